@@ -0,0 +1,242 @@
+#include "BlockEncoder.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+
+namespace
+{
+	uint16_t packColor565(const float * color)
+	{
+		uint32_t r = static_cast<uint32_t>(std::min(std::max(color[0], 0.0f), 255.0f) * 31.0f / 255.0f + 0.5f);
+		uint32_t g = static_cast<uint32_t>(std::min(std::max(color[1], 0.0f), 255.0f) * 63.0f / 255.0f + 0.5f);
+		uint32_t b = static_cast<uint32_t>(std::min(std::max(color[2], 0.0f), 255.0f) * 31.0f / 255.0f + 0.5f);
+		return static_cast<uint16_t>((r << 11) | (g << 5) | b);
+	}
+
+	// Back to 8 bits per channel, as the GPU does when decoding
+	void unpackColor565(uint16_t packed, int * color)
+	{
+		int r = (packed >> 11) & 31;
+		int g = (packed >> 5) & 63;
+		int b = packed & 31;
+		color[0] = (r << 3) | (r >> 2);
+		color[1] = (g << 2) | (g >> 4);
+		color[2] = (b << 3) | (b >> 2);
+	}
+
+	void writeLittleEndian(unsigned char * output, uint64_t value, int bytes)
+	{
+		for (int i = 0; i < bytes; i++)
+		{
+			output[i] = static_cast<unsigned char>(value >> (i * 8));
+		}
+	}
+}
+
+KtxTexture BlockEncoder::encodeTexture(const unsigned char * pixels, uint32_t width, uint32_t height)
+{
+	// Only keep alpha (at twice the size) if it is used
+	bool hasAlpha = false;
+	for (size_t i = 0; i < static_cast<size_t>(width) * height && !hasAlpha; i++)
+	{
+		hasAlpha = pixels[i * 4 + 3] != 255;
+	}
+
+	KtxTexture texture;
+	texture.format = hasAlpha ? VK_FORMAT_BC3_UNORM_BLOCK : VK_FORMAT_BC1_RGB_UNORM_BLOCK;
+	texture.width = width;
+	texture.height = height;
+	texture.mipLevels = MipGenerator::getMipLevels(width, height);
+	texture.levelOffsets.resize(texture.mipLevels);
+
+	std::vector<unsigned char> mipChain = MipGenerator::generateMipChain(pixels, width, height, texture.mipLevels);
+
+	uint32_t blockSize = KtxFile::getBlockSize(texture.format);
+	for (uint32_t level = 0; level < texture.mipLevels; level++)
+	{
+		uint32_t levelWidth = std::max(width >> level, 1u);
+		uint32_t levelHeight = std::max(height >> level, 1u);
+		const unsigned char * levelPixels = mipChain.data() + MipGenerator::getMipChainSize(width, height, level);
+
+		texture.levelOffsets[level] = texture.data.size();
+		texture.data.resize(texture.data.size() + static_cast<size_t>(KtxFile::getLevelSize(texture.format, levelWidth, levelHeight)));
+		unsigned char * output = texture.data.data() + texture.levelOffsets[level];
+
+		// Blocks go left to right, top to bottom
+		unsigned char block[16 * 4];
+		for (uint32_t y = 0; y < levelHeight; y += 4)
+		{
+			for (uint32_t x = 0; x < levelWidth; x += 4)
+			{
+				readBlock(levelPixels, levelWidth, levelHeight, x, y, block);
+				if (hasAlpha)
+				{
+					encodeAlphaBlock(block, output);
+					encodeColorBlock(block, output + 8);
+				}
+				else
+				{
+					encodeColorBlock(block, output);
+				}
+				output += blockSize;
+			}
+		}
+	}
+
+	return texture;
+}
+
+void BlockEncoder::readBlock(const unsigned char * pixels, uint32_t width, uint32_t height, uint32_t x, uint32_t y, unsigned char * block)
+{
+	for (uint32_t row = 0; row < 4; row++)
+	{
+		uint32_t pixelY = std::min(y + row, height - 1);
+		for (uint32_t column = 0; column < 4; column++)
+		{
+			uint32_t pixelX = std::min(x + column, width - 1);
+			const unsigned char * pixel = pixels + (static_cast<size_t>(pixelY) * width + pixelX) * 4;
+			std::copy(pixel, pixel + 4, block + (row * 4 + column) * 4);
+		}
+	}
+}
+
+void BlockEncoder::encodeColorBlock(const unsigned char * block, unsigned char * output)
+{
+	// Mean and covariance of the colours
+	float mean[3] = { 0.0f, 0.0f, 0.0f };
+	for (int i = 0; i < 16; i++)
+	{
+		for (int c = 0; c < 3; c++) mean[c] += block[i * 4 + c] / 16.0f;
+	}
+
+	float covariance[3][3] = {};
+	for (int i = 0; i < 16; i++)
+	{
+		float offset[3] = { block[i * 4] - mean[0], block[i * 4 + 1] - mean[1], block[i * 4 + 2] - mean[2] };
+		for (int row = 0; row < 3; row++)
+		{
+			for (int column = 0; column < 3; column++) covariance[row][column] += offset[row] * offset[column];
+		}
+	}
+
+	// Principal axis by power iteration (stays along grey for a block of one colour, whose endpoints then match)
+	float axis[3] = { 1.0f, 1.0f, 1.0f };
+	for (int iteration = 0; iteration < 8; iteration++)
+	{
+		float next[3];
+		for (int row = 0; row < 3; row++)
+		{
+			next[row] = covariance[row][0] * axis[0] + covariance[row][1] * axis[1] + covariance[row][2] * axis[2];
+		}
+
+		float length = std::sqrt(next[0] * next[0] + next[1] * next[1] + next[2] * next[2]);
+		if (length < 1e-6f) break;
+		for (int c = 0; c < 3; c++) axis[c] = next[c] / length;
+	}
+
+	// Endpoints at the pixels furthest along the axis either way
+	float minProjection = 0.0f;
+	float maxProjection = 0.0f;
+	for (int i = 0; i < 16; i++)
+	{
+		float projection = 0.0f;
+		for (int c = 0; c < 3; c++) projection += (block[i * 4 + c] - mean[c]) * axis[c];
+		minProjection = std::min(minProjection, projection);
+		maxProjection = std::max(maxProjection, projection);
+	}
+
+	float maxColor[3];
+	float minColor[3];
+	for (int c = 0; c < 3; c++)
+	{
+		maxColor[c] = mean[c] + axis[c] * maxProjection;
+		minColor[c] = mean[c] + axis[c] * minProjection;
+	}
+
+	// First endpoint must be the greater for four colour mode (BC1 would otherwise read it as three colours and black)
+	uint16_t color0 = packColor565(maxColor);
+	uint16_t color1 = packColor565(minColor);
+	if (color0 < color1) std::swap(color0, color1);
+
+	uint32_t indices = 0;
+	if (color0 != color1)
+	{
+		// Palette as the GPU will decode it: the endpoints and two colours a third and two thirds between them
+		int palette[4][3];
+		unpackColor565(color0, palette[0]);
+		unpackColor565(color1, palette[1]);
+		for (int c = 0; c < 3; c++)
+		{
+			palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+			palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+		}
+
+		for (int i = 0; i < 16; i++)
+		{
+			int bestIndex = 0;
+			int bestDistance = INT32_MAX;
+			for (int index = 0; index < 4; index++)
+			{
+				int distance = 0;
+				for (int c = 0; c < 3; c++)
+				{
+					int difference = block[i * 4 + c] - palette[index][c];
+					distance += difference * difference;
+				}
+				if (distance < bestDistance)
+				{
+					bestDistance = distance;
+					bestIndex = index;
+				}
+			}
+			indices |= static_cast<uint32_t>(bestIndex) << (i * 2);
+		}
+	}
+
+	writeLittleEndian(output, color0, 2);
+	writeLittleEndian(output + 2, color1, 2);
+	writeLittleEndian(output + 4, indices, 4);
+}
+
+void BlockEncoder::encodeAlphaBlock(const unsigned char * block, unsigned char * output)
+{
+	int alpha0 = 0;
+	int alpha1 = 255;
+	for (int i = 0; i < 16; i++)
+	{
+		alpha0 = std::max(alpha0, static_cast<int>(block[i * 4 + 3]));
+		alpha1 = std::min(alpha1, static_cast<int>(block[i * 4 + 3]));
+	}
+
+	uint64_t indices = 0;
+	if (alpha0 != alpha1)
+	{
+		// Greater first gives eight values: the endpoints, then six evenly between them
+		int palette[8] = { alpha0, alpha1 };
+		for (int index = 2; index < 8; index++)
+		{
+			palette[index] = ((8 - index) * alpha0 + (index - 1) * alpha1) / 7;
+		}
+
+		for (int i = 0; i < 16; i++)
+		{
+			int bestIndex = 0;
+			int bestDistance = INT32_MAX;
+			for (int index = 0; index < 8; index++)
+			{
+				int distance = std::abs(block[i * 4 + 3] - palette[index]);
+				if (distance < bestDistance)
+				{
+					bestDistance = distance;
+					bestIndex = index;
+				}
+			}
+			indices |= static_cast<uint64_t>(bestIndex) << (i * 3);
+		}
+	}
+
+	output[0] = static_cast<unsigned char>(alpha0);
+	output[1] = static_cast<unsigned char>(alpha1);
+	writeLittleEndian(output + 2, indices, 6);
+}
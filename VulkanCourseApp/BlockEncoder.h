@@ -0,0 +1,25 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+
+#include "KtxFile.h"
+#include "MipGenerator.h"
+
+// Compresses RGBA8 images to BC1 (opaque) or BC3 (with alpha) on the CPU, for storing textures ready to upload.
+// Each 4x4 block's colours are fitted to a line through them (the principal axis), with its endpoints at the
+// furthest pixels along it. Quick rather than best quality, it is meant to be run once ahead of time
+class BlockEncoder
+{
+public:
+	// Full mip chain of the image, compressed. BC3 if any pixel isn't fully opaque, BC1 otherwise
+	static KtxTexture encodeTexture(const unsigned char * pixels, uint32_t width, uint32_t height);
+
+private:
+	// Pixels of the 4x4 block at (x, y), edge pixels repeated where it hangs off the image
+	static void readBlock(const unsigned char * pixels, uint32_t width, uint32_t height, uint32_t x, uint32_t y, unsigned char * block);
+	// 8 bytes: two RGB565 endpoints and 2 bit indices (four colour mode)
+	static void encodeColorBlock(const unsigned char * block, unsigned char * output);
+	// 8 bytes: two alpha endpoints and 3 bit indices (eight value mode)
+	static void encodeAlphaBlock(const unsigned char * block, unsigned char * output);
+};
@@ -0,0 +1,191 @@
+#include "ComputeScheduler.h"
+
+#include <limits>
+
+ComputeScheduler::ComputeScheduler()
+{
+}
+
+ComputeScheduler::ComputeScheduler(VkDevice newDevice, VkQueue newQueue, uint32_t newQueueFamily, uint32_t newGraphicsQueueFamily, uint32_t newFrameCount)
+{
+	device = newDevice;
+	queue = newQueue;
+	queueFamily = newQueueFamily;
+	graphicsQueueFamily = newGraphicsQueueFamily;
+
+	// Each frame re-records its command buffer every time it has work
+	VkCommandPoolCreateInfo poolInfo = {};
+	poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+	poolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+	poolInfo.queueFamilyIndex = queueFamily;
+
+	VkResult result = vkCreateCommandPool(device, &poolInfo, nullptr, &commandPool);
+	if (result != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to create a Compute Command Pool!");
+	}
+
+	commandBuffers.resize(newFrameCount);
+	submittedValues.resize(newFrameCount, 0);
+
+	VkCommandBufferAllocateInfo allocInfo = {};
+	allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+	allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+	allocInfo.commandPool = commandPool;
+	allocInfo.commandBufferCount = newFrameCount;
+
+	result = vkAllocateCommandBuffers(device, &allocInfo, commandBuffers.data());
+	if (result != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to allocate Compute Command Buffers!");
+	}
+
+	VkSemaphoreTypeCreateInfo timelineCreateInfo = {};
+	timelineCreateInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+	timelineCreateInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+	timelineCreateInfo.initialValue = 0;
+
+	VkSemaphoreCreateInfo semaphoreCreateInfo = {};
+	semaphoreCreateInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+	semaphoreCreateInfo.pNext = &timelineCreateInfo;
+
+	result = vkCreateSemaphore(device, &semaphoreCreateInfo, nullptr, &timeline);
+	if (result != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to create a Compute Timeline Semaphore!");
+	}
+}
+
+VkCommandBuffer ComputeScheduler::begin(uint32_t frameIndex)
+{
+	// Command buffer can't be reset while its last submission is still running
+	wait(submittedValues[frameIndex]);
+
+	VkCommandBuffer commandBuffer = commandBuffers[frameIndex];
+	vkResetCommandBuffer(commandBuffer, 0);
+
+	VkCommandBufferBeginInfo beginInfo = {};
+	beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+	VkResult result = vkBeginCommandBuffer(commandBuffer, &beginInfo);
+	if (result != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to start recording a Compute Command Buffer!");
+	}
+
+	return commandBuffer;
+}
+
+uint64_t ComputeScheduler::submit(uint32_t frameIndex, const std::vector<QueueWait> & waits)
+{
+	VkCommandBuffer commandBuffer = commandBuffers[frameIndex];
+
+	VkResult result = vkEndCommandBuffer(commandBuffer);
+	if (result != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to stop recording a Compute Command Buffer!");
+	}
+
+	std::vector<VkSemaphore> waitSemaphores;
+	std::vector<uint64_t> waitValues;
+	std::vector<VkPipelineStageFlags> waitStages;
+	for (const auto &queueWait : waits)
+	{
+		waitSemaphores.push_back(queueWait.semaphore);
+		waitValues.push_back(queueWait.value);
+		waitStages.push_back(queueWait.stages);
+	}
+
+	uint64_t signalValue = ++lastValue;
+
+	VkTimelineSemaphoreSubmitInfo timelineSubmitInfo = {};
+	timelineSubmitInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+	timelineSubmitInfo.waitSemaphoreValueCount = static_cast<uint32_t>(waitValues.size());
+	timelineSubmitInfo.pWaitSemaphoreValues = waitValues.data();
+	timelineSubmitInfo.signalSemaphoreValueCount = 1;
+	timelineSubmitInfo.pSignalSemaphoreValues = &signalValue;
+
+	VkSubmitInfo submitInfo = {};
+	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+	submitInfo.pNext = &timelineSubmitInfo;
+	submitInfo.waitSemaphoreCount = static_cast<uint32_t>(waitSemaphores.size());
+	submitInfo.pWaitSemaphores = waitSemaphores.data();
+	submitInfo.pWaitDstStageMask = waitStages.data();
+	submitInfo.commandBufferCount = 1;
+	submitInfo.pCommandBuffers = &commandBuffer;
+	submitInfo.signalSemaphoreCount = 1;
+	submitInfo.pSignalSemaphores = &timeline;
+
+	result = vkQueueSubmit(queue, 1, &submitInfo, VK_NULL_HANDLE);
+	if (result != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to submit a Compute Command Buffer!");
+	}
+
+	submittedValues[frameIndex] = signalValue;
+	return signalValue;
+}
+
+QueueWait ComputeScheduler::getWait(VkPipelineStageFlags stages)
+{
+	QueueWait queueWait = {};
+	queueWait.semaphore = timeline;
+	queueWait.value = lastValue;
+	queueWait.stages = stages;
+	return queueWait;
+}
+
+bool ComputeScheduler::isComplete(uint64_t value)
+{
+	uint64_t completedValue;
+	vkGetSemaphoreCounterValue(device, timeline, &completedValue);
+	return completedValue >= value;
+}
+
+void ComputeScheduler::wait(uint64_t value)
+{
+	if (value == 0) return;
+
+	VkSemaphoreWaitInfo waitInfo = {};
+	waitInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+	waitInfo.semaphoreCount = 1;
+	waitInfo.pSemaphores = &timeline;
+	waitInfo.pValues = &value;
+
+	vkWaitSemaphores(device, &waitInfo, std::numeric_limits<uint64_t>::max());
+}
+
+bool ComputeScheduler::isAsync()
+{
+	return queueFamily != graphicsQueueFamily;
+}
+
+std::vector<uint32_t> ComputeScheduler::getQueueFamilies()
+{
+	if (isAsync())
+	{
+		return { graphicsQueueFamily, queueFamily };
+	}
+	return { graphicsQueueFamily };
+}
+
+void ComputeScheduler::destroyComputeScheduler()
+{
+	if (commandPool == VK_NULL_HANDLE) return;
+
+	// Everything submitted must be done before its command buffers go
+	wait(lastValue);
+
+	vkDestroyCommandPool(device, commandPool, nullptr);
+	vkDestroySemaphore(device, timeline, nullptr);
+
+	commandBuffers.clear();
+	submittedValues.clear();
+	commandPool = VK_NULL_HANDLE;
+	timeline = VK_NULL_HANDLE;
+}
+
+ComputeScheduler::~ComputeScheduler()
+{
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#define GLFW_INCLUDE_VULKAN
+
+#include <GLFW/glfw3.h>
+
+#include <vector>
+#include <stdexcept>
+
+#include "Utilities.h"
+
+// Semaphore value a queue submission must wait for, and the stages of the submission that wait for it
+struct QueueWait {
+	VkSemaphore semaphore = VK_NULL_HANDLE;
+	uint64_t value = 0;
+	VkPipelineStageFlags stages = 0;
+};
+
+// Runs compute work on a compute queue of its own, so it can overlap rendering on the graphics queue.
+// Each frame in flight records its work in to its own command buffer (between begin() and submit()), and every submit
+// signals a timeline semaphore. Graphics submissions that use the results wait on getWait(), and work can wait on other
+// queues' semaphores in turn. Results are made visible by the semaphore, so need no barriers between the queues
+// If the device has no separate compute family, the graphics queue is used and the same waits still apply
+// Resources used by both families must be shared between them (created with the families from getQueueFamilies())
+class ComputeScheduler
+{
+public:
+	ComputeScheduler();
+	ComputeScheduler(VkDevice newDevice, VkQueue newQueue, uint32_t newQueueFamily, uint32_t newGraphicsQueueFamily, uint32_t newFrameCount);
+
+	// Start recording a frame's work (waits for the frame's previous work, if it is still running)
+	VkCommandBuffer begin(uint32_t frameIndex);
+	// Submit a frame's work, to start once every wait is met. Returns the timeline value reached when it is done
+	uint64_t submit(uint32_t frameIndex, const std::vector<QueueWait> & waits);
+
+	// Wait for another submission to add, so the given stages of it see the results of all work submitted so far
+	QueueWait getWait(VkPipelineStageFlags stages);
+	bool isComplete(uint64_t value);
+	void wait(uint64_t value);
+
+	// Whether work runs on a different queue family to graphics (and so can overlap it)
+	bool isAsync();
+	// Families that resources used by both compute work and graphics must be shared between (one if they are the same)
+	std::vector<uint32_t> getQueueFamilies();
+
+	void destroyComputeScheduler();
+
+	~ComputeScheduler();
+
+private:
+	VkCommandPool commandPool = VK_NULL_HANDLE;
+	std::vector<VkCommandBuffer> commandBuffers;		// One per frame in flight
+	std::vector<uint64_t> submittedValues;				// Timeline value of the last work submitted by each frame (0 if none)
+
+	VkSemaphore timeline = VK_NULL_HANDLE;				// Reaches the value of each submission as it completes
+	uint64_t lastValue = 0;
+
+	VkDevice device;
+	VkQueue queue;
+	uint32_t queueFamily;
+	uint32_t graphicsQueueFamily;
+};
@@ -0,0 +1,77 @@
+#include "DrawList.h"
+
+DrawList::DrawList()
+{
+}
+
+uint64_t DrawList::makeKey(uint32_t pipeline, uint32_t texture, uint32_t geometry, float depth)
+{
+	// Bits of a positive float sort in the same order as the float itself
+	uint32_t depthBits = 0;
+	if (depth > 0.0f)
+	{
+		memcpy(&depthBits, &depth, sizeof(depthBits));
+	}
+
+	return (static_cast<uint64_t>(pipeline & 0xFF) << 56)
+		| (static_cast<uint64_t>(texture & 0xFFFF) << 40)
+		| (static_cast<uint64_t>(geometry & 0xFF) << 32)
+		| depthBits;
+}
+
+void DrawList::clear()
+{
+	items.clear();
+}
+
+void DrawList::add(uint64_t key, uint32_t meshIndex)
+{
+	items.push_back({ key, meshIndex });
+}
+
+void DrawList::sort()
+{
+	// Least significant digit radix sort, a byte at a time (stable, so equal keys stay in scene order)
+	scratch.resize(items.size());
+
+	for (uint32_t shift = 0; shift < 64; shift += 8)
+	{
+		size_t counts[256] = {};
+		for (const auto &item : items)
+		{
+			counts[(item.key >> shift) & 0xFF]++;
+		}
+
+		// Every key has the same byte here (e.g. only one pipeline), so this pass wouldn't move anything
+		if (counts[(items.empty() ? 0 : items[0].key >> shift) & 0xFF] == items.size()) continue;
+
+		// Turn counts in to the first position of each byte value
+		size_t offset = 0;
+		for (auto &count : counts)
+		{
+			size_t bucketSize = count;
+			count = offset;
+			offset += bucketSize;
+		}
+
+		for (const auto &item : items)
+		{
+			scratch[counts[(item.key >> shift) & 0xFF]++] = item;
+		}
+		items.swap(scratch);
+	}
+}
+
+size_t DrawList::size()
+{
+	return items.size();
+}
+
+const DrawItem & DrawList::operator[](size_t index) const
+{
+	return items[index];
+}
+
+DrawList::~DrawList()
+{
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <cstring>
+
+// One mesh to draw, with the key it is sorted by
+struct DrawItem {
+	uint64_t key;
+	uint32_t meshIndex;			// Index of mesh counting across all models (its place in the render list)
+};
+
+// Draws sorted so those sharing state are next to each other, and state only has to be bound when it changes.
+// Keys order by pipeline, then texture, then geometry buffer, then depth (front to back)
+class DrawList
+{
+public:
+	DrawList();
+
+	// Pipeline: 8 bits, texture: 16 bits, geometry buffer: 8 bits, depth: 32 bits (distance in front of camera, negatives clamp to 0)
+	static uint64_t makeKey(uint32_t pipeline, uint32_t texture, uint32_t geometry, float depth);
+
+	void clear();
+	void add(uint64_t key, uint32_t meshIndex);
+	void sort();
+
+	size_t size();
+	const DrawItem & operator[](size_t index) const;
+
+	~DrawList();
+
+private:
+	std::vector<DrawItem> items;
+	std::vector<DrawItem> scratch;			// Radix sort ping-pongs between this and items
+};
@@ -0,0 +1,126 @@
+#include "FrustumCuller.h"
+
+#include <immintrin.h>
+
+FrustumCuller::FrustumCuller()
+{
+	for (auto &plane : planes)
+	{
+		plane = glm::vec4(0.0f);
+	}
+}
+
+void FrustumCuller::setFrustum(const glm::mat4 & viewProjection)
+{
+	extractFrustumPlanes(viewProjection, planes);
+}
+
+void FrustumCuller::clearBoxes()
+{
+	centreX.clear(); centreY.clear(); centreZ.clear();
+	extentX.clear(); extentY.clear(); extentZ.clear();
+}
+
+void FrustumCuller::addBox(const glm::mat4 & transform, const glm::vec3 & boxMin, const glm::vec3 & boxMax)
+{
+	glm::vec3 centre = (boxMin + boxMax) * 0.5f;
+	glm::vec3 extent = (boxMax - boxMin) * 0.5f;
+
+	// Transformed box centre
+	glm::vec3 worldCentre = glm::vec3(transform * glm::vec4(centre, 1.0f));
+
+	// Smallest world space box that holds the rotated/scaled box: each axis gets the extents projected on to it
+	glm::vec3 worldExtent;
+	for (int axis = 0; axis < 3; axis++)
+	{
+		worldExtent[axis] = std::abs(transform[0][axis]) * extent.x
+			+ std::abs(transform[1][axis]) * extent.y
+			+ std::abs(transform[2][axis]) * extent.z;
+	}
+
+	centreX.push_back(worldCentre.x); centreY.push_back(worldCentre.y); centreZ.push_back(worldCentre.z);
+	extentX.push_back(worldExtent.x); extentY.push_back(worldExtent.y); extentZ.push_back(worldExtent.z);
+}
+
+size_t FrustumCuller::getBoxCount()
+{
+	return centreX.size();
+}
+
+size_t FrustumCuller::cull(std::vector<uint8_t>& visible)
+{
+	size_t boxCount = centreX.size();
+	visible.resize(boxCount);
+
+	// Pad to a whole number of SIMD registers, so loads never go past the end (padding results are ignored)
+	padBoxes((boxCount + 7) & ~static_cast<size_t>(7));
+
+	// A box is outside if it is entirely behind any plane: distance of centre < -(extents projected on to plane normal)
+	// Comparisons are "not less than" so a box is kept if the frustum is invalid (NaN)
+	size_t visibleCount = 0;
+	size_t i = 0;
+
+#if defined(__AVX__)
+	for (; i < boxCount; i += 8)
+	{
+		__m256 cx = _mm256_loadu_ps(&centreX[i]), cy = _mm256_loadu_ps(&centreY[i]), cz = _mm256_loadu_ps(&centreZ[i]);
+		__m256 ex = _mm256_loadu_ps(&extentX[i]), ey = _mm256_loadu_ps(&extentY[i]), ez = _mm256_loadu_ps(&extentZ[i]);
+		__m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+
+		for (const auto &plane : planes)
+		{
+			__m256 distance = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(cx, _mm256_set1_ps(plane.x)), _mm256_mul_ps(cy, _mm256_set1_ps(plane.y))),
+				_mm256_add_ps(_mm256_mul_ps(cz, _mm256_set1_ps(plane.z)), _mm256_set1_ps(plane.w)));
+			__m256 radius = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(ex, _mm256_set1_ps(std::abs(plane.x))), _mm256_mul_ps(ey, _mm256_set1_ps(std::abs(plane.y)))),
+				_mm256_mul_ps(ez, _mm256_set1_ps(std::abs(plane.z))));
+
+			inside = _mm256_and_ps(inside, _mm256_cmp_ps(_mm256_add_ps(distance, radius), _mm256_setzero_ps(), _CMP_NLT_UQ));
+		}
+
+		int mask = _mm256_movemask_ps(inside);
+		for (size_t lane = 0; lane < 8 && i + lane < boxCount; lane++)
+		{
+			visible[i + lane] = (mask >> lane) & 1;
+			visibleCount += visible[i + lane];
+		}
+	}
+#else
+	for (; i < boxCount; i += 4)
+	{
+		__m128 cx = _mm_loadu_ps(&centreX[i]), cy = _mm_loadu_ps(&centreY[i]), cz = _mm_loadu_ps(&centreZ[i]);
+		__m128 ex = _mm_loadu_ps(&extentX[i]), ey = _mm_loadu_ps(&extentY[i]), ez = _mm_loadu_ps(&extentZ[i]);
+		__m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+
+		for (const auto &plane : planes)
+		{
+			__m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(cx, _mm_set1_ps(plane.x)), _mm_mul_ps(cy, _mm_set1_ps(plane.y))),
+				_mm_add_ps(_mm_mul_ps(cz, _mm_set1_ps(plane.z)), _mm_set1_ps(plane.w)));
+			__m128 radius = _mm_add_ps(_mm_add_ps(_mm_mul_ps(ex, _mm_set1_ps(std::abs(plane.x))), _mm_mul_ps(ey, _mm_set1_ps(std::abs(plane.y)))),
+				_mm_mul_ps(ez, _mm_set1_ps(std::abs(plane.z))));
+
+			inside = _mm_and_ps(inside, _mm_cmpnlt_ps(_mm_add_ps(distance, radius), _mm_setzero_ps()));
+		}
+
+		int mask = _mm_movemask_ps(inside);
+		for (size_t lane = 0; lane < 4 && i + lane < boxCount; lane++)
+		{
+			visible[i + lane] = (mask >> lane) & 1;
+			visibleCount += visible[i + lane];
+		}
+	}
+#endif
+
+	padBoxes(boxCount);
+
+	return visibleCount;
+}
+
+void FrustumCuller::padBoxes(size_t count)
+{
+	centreX.resize(count); centreY.resize(count); centreZ.resize(count);
+	extentX.resize(count); extentY.resize(count); extentZ.resize(count);
+}
+
+FrustumCuller::~FrustumCuller()
+{
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <cmath>
+
+#include <glm.hpp>
+
+#include "Utilities.h"
+
+// Tests world space bounding boxes against a view frustum.
+// Boxes are stored as a structure of arrays so SIMD can test several at once (4 with SSE, 8 with AVX when compiled for it)
+class FrustumCuller
+{
+public:
+	FrustumCuller();
+
+	void setFrustum(const glm::mat4 & viewProjection);
+
+	// Boxes to test, given as a local space box and the transform that places it in the world
+	void clearBoxes();
+	void addBox(const glm::mat4 & transform, const glm::vec3 & boxMin, const glm::vec3 & boxMax);
+	size_t getBoxCount();
+
+	// Test every box added, visible[i] is set to 1 if box i is at least partly inside the frustum (0 if not)
+	// Returns number of visible boxes
+	size_t cull(std::vector<uint8_t> & visible);
+
+	~FrustumCuller();
+
+private:
+	glm::vec4 planes[6];
+
+	// World space centres and half extents of boxes
+	std::vector<float> centreX, centreY, centreZ;
+	std::vector<float> extentX, extentY, extentZ;
+
+	void padBoxes(size_t count);
+};
@@ -0,0 +1,133 @@
+#include "GeometryPool.h"
+
+GeometryPool::GeometryPool()
+{
+}
+
+GeometryPool::GeometryPool(MemoryAllocator * newAllocator, uint32_t newVertexCapacity, uint32_t newIndexCapacity)
+{
+	allocator = newAllocator;
+
+	// Buffers are only written by transfers, so can be in GPU only memory
+	allocator->createBuffer(sizeof(Vertex) * newVertexCapacity,
+		VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, MEMORY_CATEGORY_GEOMETRY, &vertexBuffer, &vertexBufferMemory);
+	allocator->createBuffer(sizeof(uint32_t) * newIndexCapacity,
+		VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
+		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, MEMORY_CATEGORY_GEOMETRY, &indexBuffer, &indexBufferMemory);
+
+	// Everything starts free
+	freeVertices.push_back({ 0, newVertexCapacity });
+	freeIndices.push_back({ 0, newIndexCapacity });
+}
+
+GeometryAllocation GeometryPool::upload(UploadManager * uploadManager, std::vector<Vertex>* vertices, std::vector<uint32_t>* indices)
+{
+	GeometryAllocation allocation = {};
+	allocation.vertexCount = static_cast<uint32_t>(vertices->size());
+	allocation.indexCount = static_cast<uint32_t>(indices->size());
+
+	// Find space for both, giving back the vertex space if there is no room for the indices
+	uint32_t vertexOffset = 0;
+	if (!allocateRange(freeVertices, allocation.vertexCount, &vertexOffset))
+	{
+		throw std::runtime_error("Geometry Pool out of vertex space!");
+	}
+	if (!allocateRange(freeIndices, allocation.indexCount, &allocation.firstIndex))
+	{
+		freeRange(freeVertices, vertexOffset, allocation.vertexCount);
+		throw std::runtime_error("Geometry Pool out of index space!");
+	}
+	allocation.vertexOffset = static_cast<int32_t>(vertexOffset);
+
+	// Copy each part to its place in the pool, along with everything else uploaded in the same batch
+	uploadManager->uploadBuffer(vertexBuffer, sizeof(Vertex) * vertexOffset, vertices->data(), sizeof(Vertex) * allocation.vertexCount);
+	uploadManager->uploadBuffer(indexBuffer, sizeof(uint32_t) * allocation.firstIndex, indices->data(), sizeof(uint32_t) * allocation.indexCount);
+
+	return allocation;
+}
+
+void GeometryPool::free(const GeometryAllocation & allocation)
+{
+	// Caller must make sure the GPU is no longer drawing from this range
+	freeRange(freeVertices, static_cast<uint32_t>(allocation.vertexOffset), allocation.vertexCount);
+	freeRange(freeIndices, allocation.firstIndex, allocation.indexCount);
+}
+
+VkBuffer GeometryPool::getVertexBuffer()
+{
+	return vertexBuffer;
+}
+
+VkBuffer GeometryPool::getIndexBuffer()
+{
+	return indexBuffer;
+}
+
+void GeometryPool::destroyGeometryPool()
+{
+	if (vertexBuffer == VK_NULL_HANDLE) return;
+
+	allocator->destroyBuffer(vertexBuffer, vertexBufferMemory);
+	allocator->destroyBuffer(indexBuffer, indexBufferMemory);
+
+	vertexBuffer = VK_NULL_HANDLE;
+	indexBuffer = VK_NULL_HANDLE;
+	freeVertices.clear();
+	freeIndices.clear();
+}
+
+GeometryPool::~GeometryPool()
+{
+}
+
+bool GeometryPool::allocateRange(std::vector<FreeRange>& freeRanges, uint32_t size, uint32_t * offset)
+{
+	if (size == 0)
+	{
+		*offset = 0;
+		return true;
+	}
+
+	// First fit, taking from the start of the range so the rest stays in one piece
+	for (size_t i = 0; i < freeRanges.size(); i++)
+	{
+		if (freeRanges[i].size < size) continue;
+
+		*offset = freeRanges[i].offset;
+		freeRanges[i].offset += size;
+		freeRanges[i].size -= size;
+		if (freeRanges[i].size == 0)
+		{
+			freeRanges.erase(freeRanges.begin() + i);
+		}
+		return true;
+	}
+
+	return false;
+}
+
+void GeometryPool::freeRange(std::vector<FreeRange>& freeRanges, uint32_t offset, uint32_t size)
+{
+	if (size == 0) return;
+
+	// Insert in offset order
+	size_t i = 0;
+	while (i < freeRanges.size() && freeRanges[i].offset < offset)
+	{
+		i++;
+	}
+	freeRanges.insert(freeRanges.begin() + i, { offset, size });
+
+	// Merge with the following range, then with the previous one
+	if (i + 1 < freeRanges.size() && freeRanges[i].offset + freeRanges[i].size == freeRanges[i + 1].offset)
+	{
+		freeRanges[i].size += freeRanges[i + 1].size;
+		freeRanges.erase(freeRanges.begin() + i + 1);
+	}
+	if (i > 0 && freeRanges[i - 1].offset + freeRanges[i - 1].size == freeRanges[i].offset)
+	{
+		freeRanges[i - 1].size += freeRanges[i].size;
+		freeRanges.erase(freeRanges.begin() + i);
+	}
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#define GLFW_INCLUDE_VULKAN
+
+#include <GLFW/glfw3.h>
+
+#include <vector>
+#include <stdexcept>
+
+#include "Utilities.h"
+#include "MemoryAllocator.h"
+#include "UploadManager.h"
+
+// Where a mesh's geometry lives in the pool (offsets are in vertices/indices, as passed to vkCmdDrawIndexed)
+struct GeometryAllocation {
+	int32_t vertexOffset;
+	uint32_t vertexCount;
+	uint32_t firstIndex;
+	uint32_t indexCount;
+};
+
+// One device local vertex buffer and one index buffer shared by every mesh.
+// Meshes are given a range of each, so a whole frame can bind them once and draw with offsets
+class GeometryPool
+{
+public:
+	GeometryPool();
+	GeometryPool(MemoryAllocator * newAllocator, uint32_t newVertexCapacity, uint32_t newIndexCapacity);
+
+	// Allocate space for the vertices and indices and queue their copy in (part of the upload manager's next submit)
+	GeometryAllocation upload(UploadManager * uploadManager, std::vector<Vertex> * vertices, std::vector<uint32_t> * indices);
+	void free(const GeometryAllocation & allocation);
+
+	VkBuffer getVertexBuffer();
+	VkBuffer getIndexBuffer();
+
+	void destroyGeometryPool();
+
+	~GeometryPool();
+
+private:
+	// Unused range of a buffer (in elements)
+	struct FreeRange {
+		uint32_t offset;
+		uint32_t size;
+	};
+
+	VkBuffer vertexBuffer = VK_NULL_HANDLE;
+	MemoryAllocation vertexBufferMemory;
+	std::vector<FreeRange> freeVertices;		// Sorted by offset, neighbouring ranges are always merged
+
+	VkBuffer indexBuffer = VK_NULL_HANDLE;
+	MemoryAllocation indexBufferMemory;
+	std::vector<FreeRange> freeIndices;
+
+	MemoryAllocator * allocator;
+
+	static bool allocateRange(std::vector<FreeRange> & freeRanges, uint32_t size, uint32_t * offset);
+	static void freeRange(std::vector<FreeRange> & freeRanges, uint32_t offset, uint32_t size);
+};
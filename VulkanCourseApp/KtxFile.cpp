@@ -0,0 +1,238 @@
+#include "KtxFile.h"
+
+#include "MipGenerator.h"
+
+#include <fstream>
+#include <cstring>
+#include <algorithm>
+
+namespace
+{
+	const unsigned char KTX2_IDENTIFIER[12] = { 0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n' };
+
+	// Sizes of the fixed parts of the file: identifier, header, index, then one entry per level
+	const size_t KTX2_HEADER_SIZE = 12 + 9 * 4;
+	const size_t KTX2_INDEX_SIZE = 4 * 4 + 2 * 8;
+	const size_t KTX2_LEVEL_INDEX_ENTRY_SIZE = 3 * 8;
+
+	// Data format descriptor values (Khronos Data Format Specification) for the formats written
+	const uint32_t KHR_DF_MODEL_BC1A = 128;
+	const uint32_t KHR_DF_MODEL_BC3 = 130;
+	const uint32_t KHR_DF_MODEL_BC7 = 134;
+	const uint32_t KHR_DF_CHANNEL_COLOR = 0;
+	const uint32_t KHR_DF_CHANNEL_BC1A_ALPHAPRESENT = 1;
+	const uint32_t KHR_DF_CHANNEL_BC3_ALPHA = 15;
+	const uint32_t KHR_DF_PRIMARIES_BT709 = 1;
+	const uint32_t KHR_DF_TRANSFER_LINEAR = 1;
+
+	// File is little endian, as is everything this runs on
+	template <typename T>
+	T readValue(const std::vector<char> & file, size_t offset)
+	{
+		if (offset + sizeof(T) > file.size())
+		{
+			throw std::runtime_error("Failed to read a KTX2 file, it is too short!");
+		}
+
+		T value;
+		memcpy(&value, file.data() + offset, sizeof(T));
+		return value;
+	}
+
+	template <typename T>
+	void writeValue(std::vector<char> & file, size_t offset, T value)
+	{
+		memcpy(file.data() + offset, &value, sizeof(T));
+	}
+
+	// Basic descriptor block: one sample per 64 bits of block (colour, or BC3's alpha then colour)
+	std::vector<uint32_t> createDataFormatDescriptor(VkFormat format)
+	{
+		uint32_t colorModel = KHR_DF_MODEL_BC1A;
+		std::vector<uint32_t> sampleChannels = { KHR_DF_CHANNEL_COLOR };
+		if (format == VK_FORMAT_BC1_RGBA_UNORM_BLOCK)
+		{
+			sampleChannels = { KHR_DF_CHANNEL_BC1A_ALPHAPRESENT };
+		}
+		else if (format == VK_FORMAT_BC3_UNORM_BLOCK)
+		{
+			colorModel = KHR_DF_MODEL_BC3;
+			sampleChannels = { KHR_DF_CHANNEL_BC3_ALPHA, KHR_DF_CHANNEL_COLOR };
+		}
+		else if (format == VK_FORMAT_BC7_UNORM_BLOCK)
+		{
+			colorModel = KHR_DF_MODEL_BC7;
+		}
+
+		uint32_t blockSize = KtxFile::getBlockSize(format);
+		uint32_t sampleBits = blockSize * 8 / static_cast<uint32_t>(sampleChannels.size());
+		uint32_t descriptorBlockSize = 24 + 16 * static_cast<uint32_t>(sampleChannels.size());
+
+		std::vector<uint32_t> descriptor;
+		descriptor.push_back(4 + descriptorBlockSize);					// Total size, including this
+		descriptor.push_back(0);										// Khronos vendor, basic descriptor type
+		descriptor.push_back(2 | (descriptorBlockSize << 16));			// Version 2 of the descriptor
+		descriptor.push_back(colorModel | (KHR_DF_PRIMARIES_BT709 << 8) | (KHR_DF_TRANSFER_LINEAR << 16));
+		descriptor.push_back(3 | (3 << 8));								// 4x4x1x1 texel blocks (stored minus one)
+		descriptor.push_back(blockSize);								// Bytes in plane 0 of a block
+		descriptor.push_back(0);
+		for (size_t i = 0; i < sampleChannels.size(); i++)
+		{
+			uint32_t bitOffset = static_cast<uint32_t>(i) * sampleBits;
+			descriptor.push_back(bitOffset | ((sampleBits - 1) << 16) | (sampleChannels[i] << 24));
+			descriptor.push_back(0);									// Sample position
+			descriptor.push_back(0);									// Lower value
+			descriptor.push_back(0xFFFFFFFF);							// Upper value
+		}
+
+		return descriptor;
+	}
+}
+
+bool KtxFile::load(const std::string & path, KtxTexture * texture)
+{
+	std::ifstream stream(path, std::ios::binary | std::ios::ate);
+	if (!stream.is_open()) return false;
+
+	std::vector<char> file(static_cast<size_t>(stream.tellg()));
+	stream.seekg(0);
+	stream.read(file.data(), file.size());
+	stream.close();
+
+	if (file.size() < KTX2_HEADER_SIZE + KTX2_INDEX_SIZE || memcmp(file.data(), KTX2_IDENTIFIER, sizeof(KTX2_IDENTIFIER)) != 0)
+	{
+		throw std::runtime_error("Failed to read a KTX2 file, it isn't one! (" + path + ")");
+	}
+
+	// Header
+	VkFormat format = static_cast<VkFormat>(readValue<uint32_t>(file, 12));
+	uint32_t width = readValue<uint32_t>(file, 20);
+	uint32_t height = readValue<uint32_t>(file, 24);
+	uint32_t depth = readValue<uint32_t>(file, 28);
+	uint32_t layerCount = readValue<uint32_t>(file, 32);
+	uint32_t faceCount = readValue<uint32_t>(file, 36);
+	uint32_t levelCount = std::max(readValue<uint32_t>(file, 40), 1u);			// 0 asks for mips to be generated, there is just the one
+	uint32_t supercompressionScheme = readValue<uint32_t>(file, 44);
+
+	if (getBlockSize(format) == 0)
+	{
+		throw std::runtime_error("Failed to read a KTX2 file, its format isn't BC1, BC3 or BC7! (" + path + ")");
+	}
+	if (width == 0 || height == 0 || depth > 1 || layerCount > 1 || faceCount != 1 || supercompressionScheme != 0)
+	{
+		throw std::runtime_error("Failed to read a KTX2 file, it isn't a single uncompressed 2D image! (" + path + ")");
+	}
+	if (levelCount > MipGenerator::getMipLevels(width, height))
+	{
+		throw std::runtime_error("Failed to read a KTX2 file, it has more mip levels than its size allows! (" + path + ")");
+	}
+
+	texture->format = format;
+	texture->width = width;
+	texture->height = height;
+	texture->mipLevels = levelCount;
+	texture->levelOffsets.resize(levelCount);
+	texture->data.clear();
+
+	// Levels are stored smallest first, but the level index lists them largest first
+	for (uint32_t level = 0; level < levelCount; level++)
+	{
+		size_t entry = KTX2_HEADER_SIZE + KTX2_INDEX_SIZE + level * KTX2_LEVEL_INDEX_ENTRY_SIZE;
+		uint64_t byteOffset = readValue<uint64_t>(file, entry);
+		uint64_t byteLength = readValue<uint64_t>(file, entry + 8);
+
+		VkDeviceSize levelSize = getLevelSize(format, std::max(width >> level, 1u), std::max(height >> level, 1u));
+		// Offset is checked on its own first, so a huge length can't wrap the sum back inside the file
+		if (byteLength != levelSize || byteOffset > file.size() || byteLength > file.size() - byteOffset)
+		{
+			throw std::runtime_error("Failed to read a KTX2 file, a mip level is the wrong size! (" + path + ")");
+		}
+
+		// Packed sizes are all multiples of the block size, so every level stays aligned for copies
+		texture->levelOffsets[level] = texture->data.size();
+		texture->data.insert(texture->data.end(), file.begin() + static_cast<size_t>(byteOffset),
+			file.begin() + static_cast<size_t>(byteOffset + byteLength));
+	}
+
+	return true;
+}
+
+void KtxFile::save(const std::string & path, const KtxTexture & texture)
+{
+	std::vector<uint32_t> descriptor = createDataFormatDescriptor(texture.format);
+	size_t descriptorOffset = KTX2_HEADER_SIZE + KTX2_INDEX_SIZE + texture.mipLevels * KTX2_LEVEL_INDEX_ENTRY_SIZE;
+	size_t descriptorSize = descriptor.size() * sizeof(uint32_t);
+
+	// Lay out levels smallest first, each on a block boundary
+	uint32_t blockSize = getBlockSize(texture.format);
+	std::vector<size_t> fileOffsets(texture.mipLevels);
+	size_t fileSize = descriptorOffset + descriptorSize;
+	for (uint32_t level = texture.mipLevels; level-- > 0;)
+	{
+		fileSize = (fileSize + blockSize - 1) / blockSize * blockSize;
+		fileOffsets[level] = fileSize;
+		fileSize += static_cast<size_t>(getLevelSize(texture.format, std::max(texture.width >> level, 1u), std::max(texture.height >> level, 1u)));
+	}
+
+	std::vector<char> file(fileSize, 0);
+	memcpy(file.data(), KTX2_IDENTIFIER, sizeof(KTX2_IDENTIFIER));
+
+	// Header
+	writeValue<uint32_t>(file, 12, texture.format);
+	writeValue<uint32_t>(file, 16, 1);							// Type size, 1 for block compressed formats
+	writeValue<uint32_t>(file, 20, texture.width);
+	writeValue<uint32_t>(file, 24, texture.height);
+	writeValue<uint32_t>(file, 28, 0);							// Depth (0 for 2D)
+	writeValue<uint32_t>(file, 32, 0);							// Layer count (0 if not an array)
+	writeValue<uint32_t>(file, 36, 1);							// Face count
+	writeValue<uint32_t>(file, 40, texture.mipLevels);
+	writeValue<uint32_t>(file, 44, 0);							// No supercompression
+
+	// Index (no key/value or supercompression data)
+	writeValue<uint32_t>(file, 48, static_cast<uint32_t>(descriptorOffset));
+	writeValue<uint32_t>(file, 52, static_cast<uint32_t>(descriptorSize));
+
+	for (uint32_t level = 0; level < texture.mipLevels; level++)
+	{
+		VkDeviceSize levelSize = getLevelSize(texture.format, std::max(texture.width >> level, 1u), std::max(texture.height >> level, 1u));
+
+		size_t entry = KTX2_HEADER_SIZE + KTX2_INDEX_SIZE + level * KTX2_LEVEL_INDEX_ENTRY_SIZE;
+		writeValue<uint64_t>(file, entry, fileOffsets[level]);
+		writeValue<uint64_t>(file, entry + 8, levelSize);
+		writeValue<uint64_t>(file, entry + 16, levelSize);		// Uncompressed length, the same without supercompression
+
+		memcpy(file.data() + fileOffsets[level], texture.data.data() + texture.levelOffsets[level], static_cast<size_t>(levelSize));
+	}
+
+	memcpy(file.data() + descriptorOffset, descriptor.data(), descriptorSize);
+
+	std::ofstream stream(path, std::ios::binary);
+	if (!stream.is_open())
+	{
+		throw std::runtime_error("Failed to write a KTX2 file! (" + path + ")");
+	}
+	stream.write(file.data(), file.size());
+	stream.close();
+}
+
+uint32_t KtxFile::getBlockSize(VkFormat format)
+{
+	switch (format)
+	{
+	case VK_FORMAT_BC1_RGB_UNORM_BLOCK:
+	case VK_FORMAT_BC1_RGBA_UNORM_BLOCK:
+		return 8;
+	case VK_FORMAT_BC3_UNORM_BLOCK:
+	case VK_FORMAT_BC7_UNORM_BLOCK:
+		return 16;
+	default:
+		return 0;
+	}
+}
+
+VkDeviceSize KtxFile::getLevelSize(VkFormat format, uint32_t width, uint32_t height)
+{
+	VkDeviceSize blocksWide = (width + 3) / 4;
+	VkDeviceSize blocksHigh = (height + 3) / 4;
+	return blocksWide * blocksHigh * getBlockSize(format);
+}
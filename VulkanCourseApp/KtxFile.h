@@ -0,0 +1,34 @@
+#pragma once
+
+#define GLFW_INCLUDE_VULKAN
+
+#include <GLFW/glfw3.h>
+
+#include <vector>
+#include <string>
+#include <stdexcept>
+
+// Block compressed texture with all of its mip levels, ready to copy straight in to an image
+struct KtxTexture {
+	VkFormat format = VK_FORMAT_UNDEFINED;		// Undefined if nothing was loaded
+	uint32_t width = 0;
+	uint32_t height = 0;
+	uint32_t mipLevels = 0;
+	std::vector<VkDeviceSize> levelOffsets;		// Where each level starts in data, level 0 first
+	std::vector<unsigned char> data;			// Every level packed one after another
+};
+
+// Reads and writes KTX2 files holding a single 2D image (no array layers, faces or supercompression)
+// Only the BC1, BC3 and BC7 formats are handled, since those are what textures are stored as
+class KtxFile
+{
+public:
+	// Read a file, returns false if there is no file at path (throws if it isn't a texture that can be used)
+	static bool load(const std::string & path, KtxTexture * texture);
+	static void save(const std::string & path, const KtxTexture & texture);
+
+	// Bytes in one 4x4 block of a format (0 if it isn't one handled here)
+	static uint32_t getBlockSize(VkFormat format);
+	// Bytes of one mip level of that size
+	static VkDeviceSize getLevelSize(VkFormat format, uint32_t width, uint32_t height);
+};
@@ -0,0 +1,524 @@
+#include "MemoryAllocator.h"
+
+#include <algorithm>
+
+MemoryAllocator::MemoryAllocator()
+{
+}
+
+MemoryAllocator::MemoryAllocator(VkPhysicalDevice newPhysicalDevice, VkDevice newDevice, bool newMemoryBudgetSupported)
+{
+	physicalDevice = newPhysicalDevice;
+	device = newDevice;
+	memoryBudgetSupported = newMemoryBudgetSupported;
+
+	vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memoryProperties);
+}
+
+void MemoryAllocator::createBuffer(VkDeviceSize bufferSize, VkBufferUsageFlags bufferUsage, VkMemoryPropertyFlags bufferProperties,
+	MemoryCategory category, VkBuffer * buffer, MemoryAllocation * bufferMemory)
+{
+	createBufferInPool(bufferSize, bufferUsage, bufferProperties, POOL_BUFFERS, category, {}, buffer, bufferMemory);
+}
+
+void MemoryAllocator::createSharedBuffer(VkDeviceSize bufferSize, VkBufferUsageFlags bufferUsage, VkMemoryPropertyFlags bufferProperties,
+	MemoryCategory category, const std::vector<uint32_t> & queueFamilies, VkBuffer * buffer, MemoryAllocation * bufferMemory)
+{
+	createBufferInPool(bufferSize, bufferUsage, bufferProperties, POOL_BUFFERS, category, queueFamilies, buffer, bufferMemory);
+}
+
+void MemoryAllocator::createStagingBuffer(VkDeviceSize bufferSize, VkBuffer * buffer, MemoryAllocation * bufferMemory)
+{
+	createBufferInPool(bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, POOL_STAGING, MEMORY_CATEGORY_STAGING, {}, buffer, bufferMemory);
+}
+
+void MemoryAllocator::createImage(const VkImageCreateInfo & imageCreateInfo, VkMemoryPropertyFlags imageProperties,
+	MemoryCategory category, VkImage * image, MemoryAllocation * imageMemory)
+{
+	VkResult result = vkCreateImage(device, &imageCreateInfo, nullptr, image);
+	if (result != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to create an Image!");
+	}
+
+	// Get memory requirements, and whether the driver would rather the image had memory of its own
+	VkMemoryDedicatedRequirements dedicatedRequirements = {};
+	dedicatedRequirements.sType = VK_STRUCTURE_TYPE_MEMORY_DEDICATED_REQUIREMENTS;
+
+	VkMemoryRequirements2 memoryRequirements = {};
+	memoryRequirements.sType = VK_STRUCTURE_TYPE_MEMORY_REQUIREMENTS_2;
+	memoryRequirements.pNext = &dedicatedRequirements;
+
+	VkImageMemoryRequirementsInfo2 requirementsInfo = {};
+	requirementsInfo.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_REQUIREMENTS_INFO_2;
+	requirementsInfo.image = *image;
+	vkGetImageMemoryRequirements2(device, &requirementsInfo, &memoryRequirements);
+
+	VkMemoryDedicatedAllocateInfo dedicatedInfo = {};
+	dedicatedInfo.sType = VK_STRUCTURE_TYPE_MEMORY_DEDICATED_ALLOCATE_INFO;
+	dedicatedInfo.image = *image;
+
+	// Optimal tiling images are kept out of the buffer blocks, so buffers and images are never neighbours
+	PoolKind kind = imageCreateInfo.tiling == VK_IMAGE_TILING_OPTIMAL ? POOL_OPTIMAL_IMAGES : POOL_BUFFERS;
+	*imageMemory = allocate(memoryRequirements.memoryRequirements,
+		dedicatedRequirements.prefersDedicatedAllocation || dedicatedRequirements.requiresDedicatedAllocation,
+		imageProperties, kind, dedicatedInfo);
+	imageMemory->category = category;
+	categoryUsage[getHeapIndex(*imageMemory)][category] += imageMemory->size;
+
+	vkBindImageMemory(device, *image, imageMemory->memory, imageMemory->offset);
+}
+
+void MemoryAllocator::destroyBuffer(VkBuffer buffer, MemoryAllocation & bufferMemory)
+{
+	vkDestroyBuffer(device, buffer, nullptr);
+	free(bufferMemory);
+}
+
+void MemoryAllocator::destroyImage(VkImage image, MemoryAllocation & imageMemory)
+{
+	vkDestroyImage(device, image, nullptr);
+	free(imageMemory);
+}
+
+void MemoryAllocator::free(MemoryAllocation & allocation)
+{
+	if (allocation.memory == VK_NULL_HANDLE) return;
+
+	categoryUsage[getHeapIndex(allocation)][allocation.category] -= allocation.size;
+
+	if (allocation.pool == UINT32_MAX)
+	{
+		// Dedicated, so the memory object is the allocation
+		freeMemory(allocation.memory, allocation.memoryType, allocation.size, allocation.mapped != nullptr);
+		dedicatedCount--;
+	}
+	else
+	{
+		MemoryPool &pool = pools[allocation.pool];
+		MemoryBlock &block = pool.blocks[allocation.block];
+
+		bool empty = false;
+		if (pool.kind == POOL_STAGING)
+		{
+			// Nothing is freed individually, the whole block is reused once it has no live allocations
+			block.liveAllocations--;
+			if (block.liveAllocations == 0)
+			{
+				block.head = 0;
+				empty = true;
+			}
+		}
+		else
+		{
+			returnNode(block, allocation.offset, allocation.order, pool.maxOrder);
+			empty = !block.freeNodes[pool.maxOrder].empty();
+		}
+
+		// Keep the first block of each pool around, so allocations that come and go don't keep reallocating it
+		if (empty && allocation.block > 0)
+		{
+			releaseBlock(pool, allocation.block);
+		}
+	}
+
+	allocation = MemoryAllocation();
+}
+
+VkDeviceSize MemoryAllocator::getHeapUsage(uint32_t heapIndex)
+{
+	return heapUsage[heapIndex];
+}
+
+VkDeviceSize MemoryAllocator::getCategoryUsage(uint32_t heapIndex, MemoryCategory category)
+{
+	return categoryUsage[heapIndex][category];
+}
+
+uint32_t MemoryAllocator::getHeapCount()
+{
+	return memoryProperties.memoryHeapCount;
+}
+
+uint32_t MemoryAllocator::getHeapIndex(const MemoryAllocation & allocation)
+{
+	return memoryProperties.memoryTypes[allocation.memoryType].heapIndex;
+}
+
+uint32_t MemoryAllocator::findHeapIndex(VkMemoryPropertyFlags properties)
+{
+	return memoryProperties.memoryTypes[findMemoryTypeIndex(physicalDevice, UINT32_MAX, properties)].heapIndex;
+}
+
+HeapBudget MemoryAllocator::getHeapBudget(uint32_t heapIndex)
+{
+	HeapBudget heapBudget = {};
+	heapBudget.deviceLocal = (memoryProperties.memoryHeaps[heapIndex].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) != 0;
+
+	if (memoryBudgetSupported)
+	{
+		// Driver's budget accounts for other processes, and its usage for everything this process has allocated
+		VkPhysicalDeviceMemoryBudgetPropertiesEXT budgetProperties = {};
+		budgetProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT;
+
+		VkPhysicalDeviceMemoryProperties2 memoryProperties2 = {};
+		memoryProperties2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2;
+		memoryProperties2.pNext = &budgetProperties;
+		vkGetPhysicalDeviceMemoryProperties2(physicalDevice, &memoryProperties2);
+
+		heapBudget.budget = budgetProperties.heapBudget[heapIndex];
+		heapBudget.usage = budgetProperties.heapUsage[heapIndex];
+	}
+	else
+	{
+		// Without the extension, leave a quarter of the heap for everything else using it
+		heapBudget.budget = memoryProperties.memoryHeaps[heapIndex].size / 4 * 3;
+		heapBudget.usage = heapUsage[heapIndex];
+	}
+
+	if (budgetLimit > 0 && heapBudget.deviceLocal)
+	{
+		heapBudget.budget = std::min(heapBudget.budget, budgetLimit);
+	}
+
+	return heapBudget;
+}
+
+void MemoryAllocator::setBudgetLimit(VkDeviceSize limit)
+{
+	budgetLimit = limit;
+}
+
+uint32_t MemoryAllocator::getBlockCount()
+{
+	uint32_t blockCount = 0;
+	for (const auto &pool : pools)
+	{
+		for (const auto &block : pool.blocks)
+		{
+			if (block.memory != VK_NULL_HANDLE) blockCount++;
+		}
+	}
+	return blockCount;
+}
+
+uint32_t MemoryAllocator::getDedicatedCount()
+{
+	return dedicatedCount;
+}
+
+void MemoryAllocator::destroyMemoryAllocator()
+{
+	// Every resource should have been destroyed by now, so only the blocks are left
+	for (auto &pool : pools)
+	{
+		for (uint32_t i = 0; i < pool.blocks.size(); i++)
+		{
+			releaseBlock(pool, i);
+		}
+	}
+	pools.clear();
+}
+
+MemoryAllocator::~MemoryAllocator()
+{
+}
+
+void MemoryAllocator::createBufferInPool(VkDeviceSize bufferSize, VkBufferUsageFlags bufferUsage, VkMemoryPropertyFlags bufferProperties,
+	PoolKind kind, MemoryCategory category, const std::vector<uint32_t> & queueFamilies, VkBuffer * buffer, MemoryAllocation * bufferMemory)
+{
+	// Information to create a buffer (but doesn't inlude assigning memory)
+	VkBufferCreateInfo bufferInfo = {};
+	bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+	bufferInfo.size = bufferSize;
+	bufferInfo.usage = bufferUsage;
+	bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+	// Concurrent sharing only means something between two or more different families
+	if (queueFamilies.size() > 1)
+	{
+		bufferInfo.sharingMode = VK_SHARING_MODE_CONCURRENT;
+		bufferInfo.queueFamilyIndexCount = static_cast<uint32_t>(queueFamilies.size());
+		bufferInfo.pQueueFamilyIndices = queueFamilies.data();
+	}
+
+	VkResult result = vkCreateBuffer(device, &bufferInfo, nullptr, buffer);
+	if (result != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to create a buffer!");
+	}
+
+	VkMemoryDedicatedRequirements dedicatedRequirements = {};
+	dedicatedRequirements.sType = VK_STRUCTURE_TYPE_MEMORY_DEDICATED_REQUIREMENTS;
+
+	VkMemoryRequirements2 memoryRequirements = {};
+	memoryRequirements.sType = VK_STRUCTURE_TYPE_MEMORY_REQUIREMENTS_2;
+	memoryRequirements.pNext = &dedicatedRequirements;
+
+	VkBufferMemoryRequirementsInfo2 requirementsInfo = {};
+	requirementsInfo.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_REQUIREMENTS_INFO_2;
+	requirementsInfo.buffer = *buffer;
+	vkGetBufferMemoryRequirements2(device, &requirementsInfo, &memoryRequirements);
+
+	VkMemoryDedicatedAllocateInfo dedicatedInfo = {};
+	dedicatedInfo.sType = VK_STRUCTURE_TYPE_MEMORY_DEDICATED_ALLOCATE_INFO;
+	dedicatedInfo.buffer = *buffer;
+
+	*bufferMemory = allocate(memoryRequirements.memoryRequirements,
+		dedicatedRequirements.prefersDedicatedAllocation || dedicatedRequirements.requiresDedicatedAllocation,
+		bufferProperties, kind, dedicatedInfo);
+	bufferMemory->category = category;
+	categoryUsage[getHeapIndex(*bufferMemory)][category] += bufferMemory->size;
+
+	vkBindBufferMemory(device, *buffer, bufferMemory->memory, bufferMemory->offset);
+}
+
+MemoryAllocation MemoryAllocator::allocate(const VkMemoryRequirements & requirements, bool preferDedicated,
+	VkMemoryPropertyFlags properties, PoolKind kind, const VkMemoryDedicatedAllocateInfo & dedicatedInfo)
+{
+	uint32_t memoryType = findMemoryTypeIndex(physicalDevice, requirements.memoryTypeBits, properties);
+	uint32_t poolIndex = getPool(memoryType, kind);
+	MemoryPool &pool = pools[poolIndex];
+
+	// Anything over half a block would waste most of one, so give it memory of its own
+	if (preferDedicated || requirements.size > pool.blockSize / 2)
+	{
+		return allocateDedicated(requirements, memoryType, dedicatedInfo);
+	}
+
+	MemoryAllocation allocation = {};
+	allocation.size = requirements.size;
+	allocation.memoryType = memoryType;
+	allocation.pool = poolIndex;
+
+	if (pool.kind == POOL_STAGING)
+	{
+		// Bump allocate from the first block with room (a new block if none have)
+		uint32_t blockIndex = 0;
+		VkDeviceSize offset = 0;
+		for (; blockIndex < pool.blocks.size(); blockIndex++)
+		{
+			MemoryBlock &block = pool.blocks[blockIndex];
+			if (block.memory == VK_NULL_HANDLE) continue;
+
+			offset = (block.head + requirements.alignment - 1) & ~(requirements.alignment - 1);
+			if (offset + requirements.size <= pool.blockSize) break;
+		}
+		if (blockIndex == pool.blocks.size())
+		{
+			blockIndex = createBlock(pool);
+			offset = 0;
+		}
+
+		MemoryBlock &block = pool.blocks[blockIndex];
+		block.head = offset + requirements.size;
+		block.liveAllocations++;
+
+		allocation.block = blockIndex;
+		allocation.offset = offset;
+	}
+	else
+	{
+		// Smallest node that holds the size, and is aligned (nodes are aligned to their own size)
+		VkDeviceSize nodeSize = MIN_NODE_SIZE;
+		uint32_t order = 0;
+		while (nodeSize < requirements.size || nodeSize < requirements.alignment)
+		{
+			nodeSize <<= 1;
+			order++;
+		}
+
+		uint32_t blockIndex = 0;
+		VkDeviceSize offset = 0;
+		for (; blockIndex < pool.blocks.size(); blockIndex++)
+		{
+			MemoryBlock &block = pool.blocks[blockIndex];
+			if (block.memory != VK_NULL_HANDLE && takeNode(block, order, pool.maxOrder, &offset)) break;
+		}
+		if (blockIndex == pool.blocks.size())
+		{
+			blockIndex = createBlock(pool);
+			takeNode(pool.blocks[blockIndex], order, pool.maxOrder, &offset);
+		}
+
+		allocation.block = blockIndex;
+		allocation.offset = offset;
+		allocation.order = order;
+	}
+
+	uint8_t * blockMapped = pool.blocks[allocation.block].mapped;
+	allocation.memory = pool.blocks[allocation.block].memory;
+	allocation.mapped = blockMapped != nullptr ? blockMapped + allocation.offset : nullptr;
+
+	return allocation;
+}
+
+MemoryAllocation MemoryAllocator::allocateDedicated(const VkMemoryRequirements & requirements, uint32_t memoryType,
+	const VkMemoryDedicatedAllocateInfo & dedicatedInfo)
+{
+	uint8_t * mapped = nullptr;
+
+	MemoryAllocation allocation = {};
+	allocation.memory = allocateMemory(memoryType, requirements.size, &dedicatedInfo, &mapped);
+	allocation.size = requirements.size;
+	allocation.mapped = mapped;
+	allocation.memoryType = memoryType;
+	allocation.pool = UINT32_MAX;
+
+	dedicatedCount++;
+
+	return allocation;
+}
+
+uint32_t MemoryAllocator::getPool(uint32_t memoryType, PoolKind kind)
+{
+	for (uint32_t i = 0; i < pools.size(); i++)
+	{
+		if (pools[i].memoryType == memoryType && pools[i].kind == kind) return i;
+	}
+
+	// First use of this memory type for this kind of resource
+	MemoryPool pool = {};
+	pool.memoryType = memoryType;
+	pool.kind = kind;
+
+	// Small heaps (e.g. device local, host visible memory) get smaller blocks, so one block isn't a large share of the heap
+	VkDeviceSize heapSize = memoryProperties.memoryHeaps[memoryProperties.memoryTypes[memoryType].heapIndex].size;
+	pool.blockSize = kind == POOL_STAGING ? STAGING_BLOCK_SIZE : MEMORY_BLOCK_SIZE;
+	while (pool.blockSize > MIN_NODE_SIZE && pool.blockSize > heapSize / 8)
+	{
+		pool.blockSize >>= 1;
+	}
+
+	pool.maxOrder = 0;
+	while ((MIN_NODE_SIZE << pool.maxOrder) < pool.blockSize)
+	{
+		pool.maxOrder++;
+	}
+
+	pools.push_back(pool);
+	return static_cast<uint32_t>(pools.size() - 1);
+}
+
+uint32_t MemoryAllocator::createBlock(MemoryPool & pool)
+{
+	// Reuse the slot of a released block, so indices held by existing allocations stay valid
+	uint32_t blockIndex = 0;
+	while (blockIndex < pool.blocks.size() && pool.blocks[blockIndex].memory != VK_NULL_HANDLE)
+	{
+		blockIndex++;
+	}
+	if (blockIndex == pool.blocks.size())
+	{
+		pool.blocks.push_back(MemoryBlock());
+	}
+
+	MemoryBlock &block = pool.blocks[blockIndex];
+	block.memory = allocateMemory(pool.memoryType, pool.blockSize, nullptr, &block.mapped);
+	block.head = 0;
+	block.liveAllocations = 0;
+
+	if (pool.kind != POOL_STAGING)
+	{
+		// Whole block starts as one free node
+		block.freeNodes.assign(pool.maxOrder + 1, std::set<VkDeviceSize>());
+		block.freeNodes[pool.maxOrder].insert(0);
+	}
+
+	return blockIndex;
+}
+
+void MemoryAllocator::releaseBlock(MemoryPool & pool, uint32_t blockIndex)
+{
+	MemoryBlock &block = pool.blocks[blockIndex];
+	if (block.memory == VK_NULL_HANDLE) return;
+
+	freeMemory(block.memory, pool.memoryType, pool.blockSize, block.mapped != nullptr);
+
+	block = MemoryBlock();
+}
+
+VkDeviceMemory MemoryAllocator::allocateMemory(uint32_t memoryType, VkDeviceSize size, const void * pNext, uint8_t ** mapped)
+{
+	VkMemoryAllocateInfo memoryAllocInfo = {};
+	memoryAllocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+	memoryAllocInfo.pNext = pNext;
+	memoryAllocInfo.allocationSize = size;
+	memoryAllocInfo.memoryTypeIndex = memoryType;
+
+	VkDeviceMemory memory;
+	VkResult result = vkAllocateMemory(device, &memoryAllocInfo, nullptr, &memory);
+	if (result != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to allocate Device Memory!");
+	}
+
+	heapUsage[memoryProperties.memoryTypes[memoryType].heapIndex] += size;
+
+	// Host visible memory stays mapped for as long as it exists
+	*mapped = nullptr;
+	if (memoryProperties.memoryTypes[memoryType].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT)
+	{
+		void * data;
+		result = vkMapMemory(device, memory, 0, VK_WHOLE_SIZE, 0, &data);
+		if (result != VK_SUCCESS)
+		{
+			throw std::runtime_error("Failed to map Device Memory!");
+		}
+		*mapped = static_cast<uint8_t *>(data);
+	}
+
+	return memory;
+}
+
+void MemoryAllocator::freeMemory(VkDeviceMemory memory, uint32_t memoryType, VkDeviceSize size, bool mapped)
+{
+	if (mapped)
+	{
+		vkUnmapMemory(device, memory);
+	}
+	vkFreeMemory(device, memory, nullptr);
+
+	heapUsage[memoryProperties.memoryTypes[memoryType].heapIndex] -= size;
+}
+
+bool MemoryAllocator::takeNode(MemoryBlock & block, uint32_t order, uint32_t maxOrder, VkDeviceSize * offset)
+{
+	// Find the smallest free node big enough
+	uint32_t nodeOrder = order;
+	while (nodeOrder <= maxOrder && block.freeNodes[nodeOrder].empty())
+	{
+		nodeOrder++;
+	}
+	if (nodeOrder > maxOrder) return false;
+
+	VkDeviceSize node = *block.freeNodes[nodeOrder].begin();
+	block.freeNodes[nodeOrder].erase(block.freeNodes[nodeOrder].begin());
+
+	// Split it in half until it is the size wanted, freeing the upper half each time
+	while (nodeOrder > order)
+	{
+		nodeOrder--;
+		block.freeNodes[nodeOrder].insert(node + (MIN_NODE_SIZE << nodeOrder));
+	}
+
+	*offset = node;
+	return true;
+}
+
+void MemoryAllocator::returnNode(MemoryBlock & block, VkDeviceSize offset, uint32_t order, uint32_t maxOrder)
+{
+	// Merge with its buddy for as long as the buddy is free too
+	VkDeviceSize node = offset;
+	while (order < maxOrder)
+	{
+		VkDeviceSize buddy = node ^ (MIN_NODE_SIZE << order);
+		if (block.freeNodes[order].erase(buddy) == 0) break;
+
+		node = std::min(node, buddy);
+		order++;
+	}
+
+	block.freeNodes[order].insert(node);
+}
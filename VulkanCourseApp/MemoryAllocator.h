@@ -0,0 +1,147 @@
+#pragma once
+
+#define GLFW_INCLUDE_VULKAN
+
+#include <GLFW/glfw3.h>
+
+#include <vector>
+#include <set>
+#include <stdexcept>
+
+#include "Utilities.h"
+
+// What memory is used for, so usage can be reported (and textures evicted) per category
+enum MemoryCategory {
+	MEMORY_CATEGORY_GEOMETRY,			// Shared vertex/index buffers
+	MEMORY_CATEGORY_TEXTURES,
+	MEMORY_CATEGORY_ATTACHMENTS,		// Depth buffer and other render targets
+	MEMORY_CATEGORY_TRANSIENT,			// Per-frame data (uniforms, instances, indirect commands)
+	MEMORY_CATEGORY_STAGING,
+	MEMORY_CATEGORY_COUNT
+};
+
+// How much of a heap may be used, and how much is
+struct HeapBudget {
+	VkDeviceSize budget = 0;			// From VK_EXT_memory_budget if supported (otherwise an estimate), lowered to any limit set
+	VkDeviceSize usage = 0;
+	bool deviceLocal = false;
+};
+
+// Device memory given to one buffer or image
+struct MemoryAllocation {
+	VkDeviceMemory memory = VK_NULL_HANDLE;		// Memory object to bind to (shared with other allocations unless dedicated)
+	VkDeviceSize offset = 0;					// Offset in to memory to bind at
+	VkDeviceSize size = 0;
+	void * mapped = nullptr;					// Host pointer to the start of the allocation (host visible memory only)
+	uint32_t memoryType = 0;
+	MemoryCategory category = MEMORY_CATEGORY_GEOMETRY;
+	uint32_t pool = UINT32_MAX;					// Pool it was sub-allocated from (UINT32_MAX for a dedicated allocation)
+	uint32_t block = 0;							// Block within the pool
+	uint32_t order = 0;							// Size of buddy node (MIN_NODE_SIZE << order)
+};
+
+// Hands out device memory from a few large blocks per memory type, instead of one vkAllocateMemory per resource.
+// - General blocks are split with a buddy allocator. Buffers and optimal tiling images get separate blocks,
+//   so neighbouring allocations never need padding to bufferImageGranularity
+// - Staging blocks are host visible and allocated linearly, resetting once everything in them has been freed
+// - Large resources (or ones the driver prefers to have alone) get a dedicated allocation
+// Host visible memory is mapped once, when allocated
+// Usage is tracked per heap and category, and heap budgets come from VK_EXT_memory_budget when the device has it
+class MemoryAllocator
+{
+public:
+	MemoryAllocator();
+	MemoryAllocator(VkPhysicalDevice newPhysicalDevice, VkDevice newDevice, bool newMemoryBudgetSupported);
+
+	void createBuffer(VkDeviceSize bufferSize, VkBufferUsageFlags bufferUsage, VkMemoryPropertyFlags bufferProperties,
+		MemoryCategory category, VkBuffer * buffer, MemoryAllocation * bufferMemory);
+	// Buffer used by more than one queue family at once, without ownership transfers (concurrent sharing)
+	void createSharedBuffer(VkDeviceSize bufferSize, VkBufferUsageFlags bufferUsage, VkMemoryPropertyFlags bufferProperties,
+		MemoryCategory category, const std::vector<uint32_t> & queueFamilies, VkBuffer * buffer, MemoryAllocation * bufferMemory);
+	// Host visible transfer source, only expected to live until its copy has finished
+	void createStagingBuffer(VkDeviceSize bufferSize, VkBuffer * buffer, MemoryAllocation * bufferMemory);
+	void createImage(const VkImageCreateInfo & imageCreateInfo, VkMemoryPropertyFlags imageProperties,
+		MemoryCategory category, VkImage * image, MemoryAllocation * imageMemory);
+
+	void destroyBuffer(VkBuffer buffer, MemoryAllocation & bufferMemory);
+	void destroyImage(VkImage image, MemoryAllocation & imageMemory);
+	void free(MemoryAllocation & allocation);
+
+	// Bytes of device memory currently allocated from each heap (blocks and dedicated allocations)
+	VkDeviceSize getHeapUsage(uint32_t heapIndex);
+	// Bytes given to resources of a category from a heap (excludes unused space in blocks)
+	VkDeviceSize getCategoryUsage(uint32_t heapIndex, MemoryCategory category);
+	uint32_t getHeapCount();
+	uint32_t getHeapIndex(const MemoryAllocation & allocation);
+	// Heap memory of the given properties comes from
+	uint32_t findHeapIndex(VkMemoryPropertyFlags properties);
+
+	HeapBudget getHeapBudget(uint32_t heapIndex);
+	// Lower the budget of device local heaps to this many bytes (0 = no limit, use the driver's budget)
+	void setBudgetLimit(VkDeviceSize limit);
+
+	uint32_t getBlockCount();
+	uint32_t getDedicatedCount();
+
+	void destroyMemoryAllocator();
+
+	~MemoryAllocator();
+
+private:
+	static const VkDeviceSize MIN_NODE_SIZE = 256;
+
+	// What a pool's blocks hold
+	enum PoolKind {
+		POOL_BUFFERS,				// Buffers and linear tiling images, buddy allocated
+		POOL_OPTIMAL_IMAGES,		// Optimal tiling images, buddy allocated
+		POOL_STAGING				// Staging buffers, linearly allocated
+	};
+
+	struct MemoryBlock {
+		VkDeviceMemory memory = VK_NULL_HANDLE;		// VK_NULL_HANDLE once released (slot is reused by the next new block)
+		uint8_t * mapped = nullptr;
+
+		// Buddy: offsets of free nodes of each order
+		std::vector<std::set<VkDeviceSize>> freeNodes;
+
+		// Linear: next free offset, and allocations not yet freed
+		VkDeviceSize head = 0;
+		uint32_t liveAllocations = 0;
+	};
+
+	struct MemoryPool {
+		uint32_t memoryType;
+		PoolKind kind;
+		VkDeviceSize blockSize;			// Power of two
+		uint32_t maxOrder;				// Order of a node covering the whole block
+		std::vector<MemoryBlock> blocks;
+	};
+
+	VkPhysicalDeviceMemoryProperties memoryProperties = {};
+	std::vector<MemoryPool> pools;
+	VkDeviceSize heapUsage[VK_MAX_MEMORY_HEAPS] = {};
+	VkDeviceSize categoryUsage[VK_MAX_MEMORY_HEAPS][MEMORY_CATEGORY_COUNT] = {};
+	uint32_t dedicatedCount = 0;
+
+	bool memoryBudgetSupported = false;
+	VkDeviceSize budgetLimit = 0;
+
+	VkPhysicalDevice physicalDevice = VK_NULL_HANDLE;
+	VkDevice device = VK_NULL_HANDLE;
+
+	void createBufferInPool(VkDeviceSize bufferSize, VkBufferUsageFlags bufferUsage, VkMemoryPropertyFlags bufferProperties,
+		PoolKind kind, MemoryCategory category, const std::vector<uint32_t> & queueFamilies, VkBuffer * buffer, MemoryAllocation * bufferMemory);
+	MemoryAllocation allocate(const VkMemoryRequirements & requirements, bool preferDedicated,
+		VkMemoryPropertyFlags properties, PoolKind kind, const VkMemoryDedicatedAllocateInfo & dedicatedInfo);
+	MemoryAllocation allocateDedicated(const VkMemoryRequirements & requirements, uint32_t memoryType,
+		const VkMemoryDedicatedAllocateInfo & dedicatedInfo);
+
+	uint32_t getPool(uint32_t memoryType, PoolKind kind);
+	uint32_t createBlock(MemoryPool & pool);
+	void releaseBlock(MemoryPool & pool, uint32_t blockIndex);
+	VkDeviceMemory allocateMemory(uint32_t memoryType, VkDeviceSize size, const void * pNext, uint8_t ** mapped);
+	void freeMemory(VkDeviceMemory memory, uint32_t memoryType, VkDeviceSize size, bool mapped);
+
+	static bool takeNode(MemoryBlock & block, uint32_t order, uint32_t maxOrder, VkDeviceSize * offset);
+	static void returnNode(MemoryBlock & block, VkDeviceSize offset, uint32_t order, uint32_t maxOrder);
+};
@@ -5,15 +5,12 @@ Mesh::Mesh()
 
 }
 
-Mesh::Mesh(VkPhysicalDevice newPhysicalDevice, VkDevice newDevice, VkQueue transferQueue, 
-	VkCommandPool transferCommandPool, std::vector<Vertex>* vertices, std::vector<uint32_t>* indices, int newTexId)
+Mesh::Mesh(GeometryPool * newGeometryPool, UploadManager * uploadManager,
+	std::vector<Vertex>* vertices, std::vector<uint32_t>* indices, int newTexId)
 {
-	vertexCount = vertices->size();
-	indexCount = indices->size();
-	physicalDevice = newPhysicalDevice;
-	device = newDevice;
-	createVertexBuffer(transferQueue, transferCommandPool, vertices);
-	createIndexBuffer(transferQueue, transferCommandPool, indices);
+	geometryPool = newGeometryPool;
+	calculateBounds(vertices);
+	geometry = geometryPool->upload(uploadManager, vertices, indices);
 
 	model.model = glm::mat4(1.0f);
 	texId = newTexId;
@@ -41,97 +38,79 @@ void Mesh::setTexId(int newTexId)
 
 int Mesh::getVertexCount()
 {
-	return vertexCount;
+	return geometry.vertexCount;
 }
 
-int Mesh::getIndexCount()
+int32_t Mesh::getVertexOffset()
 {
-	return indexCount;
+	return geometry.vertexOffset;
 }
 
-VkBuffer Mesh::getVertexBuffer()
+int Mesh::getIndexCount()
 {
-	return vertexBuffer;
+	return geometry.indexCount;
 }
 
-VkBuffer Mesh::getIndexBuffer()
+uint32_t Mesh::getFirstIndex()
 {
-	return indexBuffer;
+	return geometry.firstIndex;
 }
 
-void Mesh::destroyBuffers()
+glm::vec4 Mesh::getBoundingSphere()
 {
-	vkDestroyBuffer(device, vertexBuffer, nullptr);
-	vkFreeMemory(device, vertexBufferMemory, nullptr);
-	vkDestroyBuffer(device, indexBuffer, nullptr);
-	vkFreeMemory(device, indexBufferMemory, nullptr);
+	return boundingSphere;
 }
 
-Mesh::~Mesh()
+glm::vec3 Mesh::getBoundingBoxMin()
 {
-
+	return boundingBoxMin;
 }
 
-void Mesh::createVertexBuffer(VkQueue transferQueue, VkCommandPool transferCommandPool, std::vector<Vertex>* vertices)
+glm::vec3 Mesh::getBoundingBoxMax()
 {
-	// Get size of buffer needed for vertices
-	VkDeviceSize bufferSize = sizeof(Vertex) * vertices->size();
-
-	// Temporary buffer to "stage" vertex data before transferring to GPU
-	VkBuffer stagingBuffer;
-	VkDeviceMemory stagingBufferMemory;
-
-	// Create Buffer and Allocate Memory to it
-	createBuffer(physicalDevice, device, bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-				VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-				&stagingBuffer, &stagingBufferMemory);
-
-
-
-	//  -- Map memory to vertex buffer --
-	void * data;																		// 1. create pointer to point in normal memory
-	vkMapMemory(device, stagingBufferMemory, 0,bufferSize, 0, &data);					// 2. map the staging buffer memory to that point
-	memcpy(data, vertices->data(), (size_t)bufferSize);									// 3. copy memory from vertices vector to the point
-	vkUnmapMemory(device, stagingBufferMemory);											// 4. Unmap the vertex buffer memory
-
-	// Create buffer with TRANSFER_DST_BIT to mark as recipient of transfer data (also VERTEX_BUFFER)
-	// Buffer memory is to be DEVICE_LOCAL_BIT meaning memory is on the GPU and only accessible by it and not CPU (host)
-	createBuffer(physicalDevice, device, bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
-		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &vertexBuffer, &vertexBufferMemory);
-	
-	// copy staging buffer to vertex buffer on GPU
-	copyBuffer(device, transferQueue, transferCommandPool, stagingBuffer, vertexBuffer, bufferSize);
-
-	// clean up staging buffer parts
-	vkDestroyBuffer(device, stagingBuffer, nullptr);
-	vkFreeMemory(device, stagingBufferMemory, nullptr);
+	return boundingBoxMax;
 }
 
-void Mesh::createIndexBuffer(VkQueue transferQueue, VkCommandPool transferCommandPool, std::vector<uint32_t>* indices)
+void Mesh::destroyGeometry()
 {
-	// Get size of buffer needed for indices
-	VkDeviceSize bufferSize = sizeof(uint32_t) * indices->size();
-
-	// Temporary buffer to "stage" index data before transferring to GPU
-	VkBuffer stagingBuffer;
-	VkDeviceMemory stagingBufferMemory;
-	createBuffer(physicalDevice, device, bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &stagingBuffer, &stagingBufferMemory);
+	// Give ranges back to the pool (buffers themselves belong to the pool)
+	geometryPool->free(geometry);
+}
 
-	//  -- Map memory to vertex buffer --
-	void* data;
-	vkMapMemory(device, stagingBufferMemory, 0, bufferSize, 0, &data);
-	memcpy(data, indices->data(), (size_t)bufferSize);
-	vkUnmapMemory(device, stagingBufferMemory);
-	
-	// Create buffer for INDEX data on GPU access only area
-	createBuffer(physicalDevice, device, bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
-		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &indexBuffer, &indexBufferMemory);
+Mesh::~Mesh()
+{
 
-	// copy staging buffer to index buffer on GPU
-	copyBuffer(device, transferQueue, transferCommandPool, stagingBuffer, indexBuffer, bufferSize);
+}
 
-	// clean up staging buffer parts
-	vkDestroyBuffer(device, stagingBuffer, nullptr);
-	vkFreeMemory(device, stagingBufferMemory, nullptr);
+void Mesh::calculateBounds(std::vector<Vertex>* vertices)
+{
+	if (vertices->empty())
+	{
+		boundingSphere = glm::vec4(0.0f);
+		boundingBoxMin = glm::vec3(0.0f);
+		boundingBoxMax = glm::vec3(0.0f);
+		return;
+	}
+
+	// Bounding box of all vertices
+	boundingBoxMin = vertices->front().pos;
+	boundingBoxMax = vertices->front().pos;
+	for (const auto &vertex : *vertices)
+	{
+		boundingBoxMin = glm::min(boundingBoxMin, vertex.pos);
+		boundingBoxMax = glm::max(boundingBoxMax, vertex.pos);
+	}
+
+	// Centre sphere on the middle of the bounding box
+	glm::vec3 centre = (boundingBoxMin + boundingBoxMax) * 0.5f;
+
+	// Radius must reach the furthest vertex
+	float radiusSquared = 0.0f;
+	for (const auto &vertex : *vertices)
+	{
+		glm::vec3 offset = vertex.pos - centre;
+		radiusSquared = std::max(radiusSquared, glm::dot(offset, offset));
+	}
+
+	boundingSphere = glm::vec4(centre, std::sqrt(radiusSquared));
 }
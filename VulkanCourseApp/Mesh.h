@@ -5,8 +5,11 @@
 #include <GLFW/glfw3.h>
 
 #include <vector>
+#include <algorithm>
+#include <cmath>
 
 #include "Utilities.h"
+#include "GeometryPool.h"
 
 struct Model {
 	glm::mat4 model;
@@ -16,8 +19,7 @@ class Mesh
 {
 public:
 	Mesh();
-	Mesh(VkPhysicalDevice newPhysicalDevice, VkDevice newDevice, 
-		VkQueue transferQueue, VkCommandPool transferCommandPool,
+	Mesh(GeometryPool * newGeometryPool, UploadManager * uploadManager,
 		std::vector<Vertex> * vertices, std::vector<uint32_t> * indices, int newTexId);
 
 	void setModel(glm::mat4 newModel);
@@ -26,32 +28,31 @@ public:
 	int getTexId();
 	void setTexId(int newTexId);
 
+	// Geometry is in the shared pool's buffers, at these offsets
 	int getVertexCount();
-	VkBuffer getVertexBuffer();
+	int32_t getVertexOffset();
 
 	int getIndexCount();
-	VkBuffer getIndexBuffer();
+	uint32_t getFirstIndex();
 
-	void destroyBuffers();
+	glm::vec4 getBoundingSphere();
+	glm::vec3 getBoundingBoxMin();
+	glm::vec3 getBoundingBoxMax();
+
+	void destroyGeometry();
 
 	~Mesh();
 
 private:
 	Model model;
 	int texId;
+	glm::vec4 boundingSphere;		// Centre (xyz) and radius (w) in mesh space
+	glm::vec3 boundingBoxMin;		// Axis aligned bounding box in mesh space
+	glm::vec3 boundingBoxMax;
 
-	int vertexCount;
-	VkBuffer vertexBuffer;
-	VkDeviceMemory vertexBufferMemory;
-	
-	int indexCount;
-	VkBuffer indexBuffer;
-	VkDeviceMemory indexBufferMemory;
-
-	VkPhysicalDevice physicalDevice;
-	VkDevice device;
+	GeometryAllocation geometry;		// Vertex and index ranges in the pool
+	GeometryPool * geometryPool;
 
-	void createVertexBuffer(VkQueue transferQueue, VkCommandPool transferCommandPool, std::vector<Vertex> * vertices);
-	void createIndexBuffer(VkQueue transferQueue, VkCommandPool transferCommandPool, std::vector<uint32_t> * indices);
+	void calculateBounds(std::vector<Vertex> * vertices);
 };
 
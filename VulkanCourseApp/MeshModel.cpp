@@ -8,6 +8,9 @@ MeshModel::MeshModel(std::vector<Mesh> newMeshList)
 {
 	meshList = newMeshList;
 	model = glm::mat4(1.0f);
+
+	// Model starts with a single instance at the model transform
+	instances.push_back(glm::mat4(1.0f));
 }
 
 size_t MeshModel::getMeshCount()
@@ -25,6 +28,11 @@ Mesh* MeshModel::getMesh(size_t index)
 	return &meshList[index];
 }
 
+void MeshModel::setMeshes(std::vector<Mesh> newMeshList)
+{
+	meshList = newMeshList;
+}
+
 glm::mat4 MeshModel::getModel()
 {
 	return model;
@@ -35,11 +43,37 @@ void MeshModel::setModel(glm::mat4 newModel)
 	model = newModel;
 }
 
+size_t MeshModel::addInstance(glm::mat4 transform)
+{
+	instances.push_back(transform);
+	return instances.size() - 1;
+}
+
+void MeshModel::setInstance(size_t index, glm::mat4 transform)
+{
+	if (index >= instances.size())
+	{
+		throw std::runtime_error("Attempted to access invalid Instance index!");
+	}
+
+	instances[index] = transform;
+}
+
+size_t MeshModel::getInstanceCount()
+{
+	return instances.size();
+}
+
+const std::vector<glm::mat4> & MeshModel::getInstances()
+{
+	return instances;
+}
+
 void MeshModel::destroyMeshModel()
 {
 	for (auto &mesh : meshList)
 	{
-		mesh.destroyBuffers();
+		mesh.destroyGeometry();
 	}
 }
 
@@ -74,34 +108,26 @@ std::vector<std::string> MeshModel::LoadMaterials(const aiScene* scene)
 	return textureList;
 }
 
-std::vector<Mesh> MeshModel::LoadNode(VkPhysicalDevice newPhysicalDevice, VkDevice newDevice, VkQueue transferQueue, 
-	VkCommandPool transferCommandPool, aiNode* node, const aiScene* scene, std::vector<int> matToTex)
+void MeshModel::LoadNode(aiNode * node, const aiScene * scene, std::vector<MeshData> & meshDataList)
 {
-	std::vector<Mesh> meshList;
-
-	// go through each mesh at this node and create it, then add it to our meshList
+	// go through each mesh at this node and read it, then add it to our meshDataList
 	for (size_t i = 0; i < node->mNumMeshes; i++)
 	{
-		meshList.push_back(LoadMesh(newPhysicalDevice, newDevice,
-			transferQueue, transferCommandPool, scene->mMeshes[node->mMeshes[i]], scene, matToTex));
+		meshDataList.push_back(LoadMesh(scene->mMeshes[node->mMeshes[i]]));
 	}
 
-	// go through each node attached to this load, then append their meshes to this node's mesh list
+	// go through each node attached to this load, their meshes are added to the same list
 	for (size_t i = 0; i < node->mNumChildren; i++)
 	{
-		std::vector<Mesh> newList = LoadNode(newPhysicalDevice, newDevice, 
-			transferQueue, transferCommandPool, node->mChildren[i], scene, matToTex);
-		meshList.insert(meshList.end(), newList.begin(), newList.end());
+		LoadNode(node->mChildren[i], scene, meshDataList);
 	}
-
-	return meshList;
 }
 
-Mesh MeshModel::LoadMesh(VkPhysicalDevice newPhysicalDevice, VkDevice newDevice, VkQueue transferQueue, 
-	VkCommandPool transferCommandPool, aiMesh* mesh, const aiScene* scene, std::vector<int> matToTex)
+MeshData MeshModel::LoadMesh(aiMesh * mesh)
 {
-	std::vector<Vertex> vertices;
-	std::vector<uint32_t> indices;
+	MeshData meshData;
+	std::vector<Vertex> &vertices = meshData.vertices;
+	std::vector<uint32_t> &indices = meshData.indices;
 
 	// resize vertex list to hold all vertices for mesh
 	vertices.resize(mesh->mNumVertices);
@@ -138,11 +164,24 @@ Mesh MeshModel::LoadMesh(VkPhysicalDevice newPhysicalDevice, VkDevice newDevice,
 		}
 	}
 
-	// create new mesh with details and return in
-	Mesh newMesh = Mesh(newPhysicalDevice, newDevice,
-		transferQueue, transferCommandPool, &vertices, &indices, matToTex[mesh->mMaterialIndex]);
+	meshData.materialIndex = mesh->mMaterialIndex;
+
+	return meshData;
+}
+
+std::vector<Mesh> MeshModel::CreateMeshes(GeometryPool * geometryPool, UploadManager * uploadManager,
+	std::vector<MeshData> & meshDataList, std::vector<int> matToTex)
+{
+	std::vector<Mesh> meshList;
 
-	return newMesh;
+	// create new mesh with details of each
+	for (auto &meshData : meshDataList)
+	{
+		meshList.push_back(Mesh(geometryPool,
+			uploadManager, &meshData.vertices, &meshData.indices, matToTex[meshData.materialIndex]));
+	}
+
+	return meshList;
 }
 
 MeshModel::~MeshModel()
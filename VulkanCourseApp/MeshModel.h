@@ -8,6 +8,13 @@
 
 #include "Mesh.h"
 
+// Geometry of one mesh read from a model file, before any of it is on the GPU
+struct MeshData {
+	std::vector<Vertex> vertices;
+	std::vector<uint32_t> indices;
+	uint32_t materialIndex;
+};
+
 class MeshModel
 {
 public:
@@ -17,22 +24,34 @@ public:
 	size_t getMeshCount();
 	Mesh* getMesh(size_t index);
 
+	// Replace the meshes (e.g. once a model loaded in the background is ready), transform and instances are kept
+	void setMeshes(std::vector<Mesh> newMeshList);
+
 	glm::mat4 getModel();
 	void setModel(glm::mat4 newModel);
 
+	// Each instance is a copy of the model drawn with its own transform (relative to the model transform)
+	size_t addInstance(glm::mat4 transform);
+	void setInstance(size_t index, glm::mat4 transform);
+	size_t getInstanceCount();
+	const std::vector<glm::mat4> & getInstances();
+
 	void destroyMeshModel();
 
 	static std::vector<std::string> LoadMaterials(const aiScene * scene);
 
-	static std::vector<Mesh> LoadNode(VkPhysicalDevice newPhysicalDevice, VkDevice newDevice, VkQueue transferQueue, VkCommandPool transferCommandPool,
-		aiNode * node, const aiScene * scene, std::vector<int> matToTex);
+	// Reading meshes only touches CPU memory, so can be done on any thread
+	static void LoadNode(aiNode * node, const aiScene * scene, std::vector<MeshData> & meshDataList);
+	static MeshData LoadMesh(aiMesh * mesh);
 
-	static Mesh LoadMesh(VkPhysicalDevice newPhysicalDevice, VkDevice newDevice, VkQueue transferQueue, VkCommandPool transferCommandPool,
-		aiMesh* mesh, const aiScene* scene, std::vector<int> matToTex);
+	// Put loaded meshes in the geometry pool (their uploads are queued, not submitted)
+	static std::vector<Mesh> CreateMeshes(GeometryPool * geometryPool, UploadManager * uploadManager,
+		std::vector<MeshData> & meshDataList, std::vector<int> matToTex);
 
 	~MeshModel();
 private:
 	std::vector<Mesh> meshList;
 	glm::mat4 model;
+	std::vector<glm::mat4> instances;
 };
 
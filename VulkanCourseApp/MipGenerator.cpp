@@ -0,0 +1,115 @@
+#include "MipGenerator.h"
+
+#include <cstring>
+#include <algorithm>
+
+#if defined(_M_X64) || defined(__SSE2__)
+#include <emmintrin.h>
+#define MIP_GENERATOR_SSE2
+#endif
+
+uint32_t MipGenerator::getMipLevels(uint32_t width, uint32_t height)
+{
+	uint32_t levels = 1;
+	uint32_t size = std::max(width, height);
+	while (size > 1)
+	{
+		size /= 2;
+		levels++;
+	}
+	return levels;
+}
+
+size_t MipGenerator::getMipChainSize(uint32_t width, uint32_t height, uint32_t mipLevels)
+{
+	size_t size = 0;
+	for (uint32_t level = 0; level < mipLevels; level++)
+	{
+		size += static_cast<size_t>(width) * height * 4;
+		width = std::max(width / 2, 1u);
+		height = std::max(height / 2, 1u);
+	}
+	return size;
+}
+
+std::vector<unsigned char> MipGenerator::generateMipChain(const unsigned char * pixels, uint32_t width, uint32_t height, uint32_t mipLevels)
+{
+	std::vector<unsigned char> chain(getMipChainSize(width, height, mipLevels));
+	memcpy(chain.data(), pixels, static_cast<size_t>(width) * height * 4);
+
+	// Each level is made from the one before it, which sits just before it in the chain
+	size_t srcOffset = 0;
+	for (uint32_t level = 1; level < mipLevels; level++)
+	{
+		uint32_t dstWidth = std::max(width / 2, 1u);
+		uint32_t dstHeight = std::max(height / 2, 1u);
+		size_t dstOffset = srcOffset + static_cast<size_t>(width) * height * 4;
+
+		downsample(&chain[srcOffset], width, height, &chain[dstOffset], dstWidth, dstHeight);
+
+		srcOffset = dstOffset;
+		width = dstWidth;
+		height = dstHeight;
+	}
+
+	return chain;
+}
+
+void MipGenerator::downsample(const unsigned char * src, uint32_t srcWidth, uint32_t srcHeight,
+	unsigned char * dst, uint32_t dstWidth, uint32_t dstHeight)
+{
+	for (uint32_t y = 0; y < dstHeight; y++)
+	{
+		// Rows to average (the last row repeats if the source is one pixel high)
+		const unsigned char * row0 = src + static_cast<size_t>(std::min(y * 2, srcHeight - 1)) * srcWidth * 4;
+		const unsigned char * row1 = src + static_cast<size_t>(std::min(y * 2 + 1, srcHeight - 1)) * srcWidth * 4;
+		unsigned char * dstRow = dst + static_cast<size_t>(y) * dstWidth * 4;
+
+		uint32_t x = 0;
+
+#ifdef MIP_GENERATOR_SSE2
+		// 4 destination pixels at a time, from 8 source pixels of each row (only where both pixels of every pair exist)
+		const __m128i zero = _mm_setzero_si128();
+		const __m128i rounding = _mm_set1_epi16(2);
+		uint32_t pairedWidth = std::min(dstWidth, srcWidth / 2);
+		for (; x + 4 <= pairedWidth; x += 4)
+		{
+			__m128i top0 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(row0 + x * 8));
+			__m128i top1 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(row0 + x * 8 + 16));
+			__m128i bottom0 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(row1 + x * 8));
+			__m128i bottom1 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(row1 + x * 8 + 16));
+
+			// Widen to 16 bits and add the rows: each register holds two vertical pairs (one pair of neighbours)
+			__m128i sum0 = _mm_add_epi16(_mm_unpacklo_epi8(top0, zero), _mm_unpacklo_epi8(bottom0, zero));
+			__m128i sum1 = _mm_add_epi16(_mm_unpackhi_epi8(top0, zero), _mm_unpackhi_epi8(bottom0, zero));
+			__m128i sum2 = _mm_add_epi16(_mm_unpacklo_epi8(top1, zero), _mm_unpacklo_epi8(bottom1, zero));
+			__m128i sum3 = _mm_add_epi16(_mm_unpackhi_epi8(top1, zero), _mm_unpackhi_epi8(bottom1, zero));
+
+			// Add the neighbours (upper half on to lower half), then gather the four results
+			sum0 = _mm_add_epi16(sum0, _mm_srli_si128(sum0, 8));
+			sum1 = _mm_add_epi16(sum1, _mm_srli_si128(sum1, 8));
+			sum2 = _mm_add_epi16(sum2, _mm_srli_si128(sum2, 8));
+			sum3 = _mm_add_epi16(sum3, _mm_srli_si128(sum3, 8));
+			__m128i pixels01 = _mm_unpacklo_epi64(sum0, sum1);
+			__m128i pixels23 = _mm_unpacklo_epi64(sum2, sum3);
+
+			// Divide by 4 with rounding, and narrow back to bytes
+			pixels01 = _mm_srli_epi16(_mm_add_epi16(pixels01, rounding), 2);
+			pixels23 = _mm_srli_epi16(_mm_add_epi16(pixels23, rounding), 2);
+			_mm_storeu_si128(reinterpret_cast<__m128i *>(dstRow + x * 4), _mm_packus_epi16(pixels01, pixels23));
+		}
+#endif
+
+		// Remaining pixels (and all of them without SSE2)
+		for (; x < dstWidth; x++)
+		{
+			uint32_t x0 = std::min(x * 2, srcWidth - 1);
+			uint32_t x1 = std::min(x * 2 + 1, srcWidth - 1);
+			for (uint32_t c = 0; c < 4; c++)
+			{
+				uint32_t sum = row0[x0 * 4 + c] + row0[x1 * 4 + c] + row1[x0 * 4 + c] + row1[x1 * 4 + c];
+				dstRow[x * 4 + c] = static_cast<unsigned char>((sum + 2) / 4);
+			}
+		}
+	}
+}
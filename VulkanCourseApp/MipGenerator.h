@@ -0,0 +1,23 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+// Mip chains of RGBA8 images built on the CPU, for formats the GPU can't blit with linear filtering.
+// Each level is a 2x2 box filter of the one above (edge pixels are repeated when a side is odd)
+class MipGenerator
+{
+public:
+	// Levels in a full chain, down to 1x1
+	static uint32_t getMipLevels(uint32_t width, uint32_t height);
+	// Bytes of all levels packed one after another
+	static size_t getMipChainSize(uint32_t width, uint32_t height, uint32_t mipLevels);
+
+	// Every level of the chain tightly packed, level 0 (a copy of pixels) first
+	static std::vector<unsigned char> generateMipChain(const unsigned char * pixels, uint32_t width, uint32_t height, uint32_t mipLevels);
+
+private:
+	static void downsample(const unsigned char * src, uint32_t srcWidth, uint32_t srcHeight,
+		unsigned char * dst, uint32_t dstWidth, uint32_t dstHeight);
+};
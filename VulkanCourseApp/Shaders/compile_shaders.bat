@@ -1,3 +1,5 @@
 C:/VulkanSDK/1.2.182.0/Bin32/glslangValidator.exe -V shader.vert
 C:/VulkanSDK/1.2.182.0/Bin32/glslangValidator.exe -V shader.frag
+C:/VulkanSDK/1.2.182.0/Bin32/glslangValidator.exe -V shader_bindless.frag -o frag_bindless.spv
+C:/VulkanSDK/1.2.182.0/Bin32/glslangValidator.exe -V cull.comp -o cull.spv
 pause
\ No newline at end of file
@@ -0,0 +1,18 @@
+#version 450
+#extension GL_EXT_nonuniform_qualifier : require
+
+layout(location = 0) in vec3 fragCol;
+layout(location = 1) in vec2 fragTex;
+
+// Every texture in one array, indexed per draw (bindless mode)
+layout(set = 1, binding = 0) uniform sampler2D textures[];
+
+layout(push_constant) uniform PushDraw {
+	uint textureIndex;
+} pushDraw;
+
+layout(location = 0) out vec4 outColour; 	// Final output colour (must also have location
+
+void main() {
+	outColour = texture(textures[nonuniformEXT(pushDraw.textureIndex)], fragTex);
+}
@@ -0,0 +1,137 @@
+#include "TextureCache.h"
+
+#include <cctype>
+#include <cstring>
+
+TextureCache::TextureCache()
+{
+}
+
+int TextureCache::acquire(const std::string & path)
+{
+	std::lock_guard<std::mutex> lock(cacheMutex);
+
+	auto found = pathTextures.find(normalisePath(path));
+	if (found == pathTextures.end()) return -1;
+
+	referenceCounts[found->second]++;
+	hitCount++;
+	return found->second;
+}
+
+int TextureCache::acquireContent(const std::string & path, const TextureContent & content, const unsigned char * pixels)
+{
+	if (content.hash == 0) return -1;
+
+	std::lock_guard<std::mutex> lock(cacheMutex);
+
+	// Same hash isn't enough, the shape and every byte must match too
+	auto range = contentTextures.equal_range(content.hash);
+	for (auto found = range.first; found != range.second; ++found)
+	{
+		const ContentTexture &candidate = found->second;
+		if (!(candidate.content == content)
+			|| memcmp(candidate.pixels.data(), pixels, static_cast<size_t>(content.size)) != 0) continue;
+
+		pathTextures[normalisePath(path)] = candidate.texId;
+		referenceCounts[candidate.texId]++;
+		hitCount++;
+		return candidate.texId;
+	}
+
+	return -1;
+}
+
+void TextureCache::add(const std::string & path, const TextureContent & content, const unsigned char * pixels, int texId)
+{
+	std::lock_guard<std::mutex> lock(cacheMutex);
+
+	pathTextures[normalisePath(path)] = texId;
+	if (content.hash != 0)
+	{
+		ContentTexture contentTexture;
+		contentTexture.content = content;
+		contentTexture.pixels.assign(pixels, pixels + content.size);
+		contentTexture.texId = texId;
+		contentTextures.emplace(content.hash, std::move(contentTexture));
+	}
+	referenceCounts[texId] = 1;
+}
+
+bool TextureCache::release(int texId)
+{
+	std::lock_guard<std::mutex> lock(cacheMutex);
+
+	auto found = referenceCounts.find(texId);
+	if (found == referenceCounts.end() || found->second == 0) return false;
+
+	found->second--;
+	return found->second == 0;
+}
+
+uint32_t TextureCache::getReferenceCount(int texId)
+{
+	std::lock_guard<std::mutex> lock(cacheMutex);
+
+	auto found = referenceCounts.find(texId);
+	return found == referenceCounts.end() ? 0 : found->second;
+}
+
+uint32_t TextureCache::getHitCount()
+{
+	std::lock_guard<std::mutex> lock(cacheMutex);
+	return hitCount;
+}
+
+std::string TextureCache::normalisePath(const std::string & path)
+{
+	std::string normalised;
+	normalised.reserve(path.size());
+	for (char c : path)
+	{
+		normalised.push_back(c == '\\' ? '/' : static_cast<char>(std::tolower(static_cast<unsigned char>(c))));
+	}
+
+	// Remove "./" at the start or after a separator
+	size_t position = 0;
+	while ((position = normalised.find("./", position)) != std::string::npos)
+	{
+		if (position == 0 || normalised[position - 1] == '/')
+		{
+			normalised.erase(position, 2);
+		}
+		else
+		{
+			position += 2;
+		}
+	}
+
+	return normalised;
+}
+
+TextureContent TextureCache::hashContent(const unsigned char * pixels, size_t size, int width, int height, uint32_t format)
+{
+	const uint64_t prime = 1099511628211ull;
+	uint64_t hash = 14695981039346656037ull;
+
+	// Size and format first, so images with the same bytes in a different shape or format differ
+	hash = (hash ^ static_cast<uint64_t>(width)) * prime;
+	hash = (hash ^ static_cast<uint64_t>(height)) * prime;
+	hash = (hash ^ static_cast<uint64_t>(format)) * prime;
+	for (size_t i = 0; i < size; i++)
+	{
+		hash = (hash ^ pixels[i]) * prime;
+	}
+
+	TextureContent content;
+	content.hash = hash == 0 ? 1 : hash;		// 0 means "not hashed"
+	content.size = size;
+	content.width = width;
+	content.height = height;
+	content.format = format;
+	return content;
+}
+
+TextureCache::~TextureCache()
+{
+}
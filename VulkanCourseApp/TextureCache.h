@@ -0,0 +1,66 @@
+#pragma once
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <mutex>
+#include <cstdint>
+
+// Summary of a texture's decoded pixels (or block compressed levels), used to find a texture created from the same pixels
+struct TextureContent {
+	uint64_t hash = 0;				// FNV-1a of the shape, format and bytes (0 = not hashed)
+	uint64_t size = 0;				// Bytes hashed
+	int width = 0;
+	int height = 0;
+	uint32_t format = 0;			// VkFormat the bytes are in
+
+	bool operator==(const TextureContent & other) const
+	{
+		return hash == other.hash && size == other.size && width == other.width && height == other.height && format == other.format;
+	}
+};
+
+// Textures already created, so a file used by several materials or models is only loaded once.
+// Keyed by normalised path, and optionally by a hash of the decoded pixels (catches copies of a file under another name).
+// A hash match is only taken to be the same texture once the pixels themselves compare equal, so hashed textures keep a copy
+// Every material of every model that uses a texture holds a reference to it
+// Lookups are safe from any thread (loading workers check before decoding), textures are only added by the render thread
+class TextureCache
+{
+public:
+	TextureCache();
+
+	// Texture created from this file (-1 if none yet), taking a reference to it if found
+	int acquire(const std::string & path);
+	// Texture created with exactly these pixels (-1 if none yet), taking a reference to it if found
+	// The path is remembered on a hit, so later loads of it are found without decoding
+	int acquireContent(const std::string & path, const TextureContent & content, const unsigned char * pixels);
+	// Record a newly created texture, holding one reference (content hash of 0 = pixels not hashed, and not kept)
+	void add(const std::string & path, const TextureContent & content, const unsigned char * pixels, int texId);
+	// Drop a reference, returns true if that was the last one
+	bool release(int texId);
+
+	uint32_t getReferenceCount(int texId);
+	// Number of lookups that found an existing texture
+	uint32_t getHitCount();
+
+	// Same file however it is written: '/' separators, no "./" parts, lower case (file names aren't case sensitive on Windows)
+	static std::string normalisePath(const std::string & path);
+	// FNV-1a of the pixels, size and format, along with them
+	static TextureContent hashContent(const unsigned char * pixels, size_t size, int width, int height, uint32_t format);
+
+	~TextureCache();
+
+private:
+	std::unordered_map<std::string, int> pathTextures;
+	struct ContentTexture {
+		TextureContent content;
+		std::vector<unsigned char> pixels;		// Compared on a hash match, so a collision can't share the wrong texture
+		int texId;
+	};
+	std::unordered_multimap<uint64_t, ContentTexture> contentTextures;		// By hash (textures whose hashes collide are all kept)
+	std::unordered_map<int, uint32_t> referenceCounts;
+	uint32_t hitCount = 0;
+
+	std::mutex cacheMutex;
+};
@@ -0,0 +1,3 @@
+cd ..
+x64\Release\VulkanCourseApp.exe --encode-textures gorilla.jpg panda.jpg TEX_CCON.jpg TEX_DASH.jpg TEX_OBC.jpg TEX_OSCL.jpg TEX_OSCR.jpg TEX_OSSP.jpg TEX_OTC.jpg TEX_SBMP.jpg
+pause
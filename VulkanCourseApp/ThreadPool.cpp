@@ -0,0 +1,88 @@
+#include "ThreadPool.h"
+
+ThreadPool::ThreadPool()
+{
+}
+
+void ThreadPool::createWorkers(size_t workerCount)
+{
+	stopping = false;
+
+	// Start each worker, they will sleep until a task is submitted
+	for (size_t i = 0; i < workerCount; i++)
+	{
+		workers.push_back(std::thread(&ThreadPool::workerLoop, this));
+	}
+}
+
+size_t ThreadPool::getWorkerCount()
+{
+	return workers.size();
+}
+
+std::future<void> ThreadPool::submit(std::function<void()> task)
+{
+	// Wrap task so caller can wait on it (and receive any exception it throws) through the future
+	std::packaged_task<void()> packagedTask(task);
+	std::future<void> result = packagedTask.get_future();
+
+	{
+		std::lock_guard<std::mutex> lock(queueMutex);
+		tasks.push(std::move(packagedTask));
+	}
+
+	// Wake one worker to pick up the task
+	queueCondition.notify_one();
+
+	return result;
+}
+
+void ThreadPool::destroyWorkers()
+{
+	{
+		std::lock_guard<std::mutex> lock(queueMutex);
+		stopping = true;
+	}
+
+	// Wake all workers so they can finish remaining tasks and exit
+	queueCondition.notify_all();
+
+	for (auto &worker : workers)
+	{
+		worker.join();
+	}
+	workers.clear();
+}
+
+ThreadPool::~ThreadPool()
+{
+	if (!workers.empty())
+	{
+		destroyWorkers();
+	}
+}
+
+void ThreadPool::workerLoop()
+{
+	while (true)
+	{
+		std::packaged_task<void()> task;
+
+		{
+			// Sleep until there is a task or the pool is being destroyed
+			std::unique_lock<std::mutex> lock(queueMutex);
+			queueCondition.wait(lock, [this] { return stopping || !tasks.empty(); });
+
+			// Only exit once all queued work is done
+			if (stopping && tasks.empty())
+			{
+				return;
+			}
+
+			task = std::move(tasks.front());
+			tasks.pop();
+		}
+
+		task();
+	}
+}
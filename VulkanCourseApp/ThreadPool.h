@@ -0,0 +1,34 @@
+#pragma once
+
+#include <vector>
+#include <queue>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <future>
+
+class ThreadPool
+{
+public:
+	ThreadPool();
+
+	void createWorkers(size_t workerCount);
+	size_t getWorkerCount();
+
+	std::future<void> submit(std::function<void()> task);
+
+	void destroyWorkers();
+
+	~ThreadPool();
+
+private:
+	std::vector<std::thread> workers;
+	std::queue<std::packaged_task<void()>> tasks;
+
+	std::mutex queueMutex;
+	std::condition_variable queueCondition;
+	bool stopping = false;
+
+	void workerLoop();
+};
@@ -0,0 +1,123 @@
+#include "TransientRing.h"
+
+TransientRing::TransientRing()
+{
+}
+
+TransientRing::TransientRing(MemoryAllocator * newAllocator, VkDeviceSize newFrameSize, uint32_t newFrameCount, VkDeviceSize newAlignment,
+	const std::vector<uint32_t> & newQueueFamilies)
+{
+	allocator = newAllocator;
+	alignment = newAlignment;
+	frameCount = newFrameCount;
+	queueFamilies = newQueueFamilies;
+
+	// Round partition size up so every partition starts aligned
+	frameSize = (newFrameSize + alignment - 1) & ~(alignment - 1);
+
+	createRingBuffer();
+}
+
+void TransientRing::beginFrame(uint32_t newFrameIndex, uint64_t newFrameNumber, uint64_t completedFrame)
+{
+	// Everything previously allocated in this partition is no longer in use, so start again from the beginning
+	frameIndex = newFrameIndex;
+	frameNumber = newFrameNumber;
+	frameStart = frameSize * frameIndex;
+	frameHead = 0;
+
+	// Free any outgrown buffers the GPU has finished with
+	for (size_t i = 0; i < retiredBuffers.size();)
+	{
+		if (retiredBuffers[i].retireFrame <= completedFrame)
+		{
+			allocator->destroyBuffer(retiredBuffers[i].buffer, retiredBuffers[i].bufferMemory);
+			retiredBuffers[i] = retiredBuffers.back();
+			retiredBuffers.pop_back();
+		}
+		else
+		{
+			i++;
+		}
+	}
+}
+
+TransientAllocation TransientRing::allocate(VkDeviceSize size)
+{
+	VkDeviceSize offset = (frameHead + alignment - 1) & ~(alignment - 1);
+	if (offset + size > frameSize)
+	{
+		// Partition is full: move to a bigger buffer, allocations already made this frame stay valid in the old one
+		grow(size);
+		offset = 0;
+	}
+	frameHead = offset + size;
+
+	TransientAllocation allocation = {};
+	allocation.buffer = buffer;
+	allocation.offset = frameStart + offset;
+	allocation.data = mappedData + frameStart + offset;
+	return allocation;
+}
+
+VkDeviceSize TransientRing::getFrameSize()
+{
+	return frameSize;
+}
+
+VkDeviceSize TransientRing::getUsedSize()
+{
+	return frameHead;
+}
+
+void TransientRing::destroyTransientRing()
+{
+	for (RetiredBuffer & retired : retiredBuffers)
+	{
+		allocator->destroyBuffer(retired.buffer, retired.bufferMemory);
+	}
+	retiredBuffers.clear();
+
+	if (buffer == VK_NULL_HANDLE) return;
+
+	allocator->destroyBuffer(buffer, bufferMemory);
+
+	buffer = VK_NULL_HANDLE;
+	mappedData = nullptr;
+}
+
+TransientRing::~TransientRing()
+{
+}
+
+void TransientRing::createRingBuffer()
+{
+	// Host visible and coherent, so writes are seen by the GPU without flushing
+	// Usable for any per-frame data: uniforms (via dynamic offsets), streamed vertex/index data, indirect draw commands
+	// and storage data for compute (shared between the given queue families, so compute on its own queue can use it too)
+	allocator->createSharedBuffer(frameSize * frameCount,
+		VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT
+		| VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, MEMORY_CATEGORY_TRANSIENT, queueFamilies, &buffer, &bufferMemory);
+
+	// Allocator maps host visible memory once, for the lifetime of the buffer
+	mappedData = static_cast<uint8_t *>(bufferMemory.mapped);
+}
+
+void TransientRing::grow(VkDeviceSize minimumSize)
+{
+	// Keep the old buffer alive until the current frame (the last to use it) has completed
+	retiredBuffers.push_back({ buffer, bufferMemory, frameNumber });
+
+	// At least double, so a scene that keeps growing only reallocates a few times
+	VkDeviceSize newFrameSize = frameSize * 2;
+	while (newFrameSize < minimumSize)
+	{
+		newFrameSize *= 2;
+	}
+	frameSize = (newFrameSize + alignment - 1) & ~(alignment - 1);
+	createRingBuffer();
+
+	frameStart = frameSize * frameIndex;
+	frameHead = 0;
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#define GLFW_INCLUDE_VULKAN
+
+#include <GLFW/glfw3.h>
+
+#include <vector>
+#include <stdexcept>
+#include <vector>
+
+#include "Utilities.h"
+#include "MemoryAllocator.h"
+
+// Sub-range of the ring handed out for one frame's data
+struct TransientAllocation {
+	VkBuffer buffer;			// Buffer the data is in (changes when the ring grows)
+	VkDeviceSize offset;		// Offset from start of buffer (use as the dynamic offset when binding)
+	void * data;				// Mapped memory to write the data to
+};
+
+// One persistently mapped buffer split into a partition for each frame in flight.
+// A frame allocates from its own partition, which is reset when the frame is next begun (once the GPU has finished with it)
+// If a partition runs out the ring grows into a larger buffer; the old one is kept until the frame that outgrew it has completed
+class TransientRing
+{
+public:
+	TransientRing();
+	TransientRing(MemoryAllocator * newAllocator, VkDeviceSize newFrameSize, uint32_t newFrameCount, VkDeviceSize newAlignment,
+		const std::vector<uint32_t> & newQueueFamilies);
+
+	void beginFrame(uint32_t frameIndex, uint64_t frameNumber, uint64_t completedFrame);
+	TransientAllocation allocate(VkDeviceSize size);
+
+	VkDeviceSize getFrameSize();
+	VkDeviceSize getUsedSize();
+
+	void destroyTransientRing();
+
+	~TransientRing();
+
+private:
+	// Buffer replaced by a larger one, still in use until its frame completes
+	struct RetiredBuffer {
+		VkBuffer buffer;
+		MemoryAllocation bufferMemory;
+		uint64_t retireFrame;			// Frame number the buffer was last used by
+	};
+
+	VkBuffer buffer = VK_NULL_HANDLE;
+	MemoryAllocation bufferMemory;
+	uint8_t * mappedData = nullptr;
+
+	VkDeviceSize frameSize = 0;			// Size of each frame's partition
+	VkDeviceSize alignment = 1;			// Every allocation starts at a multiple of this
+	VkDeviceSize frameStart = 0;		// Offset of the current frame's partition
+	VkDeviceSize frameHead = 0;			// Bytes allocated so far from the current frame's partition
+	uint32_t frameCount = 0;
+	uint32_t frameIndex = 0;			// Partition the current frame allocates from
+	uint64_t frameNumber = 0;			// Timeline value of the current frame
+
+	std::vector<RetiredBuffer> retiredBuffers;
+
+	MemoryAllocator * allocator;
+	std::vector<uint32_t> queueFamilies;		// Families the buffer is shared between (a grown buffer is shared the same way)
+
+	void createRingBuffer();
+	void grow(VkDeviceSize minimumSize);
+};
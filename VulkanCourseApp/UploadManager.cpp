@@ -0,0 +1,583 @@
+#include "UploadManager.h"
+
+#include <cstring>
+#include <limits>
+#include <algorithm>
+
+UploadManager::UploadManager()
+{
+}
+
+UploadManager::UploadManager(MemoryAllocator * newAllocator, VkDevice newDevice, VkQueue newQueue, uint32_t newQueueFamily,
+	VkQueue newOwnerQueue, uint32_t newOwnerQueueFamily, VkDeviceSize newRingSize)
+{
+	allocator = newAllocator;
+	device = newDevice;
+	queue = newQueue;
+	queueFamily = newQueueFamily;
+	ownerQueue = newOwnerQueue;
+	ownerQueueFamily = newOwnerQueueFamily;
+	ringSize = newRingSize;
+
+	// Ring lives as long as the manager, and is mapped the whole time
+	allocator->createBuffer(ringSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, MEMORY_CATEGORY_STAGING, &ringBuffer, &ringMemory);
+
+	// Command buffers are reset and reused once their batch is done
+	VkCommandPoolCreateInfo poolInfo = {};
+	poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+	poolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT | VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+	poolInfo.queueFamilyIndex = newQueueFamily;
+
+	VkResult result = vkCreateCommandPool(device, &poolInfo, nullptr, &commandPool);
+	if (result != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to create an Upload Command Pool!");
+	}
+
+	// Acquires are recorded for the owner queue, so need a pool of its family
+	if (transfersOwnership())
+	{
+		poolInfo.queueFamilyIndex = ownerQueueFamily;
+		result = vkCreateCommandPool(device, &poolInfo, nullptr, &acquireCommandPool);
+		if (result != VK_SUCCESS)
+		{
+			throw std::runtime_error("Failed to create an Upload Acquire Command Pool!");
+		}
+	}
+
+	VkSemaphoreTypeCreateInfo timelineCreateInfo = {};
+	timelineCreateInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+	timelineCreateInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+	timelineCreateInfo.initialValue = 0;
+
+	VkSemaphoreCreateInfo semaphoreCreateInfo = {};
+	semaphoreCreateInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+	semaphoreCreateInfo.pNext = &timelineCreateInfo;
+
+	result = vkCreateSemaphore(device, &semaphoreCreateInfo, nullptr, &timeline);
+	if (result != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to create an Upload Timeline Semaphore!");
+	}
+
+	// Copies and acquires are on different queues, so each gets its own timeline to keep values increasing in order
+	if (transfersOwnership())
+	{
+		result = vkCreateSemaphore(device, &semaphoreCreateInfo, nullptr, &copyTimeline);
+		if (result != VK_SUCCESS)
+		{
+			throw std::runtime_error("Failed to create an Upload Timeline Semaphore!");
+		}
+	}
+}
+
+void UploadManager::uploadBuffer(VkBuffer dstBuffer, VkDeviceSize dstOffset, const void * data, VkDeviceSize size)
+{
+	if (size == 0) return;
+
+	VkBuffer stagingBuffer;
+	VkDeviceSize stagingOffset;
+	void * stagingData;
+	allocateStaging(size, &stagingBuffer, &stagingOffset, &stagingData);
+	memcpy(stagingData, data, static_cast<size_t>(size));
+
+	VkBufferCopy bufferCopyRegion = {};
+	bufferCopyRegion.srcOffset = stagingOffset;
+	bufferCopyRegion.dstOffset = dstOffset;
+	bufferCopyRegion.size = size;
+
+	UploadBatch &batch = getRecordingBatch();
+	vkCmdCopyBuffer(batch.commandBuffer, stagingBuffer, dstBuffer, 1, &bufferCopyRegion);
+
+	// Range is handed over to the owner when the batch is submitted
+	if (transfersOwnership())
+	{
+		VkBufferMemoryBarrier bufferMemoryBarrier = {};
+		bufferMemoryBarrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+		bufferMemoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		bufferMemoryBarrier.srcQueueFamilyIndex = queueFamily;
+		bufferMemoryBarrier.dstQueueFamilyIndex = ownerQueueFamily;
+		bufferMemoryBarrier.buffer = dstBuffer;
+		bufferMemoryBarrier.offset = dstOffset;
+		bufferMemoryBarrier.size = size;
+		batch.bufferTransfers.push_back(bufferMemoryBarrier);
+	}
+}
+
+void UploadManager::uploadImage(VkImage dstImage, uint32_t width, uint32_t height, uint32_t mipLevels,
+	const std::vector<VkDeviceSize> & levelOffsets, const void * data, VkDeviceSize size)
+{
+	VkBuffer stagingBuffer;
+	VkDeviceSize stagingOffset;
+	void * stagingData;
+	allocateStaging(size, &stagingBuffer, &stagingOffset, &stagingData);
+	memcpy(stagingData, data, static_cast<size_t>(size));
+
+	UploadBatch &batch = getRecordingBatch();
+	VkCommandBuffer commandBuffer = batch.commandBuffer;
+
+	VkImageMemoryBarrier imageMemoryBarrier = {};
+	imageMemoryBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+	imageMemoryBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	imageMemoryBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	imageMemoryBarrier.image = dstImage;
+	imageMemoryBarrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	imageMemoryBarrier.subresourceRange.baseMipLevel = 0;
+	imageMemoryBarrier.subresourceRange.levelCount = mipLevels;
+	imageMemoryBarrier.subresourceRange.baseArrayLayer = 0;
+	imageMemoryBarrier.subresourceRange.layerCount = 1;
+
+	// New image to image ready to receive data (every level, generated ones are written by blits)
+	imageMemoryBarrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	imageMemoryBarrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+	imageMemoryBarrier.srcAccessMask = 0;
+	imageMemoryBarrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+		0, 0, nullptr, 0, nullptr, 1, &imageMemoryBarrier);
+
+	// One copy per level given
+	uint32_t givenLevels = std::max(1u, std::min(mipLevels, static_cast<uint32_t>(levelOffsets.size())));
+	std::vector<VkBufferImageCopy> imageRegions(givenLevels);
+	for (uint32_t level = 0; level < givenLevels; level++)
+	{
+		VkBufferImageCopy &imageRegion = imageRegions[level];
+		imageRegion.bufferOffset = stagingOffset + (levelOffsets.empty() ? 0 : levelOffsets[level]);
+		imageRegion.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		imageRegion.imageSubresource.mipLevel = level;
+		imageRegion.imageSubresource.baseArrayLayer = 0;
+		imageRegion.imageSubresource.layerCount = 1;
+		imageRegion.imageOffset = { 0, 0, 0 };
+		imageRegion.imageExtent = { std::max(width >> level, 1u), std::max(height >> level, 1u), 1 };
+	}
+	vkCmdCopyBufferToImage(commandBuffer, stagingBuffer, dstImage, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+		static_cast<uint32_t>(imageRegions.size()), imageRegions.data());
+
+	// Rest of the levels are blitted from the last one given
+	bool generateMips = givenLevels < mipLevels;
+
+	// Transfer destination to shader readable, before any later fragment shader reads it
+	imageMemoryBarrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+	imageMemoryBarrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	imageMemoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	imageMemoryBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+	// When handing over to the owner, the layout change happens as part of the release/acquire instead
+	// Blits need a graphics queue, so levels to generate are left as transfer destinations and generated by the owner
+	if (transfersOwnership())
+	{
+		imageMemoryBarrier.srcQueueFamilyIndex = queueFamily;
+		imageMemoryBarrier.dstQueueFamilyIndex = ownerQueueFamily;
+		if (generateMips)
+		{
+			imageMemoryBarrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+
+			MipGeneration mipGeneration = {};
+			mipGeneration.image = dstImage;
+			mipGeneration.width = width;
+			mipGeneration.height = height;
+			mipGeneration.sourceLevel = givenLevels - 1;
+			mipGeneration.mipLevels = mipLevels;
+			batch.mipGenerations.push_back(mipGeneration);
+		}
+		batch.imageTransfers.push_back(imageMemoryBarrier);
+		return;
+	}
+
+	if (generateMips)
+	{
+		recordMipGeneration(commandBuffer, dstImage, width, height, givenLevels - 1, mipLevels);
+		return;
+	}
+
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+		0, 0, nullptr, 0, nullptr, 1, &imageMemoryBarrier);
+}
+
+uint64_t UploadManager::submit()
+{
+	if (batches.empty() || batches.back().token != 0) return lastToken;
+
+	UploadBatch &batch = batches.back();
+
+	if (transfersOwnership())
+	{
+		// Release everything written to the owner queue family (the matching acquire makes it visible there)
+		for (VkBufferMemoryBarrier &barrier : batch.bufferTransfers) barrier.dstAccessMask = 0;
+		for (VkImageMemoryBarrier &barrier : batch.imageTransfers) barrier.dstAccessMask = 0;
+		vkCmdPipelineBarrier(batch.commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, nullptr,
+			static_cast<uint32_t>(batch.bufferTransfers.size()), batch.bufferTransfers.data(),
+			static_cast<uint32_t>(batch.imageTransfers.size()), batch.imageTransfers.data());
+	}
+	else
+	{
+		// Buffer copies must finish before anything submitted later reads the buffers (vertex input, index reads, shaders)
+		VkMemoryBarrier memoryBarrier = {};
+		memoryBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+		memoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		memoryBarrier.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT;
+		vkCmdPipelineBarrier(batch.commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
+			0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+	}
+
+	VkResult result = vkEndCommandBuffer(batch.commandBuffer);
+	if (result != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to stop recording an Upload Command Buffer!");
+	}
+
+	// Value reached once the copies are done: the batch's token, unless there is an acquire still to come
+	uint64_t copiesDone = transfersOwnership() ? ++copyCount : ++lastToken;
+	VkSemaphore copiesSemaphore = transfersOwnership() ? copyTimeline : timeline;
+
+	VkTimelineSemaphoreSubmitInfo timelineSubmitInfo = {};
+	timelineSubmitInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+	timelineSubmitInfo.signalSemaphoreValueCount = 1;
+	timelineSubmitInfo.pSignalSemaphoreValues = &copiesDone;
+
+	VkSubmitInfo submitInfo = {};
+	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+	submitInfo.pNext = &timelineSubmitInfo;
+	submitInfo.commandBufferCount = 1;
+	submitInfo.pCommandBuffers = &batch.commandBuffer;
+	submitInfo.signalSemaphoreCount = 1;
+	submitInfo.pSignalSemaphores = &copiesSemaphore;
+
+	result = vkQueueSubmit(queue, 1, &submitInfo, VK_NULL_HANDLE);
+	if (result != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to submit an Upload Command Buffer!");
+	}
+	submitCount++;
+
+	if (transfersOwnership())
+	{
+		submitAcquire(batch, copiesDone);
+	}
+
+	batch.token = lastToken;
+	return batch.token;
+}
+
+bool UploadManager::isComplete(uint64_t token)
+{
+	uint64_t completedToken;
+	vkGetSemaphoreCounterValue(device, timeline, &completedToken);
+	return completedToken >= token;
+}
+
+void UploadManager::wait(uint64_t token)
+{
+	VkSemaphoreWaitInfo waitInfo = {};
+	waitInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+	waitInfo.semaphoreCount = 1;
+	waitInfo.pSemaphores = &timeline;
+	waitInfo.pValues = &token;
+
+	vkWaitSemaphores(device, &waitInfo, std::numeric_limits<uint64_t>::max());
+}
+
+uint64_t UploadManager::getSubmitCount()
+{
+	return submitCount;
+}
+
+void UploadManager::destroyUploadManager()
+{
+	if (ringBuffer == VK_NULL_HANDLE) return;
+
+	// Anything still recording is sent, then everything is waited for so staging can be freed
+	wait(submit());
+	reclaimBatches();
+
+	vkDestroyCommandPool(device, commandPool, nullptr);
+	if (acquireCommandPool != VK_NULL_HANDLE)
+	{
+		vkDestroyCommandPool(device, acquireCommandPool, nullptr);
+	}
+	vkDestroySemaphore(device, timeline, nullptr);
+	if (copyTimeline != VK_NULL_HANDLE)
+	{
+		vkDestroySemaphore(device, copyTimeline, nullptr);
+	}
+	allocator->destroyBuffer(ringBuffer, ringMemory);
+
+	freeCommandBuffers.clear();
+	freeAcquireCommandBuffers.clear();
+	ringBuffer = VK_NULL_HANDLE;
+	commandPool = VK_NULL_HANDLE;
+	acquireCommandPool = VK_NULL_HANDLE;
+	timeline = VK_NULL_HANDLE;
+	copyTimeline = VK_NULL_HANDLE;
+}
+
+UploadManager::~UploadManager()
+{
+}
+
+bool UploadManager::transfersOwnership()
+{
+	return queueFamily != ownerQueueFamily;
+}
+
+UploadManager::UploadBatch & UploadManager::getRecordingBatch()
+{
+	if (!batches.empty() && batches.back().token == 0) return batches.back();
+
+	UploadBatch batch = {};
+	batch.commandBuffer = beginCommandBuffer(commandPool, freeCommandBuffers);
+
+	batches.push_back(batch);
+	return batches.back();
+}
+
+VkCommandBuffer UploadManager::beginCommandBuffer(VkCommandPool pool, std::vector<VkCommandBuffer> & freeList)
+{
+	// Reuse the command buffer of a finished batch if there is one
+	VkCommandBuffer commandBuffer;
+	if (!freeList.empty())
+	{
+		commandBuffer = freeList.back();
+		freeList.pop_back();
+		vkResetCommandBuffer(commandBuffer, 0);
+	}
+	else
+	{
+		VkCommandBufferAllocateInfo allocInfo = {};
+		allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+		allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+		allocInfo.commandPool = pool;
+		allocInfo.commandBufferCount = 1;
+
+		VkResult result = vkAllocateCommandBuffers(device, &allocInfo, &commandBuffer);
+		if (result != VK_SUCCESS)
+		{
+			throw std::runtime_error("Failed to allocate an Upload Command Buffer!");
+		}
+	}
+
+	VkCommandBufferBeginInfo beginInfo = {};
+	beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+	vkBeginCommandBuffer(commandBuffer, &beginInfo);
+
+	return commandBuffer;
+}
+
+void UploadManager::submitAcquire(UploadBatch & batch, uint64_t copiesDone)
+{
+	batch.acquireCommandBuffer = beginCommandBuffer(acquireCommandPool, freeAcquireCommandBuffers);
+
+	// Acquire what the copies released, for any later use on the owner queue
+	for (VkBufferMemoryBarrier &barrier : batch.bufferTransfers)
+	{
+		barrier.srcAccessMask = 0;
+		barrier.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT;
+	}
+	for (VkImageMemoryBarrier &barrier : batch.imageTransfers)
+	{
+		// Images with levels still to generate are read and written by blits next
+		barrier.srcAccessMask = 0;
+		barrier.dstAccessMask = barrier.newLayout == VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL
+			? VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_TRANSFER_WRITE_BIT : VK_ACCESS_SHADER_READ_BIT;
+	}
+	vkCmdPipelineBarrier(batch.acquireCommandBuffer, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 0, nullptr,
+		static_cast<uint32_t>(batch.bufferTransfers.size()), batch.bufferTransfers.data(),
+		static_cast<uint32_t>(batch.imageTransfers.size()), batch.imageTransfers.data());
+
+	for (const auto &mipGeneration : batch.mipGenerations)
+	{
+		recordMipGeneration(batch.acquireCommandBuffer, mipGeneration.image, mipGeneration.width, mipGeneration.height,
+			mipGeneration.sourceLevel, mipGeneration.mipLevels);
+	}
+
+	VkResult result = vkEndCommandBuffer(batch.acquireCommandBuffer);
+	if (result != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to stop recording an Upload Acquire Command Buffer!");
+	}
+
+	// Waits on the GPU for the copies, so the owner queue only stalls if it gets to this before they are done
+	uint64_t acquireDone = ++lastToken;
+	VkPipelineStageFlags waitStage = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+
+	VkTimelineSemaphoreSubmitInfo timelineSubmitInfo = {};
+	timelineSubmitInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+	timelineSubmitInfo.waitSemaphoreValueCount = 1;
+	timelineSubmitInfo.pWaitSemaphoreValues = &copiesDone;
+	timelineSubmitInfo.signalSemaphoreValueCount = 1;
+	timelineSubmitInfo.pSignalSemaphoreValues = &acquireDone;
+
+	VkSubmitInfo submitInfo = {};
+	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+	submitInfo.pNext = &timelineSubmitInfo;
+	submitInfo.waitSemaphoreCount = 1;
+	submitInfo.pWaitSemaphores = &copyTimeline;
+	submitInfo.pWaitDstStageMask = &waitStage;
+	submitInfo.commandBufferCount = 1;
+	submitInfo.pCommandBuffers = &batch.acquireCommandBuffer;
+	submitInfo.signalSemaphoreCount = 1;
+	submitInfo.pSignalSemaphores = &timeline;
+
+	result = vkQueueSubmit(ownerQueue, 1, &submitInfo, VK_NULL_HANDLE);
+	if (result != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to submit an Upload Acquire Command Buffer!");
+	}
+	submitCount++;
+}
+
+void UploadManager::recordMipGeneration(VkCommandBuffer commandBuffer, VkImage image, uint32_t width, uint32_t height,
+	uint32_t sourceLevel, uint32_t mipLevels)
+{
+	VkImageMemoryBarrier imageMemoryBarrier = {};
+	imageMemoryBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+	imageMemoryBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	imageMemoryBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	imageMemoryBarrier.image = image;
+	imageMemoryBarrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	imageMemoryBarrier.subresourceRange.levelCount = 1;
+	imageMemoryBarrier.subresourceRange.baseArrayLayer = 0;
+	imageMemoryBarrier.subresourceRange.layerCount = 1;
+
+	// Levels given above the source are already complete
+	if (sourceLevel > 0)
+	{
+		imageMemoryBarrier.subresourceRange.baseMipLevel = 0;
+		imageMemoryBarrier.subresourceRange.levelCount = sourceLevel;
+		imageMemoryBarrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+		imageMemoryBarrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+		imageMemoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		imageMemoryBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+			0, 0, nullptr, 0, nullptr, 1, &imageMemoryBarrier);
+		imageMemoryBarrier.subresourceRange.levelCount = 1;
+	}
+
+	// Each level is a linear filtered blit of the one above it
+	int32_t levelWidth = static_cast<int32_t>(std::max(width >> sourceLevel, 1u));
+	int32_t levelHeight = static_cast<int32_t>(std::max(height >> sourceLevel, 1u));
+	for (uint32_t level = sourceLevel + 1; level < mipLevels; level++)
+	{
+		// Level above has been written, make it the blit source
+		imageMemoryBarrier.subresourceRange.baseMipLevel = level - 1;
+		imageMemoryBarrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+		imageMemoryBarrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+		imageMemoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		imageMemoryBarrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+			0, 0, nullptr, 0, nullptr, 1, &imageMemoryBarrier);
+
+		int32_t nextWidth = std::max(levelWidth / 2, 1);
+		int32_t nextHeight = std::max(levelHeight / 2, 1);
+
+		VkImageBlit blit = {};
+		blit.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		blit.srcSubresource.mipLevel = level - 1;
+		blit.srcSubresource.baseArrayLayer = 0;
+		blit.srcSubresource.layerCount = 1;
+		blit.srcOffsets[1] = { levelWidth, levelHeight, 1 };
+		blit.dstSubresource = blit.srcSubresource;
+		blit.dstSubresource.mipLevel = level;
+		blit.dstOffsets[1] = { nextWidth, nextHeight, 1 };
+		vkCmdBlitImage(commandBuffer, image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+			1, &blit, VK_FILTER_LINEAR);
+
+		// Level above is finished with
+		imageMemoryBarrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+		imageMemoryBarrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+		imageMemoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+		imageMemoryBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+			0, 0, nullptr, 0, nullptr, 1, &imageMemoryBarrier);
+
+		levelWidth = nextWidth;
+		levelHeight = nextHeight;
+	}
+
+	// Last level was only ever written
+	imageMemoryBarrier.subresourceRange.baseMipLevel = mipLevels - 1;
+	imageMemoryBarrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+	imageMemoryBarrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	imageMemoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	imageMemoryBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+		0, 0, nullptr, 0, nullptr, 1, &imageMemoryBarrier);
+}
+
+void UploadManager::allocateStaging(VkDeviceSize size, VkBuffer * buffer, VkDeviceSize * offset, void ** data)
+{
+	// Offsets suitable for copying to any image format
+	const VkDeviceSize alignment = 16;
+
+	reclaimBatches();
+
+	// Too big to ever fit in the ring, so it gets a staging buffer of its own (freed with its batch)
+	if (size > ringSize / 2)
+	{
+		UploadBatch &batch = getRecordingBatch();
+		MemoryAllocation stagingMemory;
+		allocator->createStagingBuffer(size, buffer, &stagingMemory);
+		batch.oversizedBuffers.push_back(*buffer);
+		batch.oversizedMemory.push_back(stagingMemory);
+
+		*offset = 0;
+		*data = stagingMemory.mapped;
+		return;
+	}
+
+	while (true)
+	{
+		// Space taken from the head, wrapping to the start if it doesn't fit before the end
+		VkDeviceSize start = (ringHead + alignment - 1) & ~(alignment - 1);
+		if (start + size > ringSize)
+		{
+			start = 0;
+		}
+		VkDeviceSize taken = (start >= ringHead ? start - ringHead : ringSize - ringHead) + size;
+
+		if (ringUsed + taken <= ringSize)
+		{
+			UploadBatch &batch = getRecordingBatch();
+			batch.ringBytes += taken;
+			ringUsed += taken;
+			ringHead = start + size;
+
+			*buffer = ringBuffer;
+			*offset = start;
+			*data = static_cast<uint8_t *>(ringMemory.mapped) + start;
+			return;
+		}
+
+		// Ring is full: send what has been recorded, and wait for the oldest batch to free its space
+		submit();
+		wait(batches.front().token);
+		reclaimBatches();
+	}
+}
+
+void UploadManager::reclaimBatches()
+{
+	// Batches complete in the order they were submitted
+	while (!batches.empty() && batches.front().token != 0 && isComplete(batches.front().token))
+	{
+		UploadBatch &batch = batches.front();
+		ringUsed -= batch.ringBytes;
+		for (size_t i = 0; i < batch.oversizedBuffers.size(); i++)
+		{
+			allocator->destroyBuffer(batch.oversizedBuffers[i], batch.oversizedMemory[i]);
+		}
+		freeCommandBuffers.push_back(batch.commandBuffer);
+		if (batch.acquireCommandBuffer != VK_NULL_HANDLE)
+		{
+			freeAcquireCommandBuffers.push_back(batch.acquireCommandBuffer);
+		}
+		batches.pop_front();
+	}
+
+	// Nothing in use, so start from the beginning again (keeps large uploads from needing to wrap)
+	if (ringUsed == 0)
+	{
+		ringHead = 0;
+	}
+}
@@ -0,0 +1,107 @@
+#pragma once
+
+#define GLFW_INCLUDE_VULKAN
+
+#include <GLFW/glfw3.h>
+
+#include <vector>
+#include <deque>
+#include <stdexcept>
+
+#include "Utilities.h"
+#include "MemoryAllocator.h"
+
+// Copies data to device local buffers and images without waiting for the GPU.
+// Data is written straight in to a persistently mapped staging ring, and the copies (and image layout barriers) are
+// recorded in to one command buffer. submit() sends the whole batch to the queue at once and returns a token: the batch
+// is done once isComplete(token) is true. Staging space of a batch is reused once the batch is complete
+// Copies can run on a different queue family to the one using the resources (the owner, e.g. a transfer only queue feeding
+// the graphics queue). Ownership is then released after the copies, and acquired by a small submission to the owner queue
+// that waits for them. A batch's token is reached once the acquire is done
+class UploadManager
+{
+public:
+	UploadManager();
+	UploadManager(MemoryAllocator * newAllocator, VkDevice newDevice, VkQueue newQueue, uint32_t newQueueFamily,
+		VkQueue newOwnerQueue, uint32_t newOwnerQueueFamily, VkDeviceSize newRingSize);
+
+	// Queue a copy of data to part of a buffer
+	void uploadBuffer(VkBuffer dstBuffer, VkDeviceSize dstOffset, const void * data, VkDeviceSize size);
+	// Queue a copy of tightly packed pixels to a whole image, which ends up shader readable (previous contents are discarded)
+	// levelOffsets gives where each mip level starts in data (empty if data is just level 0, offsets must suit the format)
+	// Levels past those given are generated by linear filtered blits (so the format must support that, and the image needs
+	// transfer source usage)
+	void uploadImage(VkImage dstImage, uint32_t width, uint32_t height, uint32_t mipLevels,
+		const std::vector<VkDeviceSize> & levelOffsets, const void * data, VkDeviceSize size);
+
+	// Submit everything queued since the last submit (returns the last token if there is nothing new)
+	// Later submissions to the owner queue see the uploaded data, so drawing with it doesn't need to wait on the token
+	uint64_t submit();
+	bool isComplete(uint64_t token);
+	void wait(uint64_t token);
+
+	// Number of queue submissions made, for comparing against the number of uploads
+	uint64_t getSubmitCount();
+
+	void destroyUploadManager();
+
+	~UploadManager();
+
+private:
+	// Mip levels of an image to blit on the owner queue, once it has been acquired
+	struct MipGeneration {
+		VkImage image;
+		uint32_t width;
+		uint32_t height;
+		uint32_t sourceLevel;		// Last level copied, the rest are made from it
+		uint32_t mipLevels;
+	};
+
+	// Commands recorded (and staging space used) between two submits
+	struct UploadBatch {
+		VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+		VkCommandBuffer acquireCommandBuffer = VK_NULL_HANDLE;	// Owner queue side of ownership transfers
+		uint64_t token = 0;								// Timeline value signalled when done (0 while still recording)
+		VkDeviceSize ringBytes = 0;						// Staging ring space used, including any skipped at the end when wrapping
+		std::vector<VkBuffer> oversizedBuffers;			// Staging for uploads too big for the ring
+		std::vector<MemoryAllocation> oversizedMemory;
+		std::vector<VkBufferMemoryBarrier> bufferTransfers;		// Ranges and images written, to hand over to the owner
+		std::vector<VkImageMemoryBarrier> imageTransfers;
+		std::vector<MipGeneration> mipGenerations;
+	};
+
+	VkBuffer ringBuffer = VK_NULL_HANDLE;
+	MemoryAllocation ringMemory;
+	VkDeviceSize ringSize = 0;
+	VkDeviceSize ringHead = 0;							// Where the next allocation starts
+	VkDeviceSize ringUsed = 0;							// Bytes held by batches not yet complete
+
+	std::deque<UploadBatch> batches;					// Oldest first, the last one is still recording if its token is 0
+	std::vector<VkCommandBuffer> freeCommandBuffers;
+	std::vector<VkCommandBuffer> freeAcquireCommandBuffers;
+
+	VkCommandPool commandPool = VK_NULL_HANDLE;
+	VkCommandPool acquireCommandPool = VK_NULL_HANDLE;	// Owner queue family, only if ownership is transferred
+	VkSemaphore timeline = VK_NULL_HANDLE;				// Reaches a batch's token when that batch is done
+	VkSemaphore copyTimeline = VK_NULL_HANDLE;			// Counts batches whose copies are done (only if ownership is transferred)
+	uint64_t lastToken = 0;
+	uint64_t copyCount = 0;
+	uint64_t submitCount = 0;
+
+	MemoryAllocator * allocator;
+	VkDevice device;
+	VkQueue queue;
+	VkQueue ownerQueue;
+	uint32_t queueFamily;
+	uint32_t ownerQueueFamily;
+
+	bool transfersOwnership();
+	UploadBatch & getRecordingBatch();
+	VkCommandBuffer beginCommandBuffer(VkCommandPool pool, std::vector<VkCommandBuffer> & freeList);
+	void submitAcquire(UploadBatch & batch, uint64_t copiesDone);
+	// Blit levels after sourceLevel from the one above each, leaving every level shader readable (all must start as transfer destinations)
+	void recordMipGeneration(VkCommandBuffer commandBuffer, VkImage image, uint32_t width, uint32_t height,
+		uint32_t sourceLevel, uint32_t mipLevels);
+	void allocateStaging(VkDeviceSize size, VkBuffer * buffer, VkDeviceSize * offset, void ** data);
+	void reclaimBatches();
+};
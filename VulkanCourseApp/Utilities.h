@@ -7,8 +7,18 @@
 
 #include <glm.hpp>
 
-const int MAX_FRAME_DRAWS = 2;
+const int MAX_FRAME_DRAWS = 4;		// Maximum frames in flight, the number used can be chosen at runtime
+const int DEFAULT_FRAME_DRAWS = 2;
 const int MAX_OBJECTS = 200;
+const uint32_t MAX_BINDLESS_TEXTURES = 16384;		// Size of the texture array in bindless mode (lowered to the device limit if needed)
+const VkDeviceSize TRANSIENT_FRAME_SIZE = 4 * 1024 * 1024;		// Initial bytes of per-frame data (uniforms, streamed vertices) each frame in flight can use, grows if exceeded
+const uint32_t GEOMETRY_POOL_VERTICES = 1024 * 1024;			// Vertices the shared vertex buffer can hold, across all meshes
+const uint32_t GEOMETRY_POOL_INDICES = 4 * 1024 * 1024;			// Indices the shared index buffer can hold, across all meshes
+const VkDeviceSize MEMORY_BLOCK_SIZE = 64 * 1024 * 1024;		// Size of each block of device memory resources are sub-allocated from
+const VkDeviceSize STAGING_BLOCK_SIZE = 16 * 1024 * 1024;		// Size of each block of host visible memory staging buffers come from
+const VkDeviceSize UPLOAD_RING_SIZE = 32 * 1024 * 1024;			// Staging ring uploads are written to (bigger uploads get their own staging buffer)
+const size_t LOADING_WORKER_COUNT = 2;							// Threads importing models (and decoding their textures) in the background
+const uint32_t MAX_TEXTURE_CREATES_PER_FRAME = 4;				// Textures of background loads created (and queued for upload) each frame at most
 
 const std::vector<const char *> deviceExtensions = {
 	VK_KHR_SWAPCHAIN_EXTENSION_NAME
@@ -24,6 +34,8 @@ struct Vertex {
 struct QueueFamilyIndices {
 	int graphicsFamily = -1;			// Location of Graphics Queue Family
 	int presentationFamily = -1;		// Location of Presentation Queue Family
+	int transferFamily = -1;			// Location of a Transfer only Queue Family (optional, -1 if the device has none)
+	int computeFamily = -1;				// Location of a Compute Queue Family without graphics (optional, -1 if the device has none)
 
 	// Check if queue families are valid
 	bool isValid()
@@ -32,6 +44,66 @@ struct QueueFamilyIndices {
 	}
 };
 
+// Time (in milliseconds) spent in each part of a frame that can block the CPU
+struct FrameTimings {
+	uint64_t frameNumber = 0;		// Number of the frame these timings belong to
+	double limiterWait = 0.0;		// Sleeping to hold the target frame rate
+	double fenceWait = 0.0;			// Waiting for the GPU to finish with this frame's resources/image
+	double acquireWait = 0.0;		// Waiting for vkAcquireNextImageKHR to return an image
+	double present = 0.0;			// Time spent in vkQueuePresentKHR
+	double cpuFrame = 0.0;			// Whole of draw(), from start to end (excluding limiter)
+};
+
+// Push constant data for each draw (matches shader_bindless.frag)
+struct DrawPushConstants {
+	uint32_t textureIndex;			// Element of the texture array to sample (bindless mode only)
+};
+
+// State binds of the last recorded commands. A bind is skipped when a draw needs state that is already bound
+// Only the texture changes between draws, so sorting draws by texture is what saves binds
+struct DrawStats {
+	uint32_t drawCount = 0;
+	uint32_t bindCount = 0;				// Pipeline, vertex/index buffer and descriptor set binds (and texture index pushes) recorded
+	uint32_t textureBindCount = 0;		// Of those, texture binds (set 1, or index pushes in bindless mode)
+	uint32_t textureBindsSaved = 0;		// Texture binds drawing in unsorted (model list) order would have recorded, less textureBindCount
+};
+
+// Device local memory use, and textures evicted to keep it within budget
+struct MemoryStats {
+	VkDeviceSize deviceLocalUsage = 0;
+	VkDeviceSize deviceLocalBudget = 0;
+	VkDeviceSize textureMemory = 0;			// Bytes used by resident textures
+	uint32_t evictedTextures = 0;			// Textures currently drawn with the placeholder instead
+	uint32_t textureCacheHits = 0;			// Texture loads that reused a texture already created
+};
+
+// Progress of a model loaded in the background
+enum ModelLoadState {
+	MODEL_LOADING,			// Being imported, or its uploads are still in flight (drawn with no meshes until then)
+	MODEL_READY,			// In the scene
+	MODEL_FAILED			// Couldn't be loaded, stays with no meshes
+};
+
+// Draw of one instance of one mesh, tested against the frustum by the cull compute shader (matches cull.comp)
+struct DrawCandidate {
+	glm::vec4 boundingSphere;		// Mesh space centre (xyz) and radius (w)
+	uint32_t indexCount;
+	uint32_t firstIndex;			// Mesh's place in the geometry pool
+	int32_t vertexOffset;
+	uint32_t instance;				// Index of instance transform in the frame's instance data
+	uint32_t batch;					// Batch the draw is part of
+	uint32_t batchFirstDraw;		// Index of first draw of batch in the output commands
+	uint32_t padding;
+};
+
+// Uniform data for the cull compute shader (std140 layout, matches cull.comp)
+struct CullParams {
+	glm::vec4 frustumPlanes[6];		// World space planes, normals point inwards
+	uint32_t candidateCount;
+	uint32_t compact;				// Pack visible draws and count them (needs drawIndirectCount), otherwise zero culled draws
+	uint32_t padding[2];
+};
+
 struct SwapChainDetails {
 	VkSurfaceCapabilitiesKHR surfaceCapabilities;		// Surface properties, e.g. image size/extent
 	std::vector<VkSurfaceFormatKHR> formats;			// Surface image formats, e.g. RGBA and size of each colour
@@ -43,6 +115,30 @@ struct SwapchainImage {
 	VkImageView imageView;
 };
 
+// Get the 6 planes (left, right, bottom, top, near, far) of the frustum of a view projection matrix (depth 0 to 1)
+// Each plane is normalised with its normal pointing inwards, so a point p is inside when dot(plane.xyz, p) + plane.w >= 0
+static void extractFrustumPlanes(const glm::mat4 &viewProjection, glm::vec4 planes[6])
+{
+	// Rows of the matrix (GLM stores columns)
+	glm::vec4 rows[4];
+	for (int i = 0; i < 4; i++)
+	{
+		rows[i] = glm::vec4(viewProjection[0][i], viewProjection[1][i], viewProjection[2][i], viewProjection[3][i]);
+	}
+
+	planes[0] = rows[3] + rows[0];
+	planes[1] = rows[3] - rows[0];
+	planes[2] = rows[3] + rows[1];
+	planes[3] = rows[3] - rows[1];
+	planes[4] = rows[2];
+	planes[5] = rows[3] - rows[2];
+
+	for (int i = 0; i < 6; i++)
+	{
+		planes[i] /= glm::length(glm::vec3(planes[i]));
+	}
+}
+
 static std::vector<char> readFile(const std::string &filename)
 {
 	// Open stream from given file
@@ -87,180 +183,6 @@ static uint32_t findMemoryTypeIndex(VkPhysicalDevice physicalDevice, uint32_t al
 			return i;
 		}
 	}
-}
-
-static void createBuffer(VkPhysicalDevice physicalDevice, VkDevice device, VkDeviceSize bufferSize, VkBufferUsageFlags bufferUsage,
-	VkMemoryPropertyFlags bufferProperties, VkBuffer* buffer, VkDeviceMemory* bufferMemory)
-{
-	// -- Create vertex buffer --
-	// Information to create a buffer (but doesn't inlude assigning memory)
-	VkBufferCreateInfo bufferInfo = {};
-	bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
-	bufferInfo.size = bufferSize;												// size of buffer (size of 1 vertex * number of vertices)
-	bufferInfo.usage = bufferUsage;											    // multiple types of buffer possible
-	bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;							// similar to swap chain images, can share vertex buffers
-
-	VkResult result = vkCreateBuffer(device, &bufferInfo, nullptr, buffer);
-	if (result != VK_SUCCESS)
-	{
-		throw std::runtime_error("Failed to create a vertex buffer!");
-	}
-
-	// Get buffer memory requirements
-	VkMemoryRequirements memRequirements;
-	vkGetBufferMemoryRequirements(device, *buffer, &memRequirements);
-
-	// allocate memory to buffer
-	VkMemoryAllocateInfo memoryAllocInfo = {};
-	memoryAllocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-	memoryAllocInfo.allocationSize = memRequirements.size;
-	memoryAllocInfo.memoryTypeIndex = findMemoryTypeIndex(physicalDevice, memRequirements.memoryTypeBits, bufferProperties);													
-
-	// allocate memory to VkDeviceMemory
-	result = vkAllocateMemory(device, &memoryAllocInfo, nullptr, bufferMemory);
-	if (result != VK_SUCCESS)
-	{
-		throw std::runtime_error("Failed to allocate Vertex Buffer Memory!");
-	}
-
-	// allocate memory to given vertex buffer
-	vkBindBufferMemory(device, *buffer, *bufferMemory, 0);
-}
 
-static VkCommandBuffer beginCommandBuffer(VkDevice device, VkCommandPool commandPool)
-{
-	// Command buffer to hold transfer commands
-	VkCommandBuffer commandBuffer;
-
-	// Command buffer details
-	VkCommandBufferAllocateInfo allocInfo = {};
-	allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-	allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-	allocInfo.commandPool = commandPool;
-	allocInfo.commandBufferCount = 1;
-
-	// allocate command buffer from pool
-	vkAllocateCommandBuffers(device, &allocInfo, &commandBuffer);
-
-	// information to begin the command buffer record
-	VkCommandBufferBeginInfo beginInfo = {};
-	beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-	beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT; // we're only using command buffer once, so set up for once
-
-	// begin recording transfer commands
-	vkBeginCommandBuffer(commandBuffer, &beginInfo);
-
-	return commandBuffer;
-}
-
-static void endAndSubmitCommandBuffer(VkDevice device, VkCommandPool commandPool, VkQueue queue, VkCommandBuffer commandBuffer)
-{
-	vkEndCommandBuffer(commandBuffer);
-
-	// Queue submission information
-	VkSubmitInfo submitInfo = {};
-	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-	submitInfo.commandBufferCount = 1;
-	submitInfo.pCommandBuffers = &commandBuffer;
-
-	// submit transfer command to transfer queue (which is also our graphics queue) and wait until it finishes
-	vkQueueSubmit(queue, 1, &submitInfo, VK_NULL_HANDLE);
-	vkQueueWaitIdle(queue);
-
-	// free temporary command buffer back to pool
-	vkFreeCommandBuffers(device, commandPool, 1, &commandBuffer);
-}
-
-static void copyBuffer(VkDevice device, VkQueue transferQueue, VkCommandPool transferCommandPool,
-	VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize bufferSize)
-{
-	// create buffer
-	VkCommandBuffer transferCommandBuffer = beginCommandBuffer(device, transferCommandPool);
-
-	// region of data to from and to
-	VkBufferCopy bufferCopyRegion = {};
-	bufferCopyRegion.srcOffset = 0;
-	bufferCopyRegion.dstOffset = 0;
-	bufferCopyRegion.size = bufferSize;
-
-	// command to copy src buffer to dst buffer
-	vkCmdCopyBuffer(transferCommandBuffer, srcBuffer, dstBuffer, 1, &bufferCopyRegion);
-
-	endAndSubmitCommandBuffer(device, transferCommandPool, transferQueue, transferCommandBuffer);
-	
+	throw std::runtime_error("Failed to find a suitable memory type!");
 }
-
-static void copyImageBuffer(VkDevice device, VkQueue transferQueue, VkCommandPool transferCommandPool,
-	VkBuffer srcBuffer, VkImage image, uint32_t width, uint32_t height)
-{
-	// create buffer
-	VkCommandBuffer transferCommandBuffer = beginCommandBuffer(device, transferCommandPool);
-
-	VkBufferImageCopy imageRegion = {};
-	imageRegion.bufferOffset = 0;												// offset into data
-	imageRegion.bufferRowLength = 0;											// row length of data to calculate data spacing
-	imageRegion.bufferImageHeight = 0;											// image height to calculate data spacing
-	imageRegion.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;		// which aspect of image to copy
-	imageRegion.imageSubresource.mipLevel = 0;									// mipmap level to copy
-	imageRegion.imageSubresource.baseArrayLayer = 0;							// starting array level
-	imageRegion.imageSubresource.layerCount = 1;								// number of lyers to copy stargin at baseArrayLayer
-	imageRegion.imageOffset = { 0, 0, 0 };										// offset into image (as opposed to raw data in buffer offset)
-	imageRegion.imageExtent = { width, height, 1 };								// size of region to copy as (x, y, z) values
-	
-	// copy buffer to given image
-	vkCmdCopyBufferToImage(transferCommandBuffer, srcBuffer, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &imageRegion);
-
-	endAndSubmitCommandBuffer(device, transferCommandPool, transferQueue, transferCommandBuffer);
-}
-
-static void transtionImageLayout(VkDevice device, VkQueue queue, VkCommandPool commandPool, VkImage image, VkImageLayout oldLayout, VkImageLayout newLayout)
-{
-	// create buffer
-	VkCommandBuffer commandBuffer = beginCommandBuffer(device, commandPool);
-
-	VkImageMemoryBarrier imageMemoryBarrier = {};
-	imageMemoryBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-	imageMemoryBarrier.oldLayout = oldLayout;										// layout to transition from
-	imageMemoryBarrier.newLayout = newLayout;										// layout to transition to
-	imageMemoryBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;				// queue family to transition from
-	imageMemoryBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;				// queue family to transition to
-	imageMemoryBarrier.image = image;												// image beng accessed and modified as part of the barrier
-	imageMemoryBarrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;		// aspect of image being altered
-	imageMemoryBarrier.subresourceRange.baseMipLevel = 0;							// first mip level to start alterations on
-	imageMemoryBarrier.subresourceRange.levelCount = 1;								// number of mip levels to alter starting from base
-	imageMemoryBarrier.subresourceRange.baseArrayLayer = 0;							// first layer to start alterations on
-	imageMemoryBarrier.subresourceRange.layerCount = 1;								// number of layers to alter starting from basearraylayer
-
-	VkPipelineStageFlags srcStage;
-	VkPipelineStageFlags dstStage;
-
-	// if transitioning from new image to image ready to receive data...
-	if (oldLayout == VK_IMAGE_LAYOUT_UNDEFINED && newLayout == VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL)
-	{
-		imageMemoryBarrier.srcAccessMask = 0;								// memory access stage transition must happen after...
-		imageMemoryBarrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;		// memory access stage transition must happen before...
-
-		srcStage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
-		dstStage = VK_PIPELINE_STAGE_TRANSFER_BIT;
-	}
-	// if transitioning from transfer destination to shader readable...
-	else if (oldLayout == VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL && newLayout == VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL)
-	{
-		imageMemoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;		// memory access stage transition must happen after...
-		imageMemoryBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;			// memory access stage transition must happen before...
-
-		srcStage = VK_PIPELINE_STAGE_TRANSFER_BIT;
-		dstStage = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
-	}
-
-	vkCmdPipelineBarrier(
-		commandBuffer,
-		srcStage, dstStage,		// pipeline stages (match to src and dst AccessMasks)
-		0,						// dependency flags
-		0, nullptr,				// memory barrier count + data
-		0, nullptr,				// buffer memory barrier count + data
-		1, &imageMemoryBarrier	// image memory barrier count + data
-	);
-
-	endAndSubmitCommandBuffer(device, commandPool, queue, commandBuffer);
-}
\ No newline at end of file
@@ -14,29 +14,33 @@ int VulkanRenderer::init(GLFWwindow * newWindow)
 		createSurface();
 		getPhysicalDevice();
 		createLogicalDevice();
+		createMemoryAllocator();
 		createSwapChain();
 		createRenderPass();
 		createDescriptorSetLayout();
 		createPushConstantRange();
 		createGraphicsPipeline();
+		createCullPipeline();
 		createDepthBufferImage();
 		createFramebuffers();
 		createCommandPool();
-		createCommandBuffers();
+		createUploadManager();
+		createGeometryPool();
 		createTextureSampler();
-		//allocateDynamicBufferTransferSpace();
-		createUniformBuffers();
+		createPlaceholderTexture();
 		createDescriptorPool();
-		createDescriptorSets();
-		createSynchronisation();
+		createBindlessTextureSet();
+		createPlaceholderDescriptor();
+		createFrameTimeline();
+		createFrameResources();
+		loadingWorkers.createWorkers(LOADING_WORKER_COUNT);
+		decodingWorkers.createWorkers(std::max(1u, std::thread::hardware_concurrency()));
 
 		//int firstTexture = createTextureImage("gorilla.jpg");
 
-		uboViewProjection.projection = glm::perspective(glm::radians(45.0f), (float)swapChainExtent.width / (float)swapChainExtent.height, 0.1f, 100.0f);
+		updateProjection();
 		uboViewProjection.view = glm::lookAt(glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 0.0f, 0.0f));
 
-		uboViewProjection.projection[1][1] *= -1;
-
 		//// Create a mesh
 		//// Vertex Data
 		//std::vector<Vertex> meshVertices = {
@@ -70,7 +74,14 @@ int VulkanRenderer::init(GLFWwindow * newWindow)
 		//meshList.push_back(firstMesh);
 		//meshList.push_back(secondMesh);
 
-		createMeshModel("Models/Seahawk.obj");
+		if (asyncModelLoading)
+		{
+			loadModelAsync("Models/Seahawk.obj");
+		}
+		else
+		{
+			createMeshModel("Models/Seahawk.obj");
+		}
 
 	}
 	catch (const std::runtime_error &e) {
@@ -84,41 +95,321 @@ int VulkanRenderer::init(GLFWwindow * newWindow)
 void VulkanRenderer::updateModel(int modelId, glm::mat4 newModel)
 {
 	if (modelId >= modelList.size()) return;
+
+	// Transforms are read from the instance buffer each frame, so recorded commands stay valid
 	modelList[modelId].setModel(newModel);
 }
 
+size_t VulkanRenderer::addInstance(int modelId, glm::mat4 transform)
+{
+	if (modelId >= modelList.size())
+	{
+		throw std::runtime_error("Attempted to add Instance to invalid Model!");
+	}
+
+	// Instance count is recorded into the draw commands, so they must be recorded again
+	size_t instanceId = modelList[modelId].addInstance(transform);
+	invalidateCommandBuffers();
+
+	return instanceId;
+}
+
+void VulkanRenderer::updateInstance(int modelId, size_t instanceId, glm::mat4 transform)
+{
+	if (modelId >= modelList.size()) return;
+
+	modelList[modelId].setInstance(instanceId, transform);
+}
+
+void VulkanRenderer::updateMeshTexture(int modelId, size_t meshIndex, int texId)
+{
+	if (modelId >= modelList.size() || texId >= textureImageViews.size()) return;
+
+	// Texture descriptor set (or index, when bindless) is recorded into the commands, so they must be recorded again
+	modelList[modelId].getMesh(meshIndex)->setTexId(texId);
+	renderListDirty = true;
+	invalidateCommandBuffers();
+}
+
+void VulkanRenderer::setCommandBufferCaching(bool enabled)
+{
+	commandBufferCaching = enabled;
+	invalidateCommandBuffers();
+}
+
+void VulkanRenderer::setParallelRecording(bool enabled)
+{
+	parallelRecording = enabled;
+	invalidateCommandBuffers();
+}
+
+void VulkanRenderer::setIndirectDrawing(bool enabled)
+{
+	indirectDrawing = enabled;
+	invalidateCommandBuffers();
+}
+
+void VulkanRenderer::setGpuCulling(bool enabled)
+{
+	// Decides whether the cull pipeline is created, so can't change once it would have been
+	if (mainDevice.logicalDevice != VK_NULL_HANDLE) return;
+
+	gpuCulling = enabled;
+}
+
+void VulkanRenderer::setCpuCulling(bool enabled)
+{
+	// Meshes outside the view are left out of the draws before each frame is submitted
+	// Off by default: direct draws record their instance counts, so with command buffer caching they are
+	// re-recorded whenever the visible set changes (indirect draws read the counts each frame instead)
+	cpuCulling = enabled;
+	invalidateCommandBuffers();
+}
+
+void VulkanRenderer::setBindlessTextures(bool enabled)
+{
+	// Decides descriptor layouts and shaders, so can't change once they are created
+	if (mainDevice.logicalDevice != VK_NULL_HANDLE) return;
+
+	bindlessTextures = enabled;
+}
+
+void VulkanRenderer::setFramesInFlight(uint32_t count)
+{
+	// Keep within the number of frames resources can be created for
+	count = std::max(1u, std::min(count, static_cast<uint32_t>(MAX_FRAME_DRAWS)));
+	if (count == framesInFlight) return;
+
+	framesInFlight = count;
+
+	// If renderer not initialised yet, new count will be used when frame resources are first created
+	if (frames.empty()) return;
+
+	// Frame resources can only be replaced once the GPU has finished with all of them
+	vkDeviceWaitIdle(mainDevice.logicalDevice);
+	destroyFrameResources();
+	createFrameResources();
+}
+
+void VulkanRenderer::notifyFramebufferResized()
+{
+	// Swapchain is recreated after the next present, some platforms never report it out of date
+	swapChainOutOfDate = true;
+}
+
+void VulkanRenderer::setPresentMode(VkPresentModeKHR mode)
+{
+	preferredPresentMode = mode;
+
+	// Present mode is fixed at swapchain creation, so rebuild it if one already exists
+	if (swapchain != VK_NULL_HANDLE)
+	{
+		swapChainOutOfDate = true;
+	}
+}
+
+VkPresentModeKHR VulkanRenderer::getPresentMode()
+{
+	return presentMode;
+}
+
+void VulkanRenderer::setTargetFrameRate(double framesPerSecond)
+{
+	if (framesPerSecond <= 0.0)
+	{
+		targetFrameInterval = std::chrono::steady_clock::duration::zero();
+		return;
+	}
+
+	targetFrameInterval = std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+		std::chrono::duration<double>(1.0 / framesPerSecond));
+	nextFrameStart = std::chrono::steady_clock::now();
+}
+
+const FrameTimings & VulkanRenderer::getFrameTimings()
+{
+	return frameTimings;
+}
+
+const DrawStats & VulkanRenderer::getDrawStats()
+{
+	return drawStats;
+}
+
+void VulkanRenderer::setMemoryBudget(VkDeviceSize bytes)
+{
+	memoryBudgetLimit = bytes;
+	memoryAllocator.setBudgetLimit(bytes);
+}
+
+const MemoryStats & VulkanRenderer::getMemoryStats()
+{
+	return memoryStats;
+}
+
+void VulkanRenderer::limitFrameRate()
+{
+	if (targetFrameInterval == std::chrono::steady_clock::duration::zero()) return;
+
+	auto now = std::chrono::steady_clock::now();
+
+	// Sleep is only accurate to a millisecond or so, so sleep most of the way and spin for the rest
+	const auto spinTime = std::chrono::milliseconds(2);
+	if (nextFrameStart - now > spinTime)
+	{
+		std::this_thread::sleep_until(nextFrameStart - spinTime);
+	}
+	while (std::chrono::steady_clock::now() < nextFrameStart)
+	{
+		std::this_thread::yield();
+	}
+
+	// Schedule next frame from when this one was due, unless we've fallen behind (don't try to catch up)
+	now = std::chrono::steady_clock::now();
+	nextFrameStart += targetFrameInterval;
+	if (nextFrameStart < now)
+	{
+		nextFrameStart = now + targetFrameInterval;
+	}
+}
+
+uint64_t VulkanRenderer::getSubmittedFrame()
+{
+	return frameNumber;
+}
+
+uint64_t VulkanRenderer::getCompletedFrame()
+{
+	// Timeline value is the number of the last frame the GPU finished
+	uint64_t completedFrame;
+	vkGetSemaphoreCounterValue(mainDevice.logicalDevice, frameTimeline, &completedFrame);
+	return completedFrame;
+}
+
+void VulkanRenderer::waitForFrame(uint64_t targetFrame)
+{
+	// Wait until the timeline reaches the given frame (returns immediately if already reached, or frame 0)
+	VkSemaphoreWaitInfo waitInfo = {};
+	waitInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+	waitInfo.semaphoreCount = 1;
+	waitInfo.pSemaphores = &frameTimeline;
+	waitInfo.pValues = &targetFrame;
+
+	vkWaitSemaphores(mainDevice.logicalDevice, &waitInfo, std::numeric_limits<uint64_t>::max());
+}
+
 void VulkanRenderer::draw()
 {
+	using Clock = std::chrono::steady_clock;
+	auto milliseconds = [](Clock::duration duration) { return std::chrono::duration<double, std::milli>(duration).count(); };
+
+	// Hold the target frame rate before starting any work, so input is read as late as possible
+	Clock::time_point limiterStart = Clock::now();
+	limitFrameRate();
+	Clock::time_point frameStart = Clock::now();
+
+	FrameTimings timings = {};
+	timings.limiterWait = milliseconds(frameStart - limiterStart);
+
+	FrameResources &frame = frames[currentFrame];
+
 	// -- GET NEXT IMAGE --
-	// Wait for given fence to signal (open) from last draw before continuing
-	vkWaitForFences(mainDevice.logicalDevice, 1, &drawFences[currentFrame], VK_TRUE, std::numeric_limits<uint64_t>::max());
-	// Manually reset (close) fences
-	vkResetFences(mainDevice.logicalDevice, 1, &drawFences[currentFrame]);
+	// Wait for the last frame submitted with these resources to finish before continuing
+	waitForFrame(frame.submittedFrame);
+	Clock::time_point acquireStart = Clock::now();
+	timings.fenceWait = milliseconds(acquireStart - frameStart);
 
 	// Get index of next image to be drawn to, and signal semaphore when ready to be drawn to
 	uint32_t imageIndex;
-	vkAcquireNextImageKHR(mainDevice.logicalDevice, swapchain, std::numeric_limits<uint64_t>::max(), imageAvailable[currentFrame], VK_NULL_HANDLE, &imageIndex);
+	VkResult result = vkAcquireNextImageKHR(mainDevice.logicalDevice, swapchain, std::numeric_limits<uint64_t>::max(), frame.imageAvailable, VK_NULL_HANDLE, &imageIndex);
+	Clock::time_point acquireEnd = Clock::now();
+	timings.acquireWait = milliseconds(acquireEnd - acquireStart);
+
+	// Swapchain no longer matches the surface (e.g. window resized), so it can't be drawn to. Rebuild it and skip this frame
+	// Nothing has been numbered or submitted yet, so this frame's resources are untouched
+	if (result == VK_ERROR_OUT_OF_DATE_KHR)
+	{
+		recreateSwapChain();
+		return;
+	}
+	// Suboptimal images can still be presented, swapchain is rebuilt after presenting instead
+	if (result != VK_SUCCESS && result != VK_SUBOPTIMAL_KHR)
+	{
+		throw std::runtime_error("Failed to acquire Swapchain Image!");
+	}
+
+	// If a previous frame is still rendering to this image, wait for it to finish
+	waitForFrame(imagesInFlight[imageIndex]);
+	timings.fenceWait += milliseconds(Clock::now() - acquireEnd);
+
+	// Number this frame, the timeline will reach this value when it is done
+	frameNumber++;
+	frame.submittedFrame = frameNumber;
+	imagesInFlight[imageIndex] = frameNumber;
 
-	recordCommands(imageIndex);
-	updateUniformBuffers(imageIndex);
+	// Models loaded in the background join the scene once ready, before the render list is built
+	updateModelLoads();
+
+	// Write this frame's uniforms first, recorded commands depend on where they are placed
+	updateUniformBuffers(currentFrame);
+
+	// Keep within the memory budget, before recording (evicting or restoring a texture changes its descriptor)
+	manageTextureMemory();
+
+	// Only record commands again if the scene has changed since this image's commands were recorded
+	if (!commandBufferCaching || frame.commandBufferDirty[imageIndex])
+	{
+		recordCommands(imageIndex);
+		frame.commandBufferDirty[imageIndex] = false;
+	}
 
 	// -- SUBMIT COMMAND BUFFER TO RENDER --
 	// Queue submission information
+	std::vector<VkSemaphore> waitSemaphores = { frame.imageAvailable };
+	std::vector<VkPipelineStageFlags> waitStages = { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT };
+	std::vector<uint64_t> waitValues = { 0 };							// Values to wait for timeline semaphores to reach (binary semaphore values are ignored)
+
+	// Cull this frame's draws on the compute queue, while the graphics queue works on previous frames
+	// Draws wait for the results at the stages that read them
+	if (computeScheduler.isAsync() && indirectDrawingActive() && cullCandidateCount > 0)
+	{
+		VkCommandBuffer computeCommandBuffer = computeScheduler.begin(currentFrame);
+		recordCulling(computeCommandBuffer, frame);
+		computeScheduler.submit(currentFrame, {});
+
+		QueueWait cullWait = computeScheduler.getWait(VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_INPUT_BIT);
+		waitSemaphores.push_back(cullWait.semaphore);
+		waitStages.push_back(cullWait.stages);
+		waitValues.push_back(cullWait.value);
+	}
+
 	VkSubmitInfo submitInfo = {};
 	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-	submitInfo.waitSemaphoreCount = 1;										// Number of semaphores to wait on
-	submitInfo.pWaitSemaphores = &imageAvailable[currentFrame];				// List of semaphores to wait on
-	VkPipelineStageFlags waitStages[] = {
-		VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT
-	};
-	submitInfo.pWaitDstStageMask = waitStages;						// Stages to check semaphores at
-	submitInfo.commandBufferCount = 1;								// Number of command buffers to submit
-	submitInfo.pCommandBuffers = &commandBuffers[imageIndex];		// Command buffer to submit
-	submitInfo.signalSemaphoreCount = 1;							// Number of semaphores to signal
-	submitInfo.pSignalSemaphores = &renderFinished[currentFrame];	// Semaphores to signal when command buffer finishes
+	submitInfo.waitSemaphoreCount = static_cast<uint32_t>(waitSemaphores.size());	// Number of semaphores to wait on
+	submitInfo.pWaitSemaphores = waitSemaphores.data();								// List of semaphores to wait on
+	submitInfo.pWaitDstStageMask = waitStages.data();								// Stages to check semaphores at
+	submitInfo.commandBufferCount = 1;										// Number of command buffers to submit
+	submitInfo.pCommandBuffers = &frame.commandBuffers[imageIndex];			// Command buffer to submit
+	std::array<VkSemaphore, 2> signalSemaphores = { frame.renderFinished, frameTimeline };
+	submitInfo.signalSemaphoreCount = static_cast<uint32_t>(signalSemaphores.size());	// Number of semaphores to signal
+	submitInfo.pSignalSemaphores = signalSemaphores.data();								// Semaphores to signal when command buffer finishes
+
+	// Values to signal timeline semaphores with (binary semaphore values are ignored)
+	std::array<uint64_t, 2> signalValues = { 0, frameNumber };
+
+	VkTimelineSemaphoreSubmitInfo timelineSubmitInfo = {};
+	timelineSubmitInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+	timelineSubmitInfo.waitSemaphoreValueCount = static_cast<uint32_t>(waitValues.size());
+	timelineSubmitInfo.pWaitSemaphoreValues = waitValues.data();
+	timelineSubmitInfo.signalSemaphoreValueCount = static_cast<uint32_t>(signalValues.size());
+	timelineSubmitInfo.pSignalSemaphoreValues = signalValues.data();
+	submitInfo.pNext = &timelineSubmitInfo;
+
+	// Uploads made since the last frame go first, so this frame's commands see them (on the graphics queue, or acquired by it)
+	uploadManager.submit();
 
 	// Submit command buffer to queue
-	VkResult result = vkQueueSubmit(graphicsQueue, 1, &submitInfo, drawFences[currentFrame]);
+	result = vkQueueSubmit(graphicsQueue, 1, &submitInfo, VK_NULL_HANDLE);
 	if (result != VK_SUCCESS)
 	{
 		throw std::runtime_error("Failed to submit Command Buffer to Queue!");
@@ -128,33 +419,66 @@ void VulkanRenderer::draw()
 	VkPresentInfoKHR presentInfo = {};
 	presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
 	presentInfo.waitSemaphoreCount = 1;										// Number of semaphores to wait on
-	presentInfo.pWaitSemaphores = &renderFinished[currentFrame];			// Semaphores to wait on
+	presentInfo.pWaitSemaphores = &frame.renderFinished;					// Semaphores to wait on
 	presentInfo.swapchainCount = 1;											// Number of swapchains to present to
 	presentInfo.pSwapchains = &swapchain;									// Swapchains to present images to
 	presentInfo.pImageIndices = &imageIndex;								// Index of images in swapchains to present
 
 	// Present image
+	Clock::time_point presentStart = Clock::now();
 	result = vkQueuePresentKHR(presentationQueue, &presentInfo);
-	if (result != VK_SUCCESS)
+	timings.present = milliseconds(Clock::now() - presentStart);
+
+	// Get next frame (use % framesInFlight to keep value below framesInFlight)
+	currentFrame = (currentFrame + 1) % framesInFlight;
+
+	timings.frameNumber = frameNumber;
+	timings.cpuFrame = milliseconds(Clock::now() - frameStart);
+	frameTimings = timings;
+
+	// Rebuild swapchain if it no longer matches the surface, the window has been resized or the present mode changed
+	if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR || swapChainOutOfDate)
+	{
+		swapChainOutOfDate = false;
+		recreateSwapChain();
+	}
+	else if (result != VK_SUCCESS)
 	{
 		throw std::runtime_error("Failed to present Image!");
 	}
-
-	// Get next frame (use % MAX_FRAME_DRAWS to keep value below MAX_FRAME_DRAWS)
-	currentFrame = (currentFrame + 1) % MAX_FRAME_DRAWS;
 }
 
 void VulkanRenderer::cleanup()
 {
+	// Let background loads and restores finish decoding, then drop any that haven't made it to the GPU
+	loadingWorkers.destroyWorkers();
+	for (auto &pending : pendingModels)
+	{
+		freeModelData(*pending.data);
+	}
+	pendingModels.clear();
+	decodingWorkers.destroyWorkers();
+
 	// Wait until no actions being run on device before destroying
 	vkDeviceWaitIdle(mainDevice.logicalDevice);
 
-	//_aligned_free(modelTransferSpace);
+	for (auto &pending : pendingRestores)
+	{
+		if (!pending.uploaded)
+		{
+			freeTextureData(*pending.data);
+		}
+	}
+	pendingRestores.clear();
+
+	// Upload batches still hold staging memory and command buffers, free them before what they upload to
+	uploadManager.destroyUploadManager();
 
 	for (size_t i = 0; i < modelList.size(); i++)
 	{
 		modelList[i].destroyMeshModel();
 	}
+	geometryPool.destroyGeometryPool();
 
 	vkDestroyDescriptorPool(mainDevice.logicalDevice, samplerDescriptorPool, nullptr);
 	vkDestroyDescriptorSetLayout(mainDevice.logicalDevice, samplerSetLayout, nullptr);
@@ -164,41 +488,32 @@ void VulkanRenderer::cleanup()
 	for (size_t i = 0; i < textureImages.size(); i++)
 	{
 		vkDestroyImageView(mainDevice.logicalDevice, textureImageViews[i], nullptr);
-		vkDestroyImage(mainDevice.logicalDevice, textureImages[i], nullptr);
-		vkFreeMemory(mainDevice.logicalDevice, textureImageMemory[i], nullptr);
+		memoryAllocator.destroyImage(textureImages[i], textureImageMemory[i]);
 	}
+	vkDestroyImageView(mainDevice.logicalDevice, placeholderImageView, nullptr);
+	memoryAllocator.destroyImage(placeholderImage, placeholderImageMemory);
 
-	vkDestroyImageView(mainDevice.logicalDevice, depthBufferImageView, nullptr);
-	vkDestroyImage(mainDevice.logicalDevice, depthBufferImage, nullptr);
-	vkFreeMemory(mainDevice.logicalDevice, depthBufferImageMemory, nullptr);
+	destroyFrameResources();
+	vkDestroySemaphore(mainDevice.logicalDevice, frameTimeline, nullptr);
 
 	vkDestroyDescriptorPool(mainDevice.logicalDevice, descriptorPool, nullptr);
 	vkDestroyDescriptorSetLayout(mainDevice.logicalDevice, descriptorSetLayout, nullptr);
-	for (size_t i = 0; i < swapChainImages.size(); i++)
-	{
-		vkDestroyBuffer(mainDevice.logicalDevice, vpUniformBuffer[i], nullptr);
-		vkFreeMemory(mainDevice.logicalDevice, vpUniformBufferMemory[i], nullptr);
-	}
 
-	for (size_t i = 0; i < MAX_FRAME_DRAWS; i++)
-	{
-		vkDestroySemaphore(mainDevice.logicalDevice, renderFinished[i], nullptr);
-		vkDestroySemaphore(mainDevice.logicalDevice, imageAvailable[i], nullptr);
-		vkDestroyFence(mainDevice.logicalDevice, drawFences[i], nullptr);
-	}
 	vkDestroyCommandPool(mainDevice.logicalDevice, graphicsCommandPool, nullptr);
-	for (auto framebuffer : swapChainFramebuffers)
+	for (auto workerCommandPool : workerCommandPools)
 	{
-		vkDestroyFramebuffer(mainDevice.logicalDevice, framebuffer, nullptr);
+		vkDestroyCommandPool(mainDevice.logicalDevice, workerCommandPool, nullptr);
 	}
+	recordingWorkers.destroyWorkers();
+	destroySwapChainResources();
+	vkDestroyPipeline(mainDevice.logicalDevice, cullPipeline, nullptr);
+	vkDestroyPipelineLayout(mainDevice.logicalDevice, cullPipelineLayout, nullptr);
+	vkDestroyDescriptorSetLayout(mainDevice.logicalDevice, cullSetLayout, nullptr);
 	vkDestroyPipeline(mainDevice.logicalDevice, graphicsPipeline, nullptr);
 	vkDestroyPipelineLayout(mainDevice.logicalDevice, pipelineLayout, nullptr);
 	vkDestroyRenderPass(mainDevice.logicalDevice, renderPass, nullptr);
-	for (auto image : swapChainImages)
-	{
-		vkDestroyImageView(mainDevice.logicalDevice, image.imageView, nullptr);
-	}
 	vkDestroySwapchainKHR(mainDevice.logicalDevice, swapchain, nullptr);
+	memoryAllocator.destroyMemoryAllocator();
 	vkDestroySurfaceKHR(instance, surface, nullptr);
 	vkDestroyDevice(mainDevice.logicalDevice, nullptr);
 	if (enableValidationLayers) {
@@ -227,7 +542,7 @@ void VulkanRenderer::createInstance()
 	appInfo.applicationVersion = VK_MAKE_VERSION(1, 0, 0);		// Custom version of the application
 	appInfo.pEngineName = "No Engine";							// Custom engine name
 	appInfo.engineVersion = VK_MAKE_VERSION(1, 0, 0);			// Custom engine version
-	appInfo.apiVersion = VK_API_VERSION_1_0;					// The Vulkan Version
+	appInfo.apiVersion = VK_API_VERSION_1_2;					// The Vulkan Version (1.2 for timeline semaphores)
 
 	// Creation information for a VkInstance (Vulkan Instance)
 	VkInstanceCreateInfo createInfo = {};
@@ -270,6 +585,14 @@ void VulkanRenderer::createLogicalDevice()
 	// Vector for queue creation information, and set for family indices
 	std::vector<VkDeviceQueueCreateInfo> queueCreateInfos;
 	std::set<int> queueFamilyIndices = { indices.graphicsFamily, indices.presentationFamily };
+	if (indices.transferFamily >= 0)
+	{
+		queueFamilyIndices.insert(indices.transferFamily);
+	}
+	if (indices.computeFamily >= 0)
+	{
+		queueFamilyIndices.insert(indices.computeFamily);
+	}
 
 	// Queues the logical device needs to create and info to do so
 	for (int queueFamilyIndex : queueFamilyIndices)
@@ -289,14 +612,40 @@ void VulkanRenderer::createLogicalDevice()
 	deviceCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
 	deviceCreateInfo.queueCreateInfoCount = static_cast<uint32_t>(queueCreateInfos.size());		// Number of Queue Create Infos
 	deviceCreateInfo.pQueueCreateInfos = queueCreateInfos.data();								// List of queue create infos so device can create required queues
-	deviceCreateInfo.enabledExtensionCount = static_cast<uint32_t>(deviceExtensions.size());	// Number of enabled logical device extensions
-	deviceCreateInfo.ppEnabledExtensionNames = deviceExtensions.data();							// List of enabled logical device extensions
+	std::vector<const char *> enabledExtensions = deviceExtensions;
+	if (optionalFeatures.memoryBudget)
+	{
+		enabledExtensions.push_back(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+	}
+	deviceCreateInfo.enabledExtensionCount = static_cast<uint32_t>(enabledExtensions.size());	// Number of enabled logical device extensions
+	deviceCreateInfo.ppEnabledExtensionNames = enabledExtensions.data();						// List of enabled logical device extensions
 
 	// Physical Device Features the Logical Device will be using
 	VkPhysicalDeviceFeatures deviceFeatures = {};
 	deviceFeatures.samplerAnisotropy = VK_TRUE;
+	deviceFeatures.multiDrawIndirect = optionalFeatures.multiDrawIndirect;
+	deviceFeatures.drawIndirectFirstInstance = optionalFeatures.drawIndirectFirstInstance;
+	deviceFeatures.textureCompressionBC = optionalFeatures.textureCompressionBC;
 
 	deviceCreateInfo.pEnabledFeatures = &deviceFeatures;			// Physical Device features Logical Device will use
+
+	// Vulkan 1.2 features are enabled through a structure chained to the create info
+	VkPhysicalDeviceVulkan12Features vulkan12Features = {};
+	vulkan12Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+	vulkan12Features.timelineSemaphore = VK_TRUE;					// Frame completion is tracked with a timeline semaphore
+	vulkan12Features.drawIndirectCount = optionalFeatures.drawIndirectCount;
+
+	// Bindless textures: an array of textures, indexed by a value that can differ between invocations, that can be
+	// written while commands using it are in flight, and doesn't need every element written
+	if (bindlessTexturesActive())
+	{
+		vulkan12Features.runtimeDescriptorArray = VK_TRUE;
+		vulkan12Features.shaderSampledImageArrayNonUniformIndexing = VK_TRUE;
+		vulkan12Features.descriptorBindingSampledImageUpdateAfterBind = VK_TRUE;
+		vulkan12Features.descriptorBindingPartiallyBound = VK_TRUE;
+	}
+
+	deviceCreateInfo.pNext = &vulkan12Features;
 	
 	// Create the logical device for the given physical device
 	VkResult result = vkCreateDevice(mainDevice.physicalDevice, &deviceCreateInfo, nullptr, &mainDevice.logicalDevice);
@@ -310,6 +659,14 @@ void VulkanRenderer::createLogicalDevice()
 	// From given logical device, of given Queue Family, of given Queue Index (0 since only one queue), place reference in given VkQueue
 	vkGetDeviceQueue(mainDevice.logicalDevice, indices.graphicsFamily, 0, &graphicsQueue);
 	vkGetDeviceQueue(mainDevice.logicalDevice, indices.presentationFamily, 0, &presentationQueue);
+	if (indices.transferFamily >= 0)
+	{
+		vkGetDeviceQueue(mainDevice.logicalDevice, indices.transferFamily, 0, &transferQueue);
+	}
+	if (indices.computeFamily >= 0)
+	{
+		vkGetDeviceQueue(mainDevice.logicalDevice, indices.computeFamily, 0, &computeQueue);
+	}
 }
 
 void VulkanRenderer::setupDebugMessenger()
@@ -344,7 +701,7 @@ void VulkanRenderer::createSwapChain()
 
 	// Find optimal surface values for our swap chain
 	VkSurfaceFormatKHR surfaceFormat = chooseBestSurfaceFormat(swapChainDetails.formats);
-	VkPresentModeKHR presentMode = chooseBestPresentationMode(swapChainDetails.presentationModes);
+	presentMode = chooseBestPresentationMode(swapChainDetails.presentationModes);
 	VkExtent2D extent = chooseSwapExtent(swapChainDetails.surfaceCapabilities);
 
 	// How many images are in the swap chain? Get 1 more than the minimum to allow triple buffering
@@ -397,7 +754,8 @@ void VulkanRenderer::createSwapChain()
 	}
 
 	// IF old swap chain been destroyed and this one replaces it, then link old one to quickly hand over responsibilities
-	swapChainCreateInfo.oldSwapchain = VK_NULL_HANDLE;
+	VkSwapchainKHR oldSwapchain = swapchain;
+	swapChainCreateInfo.oldSwapchain = oldSwapchain;
 
 	// Create Swapchain
 	VkResult result = vkCreateSwapchainKHR(mainDevice.logicalDevice, &swapChainCreateInfo, nullptr, &swapchain);
@@ -406,6 +764,12 @@ void VulkanRenderer::createSwapChain()
 		throw std::runtime_error("Failed to create a Swapchain!");
 	}
 
+	// Old swapchain has been retired by the new one, so can now be destroyed
+	if (oldSwapchain != VK_NULL_HANDLE)
+	{
+		vkDestroySwapchainKHR(mainDevice.logicalDevice, oldSwapchain, nullptr);
+	}
+
 	// Store for later reference
 	swapChainImageFormat = surfaceFormat.format;
 	swapChainExtent = extent;
@@ -416,18 +780,66 @@ void VulkanRenderer::createSwapChain()
 	std::vector<VkImage> images(swapChainImageCount);
 	vkGetSwapchainImagesKHR(mainDevice.logicalDevice, swapchain, &swapChainImageCount, images.data());
 
+	swapChainImages.clear();
 	for (VkImage image : images)
 	{
 		// Store image handle
 		SwapchainImage swapChainImage = {};
 		swapChainImage.image = image;
-		swapChainImage.imageView = createImageView(image, swapChainImageFormat, VK_IMAGE_ASPECT_COLOR_BIT);
+		swapChainImage.imageView = createImageView(image, swapChainImageFormat, VK_IMAGE_ASPECT_COLOR_BIT, 1);
 
 		// Add to swapchain image list
 		swapChainImages.push_back(swapChainImage);
 	}
 }
 
+void VulkanRenderer::recreateSwapChain()
+{
+	// Window is minimised, wait until it has a size again (a swapchain can't have 0 extent)
+	int width = 0, height = 0;
+	glfwGetFramebufferSize(window, &width, &height);
+	while (width == 0 || height == 0)
+	{
+		glfwWaitEvents();
+		glfwGetFramebufferSize(window, &width, &height);
+	}
+
+	// Frames in flight may still be using the old images and framebuffers
+	vkDeviceWaitIdle(mainDevice.logicalDevice);
+
+	// Only resources that depend on the surface size are rebuilt
+	// (render pass, pipeline, descriptors and buffers don't change: viewport and scissor are dynamic)
+	destroySwapChainResources();
+	createSwapChain();
+	createDepthBufferImage();
+	createFramebuffers();
+
+	// New swapchain may have a different number of images, and recorded commands reference the old framebuffers
+	destroyCommandBuffers();
+	createCommandBuffers();
+	imagesInFlight.assign(swapChainImages.size(), 0);
+
+	updateProjection();
+}
+
+void VulkanRenderer::destroySwapChainResources()
+{
+	for (auto framebuffer : swapChainFramebuffers)
+	{
+		vkDestroyFramebuffer(mainDevice.logicalDevice, framebuffer, nullptr);
+	}
+	swapChainFramebuffers.clear();
+
+	vkDestroyImageView(mainDevice.logicalDevice, depthBufferImageView, nullptr);
+	memoryAllocator.destroyImage(depthBufferImage, depthBufferImageMemory);
+
+	for (auto image : swapChainImages)
+	{
+		vkDestroyImageView(mainDevice.logicalDevice, image.imageView, nullptr);
+	}
+	swapChainImages.clear();
+}
+
 void VulkanRenderer::createRenderPass()
 {
 	// ATTACHMENTS
@@ -478,7 +890,7 @@ void VulkanRenderer::createRenderPass()
 	subpass.pDepthStencilAttachment = &depthAttachmentReference;
 
 	// Need to determine when layout transitions occur using subpass dependencies
-	std::array<VkSubpassDependency, 2> subpassDependencies;
+	std::array<VkSubpassDependency, 3> subpassDependencies;
 
 	// Conversion from VK_IMAGE_LAYOUT_UNDEFINED to VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL
 	// Transition must happen after...
@@ -503,6 +915,17 @@ void VulkanRenderer::createRenderPass()
 	subpassDependencies[1].dstAccessMask = VK_ACCESS_MEMORY_READ_BIT;
 	subpassDependencies[1].dependencyFlags = 0;
 
+	// Depth buffer is shared by all frames in flight, so a previous frame's depth writes must finish before it is cleared again
+	// Transition must happen after...
+	subpassDependencies[2].srcSubpass = VK_SUBPASS_EXTERNAL;
+	subpassDependencies[2].srcStageMask = VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+	subpassDependencies[2].srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+	// But must happen before...
+	subpassDependencies[2].dstSubpass = 0;
+	subpassDependencies[2].dstStageMask = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
+	subpassDependencies[2].dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+	subpassDependencies[2].dependencyFlags = 0;
+
 	std::array<VkAttachmentDescription, 2> renderPassAttachments = { colourAttachment, depthAttachment };
 
 	// Create info for Render Pass
@@ -528,19 +951,12 @@ void VulkanRenderer::createDescriptorSetLayout()
 	// UboViewProjection Binding Info
 	VkDescriptorSetLayoutBinding vpLayoutBinding = {};
 	vpLayoutBinding.binding = 0;											// Binding point in shader (designated by binding number in shader)
-	vpLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;	// Type of descriptor (uniform, dynamic uniform, image sampler, etc)
+	vpLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;	// Type of descriptor (uniform, dynamic uniform, image sampler, etc)
 	vpLayoutBinding.descriptorCount = 1;									// Number of descriptors for binding
 	vpLayoutBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;				// Shader stage to bind to
 	vpLayoutBinding.pImmutableSamplers = nullptr;							// For Texture: Can make sampler data unchangeable (immutable) by specifying in layout
 
-	// Model Binding Info
-	/*VkDescriptorSetLayoutBinding modelLayoutBinding = {};
-	modelLayoutBinding.binding = 1;
-	modelLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
-	modelLayoutBinding.descriptorCount = 1;
-	modelLayoutBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
-	modelLayoutBinding.pImmutableSamplers = nullptr;*/
-
+	// (Model transforms are per-instance vertex data, not uniforms)
 	std::vector<VkDescriptorSetLayoutBinding> layoutBindings = { vpLayoutBinding };
 
 	// Create Descriptor Set Layout with given bindings
@@ -557,19 +973,31 @@ void VulkanRenderer::createDescriptorSetLayout()
 	}
 
 	// Create texture sampler descriptor set layout
-	// Texture binding info
+	// Texture binding info (a single texture, or in bindless mode an array of every texture)
 	VkDescriptorSetLayoutBinding samplerLayoutBinding = {};
 	samplerLayoutBinding.binding = 0;
 	samplerLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-	samplerLayoutBinding.descriptorCount = 1;
+	samplerLayoutBinding.descriptorCount = bindlessTexturesActive() ? bindlessTextureCapacity : 1;
 	samplerLayoutBinding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
 	samplerLayoutBinding.pImmutableSamplers = nullptr;
 
+	// Bindless array is written as textures are created (even while in use by recorded commands), and unused elements are never read
+	VkDescriptorBindingFlags bindlessFlags = VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT | VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT;
+	VkDescriptorSetLayoutBindingFlagsCreateInfo bindingFlagsCreateInfo = {};
+	bindingFlagsCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO;
+	bindingFlagsCreateInfo.bindingCount = 1;
+	bindingFlagsCreateInfo.pBindingFlags = &bindlessFlags;
+
 	// create a descriptor set layout with given bindings for texture
 	VkDescriptorSetLayoutCreateInfo textureLayoutCreateInfo = {};
 	textureLayoutCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
 	textureLayoutCreateInfo.bindingCount = 1;
 	textureLayoutCreateInfo.pBindings = &samplerLayoutBinding;
+	if (bindlessTexturesActive())
+	{
+		textureLayoutCreateInfo.flags = VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT;
+		textureLayoutCreateInfo.pNext = &bindingFlagsCreateInfo;
+	}
 
 	// create a descriptor set layout
 	result = vkCreateDescriptorSetLayout(mainDevice.logicalDevice, &textureLayoutCreateInfo, nullptr, &samplerSetLayout);
@@ -583,16 +1011,17 @@ void VulkanRenderer::createDescriptorSetLayout()
 void VulkanRenderer::createPushConstantRange()
 {
 	// Define push constant values (no 'create' needed!)
-	pushConstantRange.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;	// Shader stage push constant will go to
-	pushConstantRange.offset = 0;								// Offset into given data to pass to push constant
-	pushConstantRange.size = sizeof(Model);						// Size of data being passed
+	pushConstantRange.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;	// Shader stage push constant will go to
+	pushConstantRange.offset = 0;									// Offset into given data to pass to push constant
+	pushConstantRange.size = sizeof(DrawPushConstants);				// Size of data being passed
 }
 
 void VulkanRenderer::createGraphicsPipeline()
 {
 	// Read in SPIR-V code of shaders
 	auto vertexShaderCode = readFile("Shaders/vert.spv");
-	auto fragmentShaderCode = readFile("Shaders/frag.spv");
+	// (bindless mode samples from the texture array, using the texture index pushed for each draw)
+	auto fragmentShaderCode = readFile(bindlessTexturesActive() ? "Shaders/frag_bindless.spv" : "Shaders/frag.spv");
 
 	// Create Shader Modules
 	VkShaderModule vertexShaderModule = createShaderModule(vertexShaderCode);
@@ -625,8 +1054,16 @@ void VulkanRenderer::createGraphicsPipeline()
 																	// VK_VERTEX_INPUT_RATE_INDEX		: Move on to the next vertex
 																	// VK_VERTEX_INPUT_RATE_INSTANCE	: Move to a vertex for the next instance
 
+	// Per-instance data (model transform) comes from a second stream, moving on once per instance
+	VkVertexInputBindingDescription instanceBindingDescription = {};
+	instanceBindingDescription.binding = 1;
+	instanceBindingDescription.stride = sizeof(glm::mat4);
+	instanceBindingDescription.inputRate = VK_VERTEX_INPUT_RATE_INSTANCE;
+
+	std::array<VkVertexInputBindingDescription, 2> bindingDescriptions = { bindingDescription, instanceBindingDescription };
+
 	// How the data for an attribute is defined within a vertex
-	std::array<VkVertexInputAttributeDescription, 3> attributeDescriptions;
+	std::array<VkVertexInputAttributeDescription, 7> attributeDescriptions;
 
 	// Position Attribute
 	attributeDescriptions[0].binding = 0;							// Which binding the data is at (should be same as above)
@@ -646,11 +1083,20 @@ void VulkanRenderer::createGraphicsPipeline()
 	attributeDescriptions[2].format = VK_FORMAT_R32G32_SFLOAT;
 	attributeDescriptions[2].offset = offsetof(Vertex, tex);
 
+	// Instance Model Attribute (a mat4 takes up one location per column)
+	for (uint32_t column = 0; column < 4; column++)
+	{
+		attributeDescriptions[3 + column].binding = 1;
+		attributeDescriptions[3 + column].location = 3 + column;
+		attributeDescriptions[3 + column].format = VK_FORMAT_R32G32B32A32_SFLOAT;
+		attributeDescriptions[3 + column].offset = sizeof(glm::vec4) * column;
+	}
+
 	// -- VERTEX INPUT --
 	VkPipelineVertexInputStateCreateInfo vertexInputCreateInfo = {};
 	vertexInputCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
-	vertexInputCreateInfo.vertexBindingDescriptionCount = 1;
-	vertexInputCreateInfo.pVertexBindingDescriptions = &bindingDescription;											// List of Vertex Binding Descriptions (data spacing/stride information)
+	vertexInputCreateInfo.vertexBindingDescriptionCount = static_cast<uint32_t>(bindingDescriptions.size());
+	vertexInputCreateInfo.pVertexBindingDescriptions = bindingDescriptions.data();											// List of Vertex Binding Descriptions (data spacing/stride information)
 	vertexInputCreateInfo.vertexAttributeDescriptionCount = static_cast<uint32_t>(attributeDescriptions.size());
 	vertexInputCreateInfo.pVertexAttributeDescriptions = attributeDescriptions.data();								// List of Vertex Attribute Descriptions (data format and where to bind to/from)
 
@@ -687,15 +1133,16 @@ void VulkanRenderer::createGraphicsPipeline()
 
 	// -- DYNAMIC STATES --
 	// Dynamic states to enable
-	//std::vector<VkDynamicState> dynamicStateEnables;
-	//dynamicStateEnables.push_back(VK_DYNAMIC_STATE_VIEWPORT);	// Dynamic Viewport : Can resize in command buffer with vkCmdSetViewport(commandbuffer, 0, 1, &viewport);
-	//dynamicStateEnables.push_back(VK_DYNAMIC_STATE_SCISSOR);	// Dynamic Scissor	: Can resize in command buffer with vkCmdSetScissor(commandbuffer, 0, 1, &scissor);
+	// (viewport and scissor are dynamic so the pipeline survives swapchain recreation)
+	std::vector<VkDynamicState> dynamicStateEnables;
+	dynamicStateEnables.push_back(VK_DYNAMIC_STATE_VIEWPORT);	// Dynamic Viewport : Can resize in command buffer with vkCmdSetViewport(commandbuffer, 0, 1, &viewport);
+	dynamicStateEnables.push_back(VK_DYNAMIC_STATE_SCISSOR);	// Dynamic Scissor	: Can resize in command buffer with vkCmdSetScissor(commandbuffer, 0, 1, &scissor);
 
-	//// Dynamic State creation info
-	//VkPipelineDynamicStateCreateInfo dynamicStateCreateInfo = {};
-	//dynamicStateCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
-	//dynamicStateCreateInfo.dynamicStateCount = static_cast<uint32_t>(dynamicStateEnables.size());
-	//dynamicStateCreateInfo.pDynamicStates = dynamicStateEnables.data();
+	// Dynamic State creation info
+	VkPipelineDynamicStateCreateInfo dynamicStateCreateInfo = {};
+	dynamicStateCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+	dynamicStateCreateInfo.dynamicStateCount = static_cast<uint32_t>(dynamicStateEnables.size());
+	dynamicStateCreateInfo.pDynamicStates = dynamicStateEnables.data();
 
 
 	// -- RASTERIZER --
@@ -780,7 +1227,7 @@ void VulkanRenderer::createGraphicsPipeline()
 	pipelineCreateInfo.pVertexInputState = &vertexInputCreateInfo;		// All the fixed function pipeline states
 	pipelineCreateInfo.pInputAssemblyState = &inputAssembly;
 	pipelineCreateInfo.pViewportState = &viewportStateCreateInfo;
-	pipelineCreateInfo.pDynamicState = nullptr;
+	pipelineCreateInfo.pDynamicState = &dynamicStateCreateInfo;
 	pipelineCreateInfo.pRasterizationState = &rasterizerCreateInfo;
 	pipelineCreateInfo.pMultisampleState = &multisamplingCreateInfo;
 	pipelineCreateInfo.pColorBlendState = &colourBlendingCreateInfo;
@@ -805,6 +1252,69 @@ void VulkanRenderer::createGraphicsPipeline()
 	vkDestroyShaderModule(mainDevice.logicalDevice, vertexShaderModule, nullptr);
 }
 
+void VulkanRenderer::createCullPipeline()
+{
+	// Without cull objects culling can't be turned on later (e.g. by switching to indirect drawing after init)
+	if (!gpuCullingActive())
+	{
+		gpuCulling = false;
+		return;
+	}
+
+	// Cull shader bindings: params (uniform), then candidates, instances, commands and counts (storage)
+	std::array<VkDescriptorSetLayoutBinding, 5> cullBindings = {};
+	for (uint32_t i = 0; i < cullBindings.size(); i++)
+	{
+		cullBindings[i].binding = i;
+		cullBindings[i].descriptorType = i == 0 ? VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER : VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		cullBindings[i].descriptorCount = 1;
+		cullBindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+		cullBindings[i].pImmutableSamplers = nullptr;
+	}
+
+	VkDescriptorSetLayoutCreateInfo layoutCreateInfo = {};
+	layoutCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	layoutCreateInfo.bindingCount = static_cast<uint32_t>(cullBindings.size());
+	layoutCreateInfo.pBindings = cullBindings.data();
+
+	VkResult result = vkCreateDescriptorSetLayout(mainDevice.logicalDevice, &layoutCreateInfo, nullptr, &cullSetLayout);
+	if (result != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to create a (cull) Descriptor Set Layout!");
+	}
+
+	VkPipelineLayoutCreateInfo pipelineLayoutCreateInfo = {};
+	pipelineLayoutCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+	pipelineLayoutCreateInfo.setLayoutCount = 1;
+	pipelineLayoutCreateInfo.pSetLayouts = &cullSetLayout;
+
+	result = vkCreatePipelineLayout(mainDevice.logicalDevice, &pipelineLayoutCreateInfo, nullptr, &cullPipelineLayout);
+	if (result != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to create (cull) Pipeline Layout!");
+	}
+
+	// Compute pipelines have a single shader stage and no fixed function state
+	auto computeShaderCode = readFile("Shaders/cull.spv");
+	VkShaderModule computeShaderModule = createShaderModule(computeShaderCode);
+
+	VkComputePipelineCreateInfo pipelineCreateInfo = {};
+	pipelineCreateInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+	pipelineCreateInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	pipelineCreateInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+	pipelineCreateInfo.stage.module = computeShaderModule;
+	pipelineCreateInfo.stage.pName = "main";
+	pipelineCreateInfo.layout = cullPipelineLayout;
+
+	result = vkCreateComputePipelines(mainDevice.logicalDevice, VK_NULL_HANDLE, 1, &pipelineCreateInfo, nullptr, &cullPipeline);
+	if (result != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to create a (cull) Compute Pipeline!");
+	}
+
+	vkDestroyShaderModule(mainDevice.logicalDevice, computeShaderModule, nullptr);
+}
+
 void VulkanRenderer::createDepthBufferImage()
 {
 	// get supported format for depth buffer
@@ -814,10 +1324,10 @@ void VulkanRenderer::createDepthBufferImage()
 		VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT);
 
 	// create depth buffer image
-	depthBufferImage = createImage(swapChainExtent.width, swapChainExtent.height, depthFormat, VK_IMAGE_TILING_OPTIMAL,
-		VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &depthBufferImageMemory);
+	depthBufferImage = createImage(swapChainExtent.width, swapChainExtent.height, 1, depthFormat, VK_IMAGE_TILING_OPTIMAL,
+		VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, MEMORY_CATEGORY_ATTACHMENTS, &depthBufferImageMemory);
 
-	depthBufferImageView = createImageView(depthBufferImage, depthFormat, VK_IMAGE_ASPECT_DEPTH_BIT);
+	depthBufferImageView = createImageView(depthBufferImage, depthFormat, VK_IMAGE_ASPECT_DEPTH_BIT, 1);
 }
 
 void VulkanRenderer::createFramebuffers()
@@ -867,58 +1377,113 @@ void VulkanRenderer::createCommandPool()
 	{
 		throw std::runtime_error("Failed to create a Command Pool!");
 	}
+
+	// Start one recording worker per CPU core, each with its own Command Pool
+	recordingWorkers.createWorkers(std::max(1u, std::thread::hardware_concurrency()));
+	workerCommandPools.resize(recordingWorkers.getWorkerCount());
+
+	for (size_t i = 0; i < workerCommandPools.size(); i++)
+	{
+		result = vkCreateCommandPool(mainDevice.logicalDevice, &poolInfo, nullptr, &workerCommandPools[i]);
+		if (result != VK_SUCCESS)
+		{
+			throw std::runtime_error("Failed to create a worker Command Pool!");
+		}
+	}
 }
 
 void VulkanRenderer::createCommandBuffers()
 {
-	// Resize command buffer count to have one for each framebuffer
-	commandBuffers.resize(swapChainFramebuffers.size());
-
 	VkCommandBufferAllocateInfo cbAllocInfo = {};
 	cbAllocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
 	cbAllocInfo.commandPool = graphicsCommandPool;
 	cbAllocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;	// VK_COMMAND_BUFFER_LEVEL_PRIMARY	: Buffer you submit directly to queue. Cant be called by other buffers.
 															// VK_COMMAND_BUFFER_LEVEL_SECONARY	: Buffer can't be called directly. Can be called from other buffers via "vkCmdExecuteCommands" when recording commands in primary buffer
-	cbAllocInfo.commandBufferCount = static_cast<uint32_t>(commandBuffers.size());
+	cbAllocInfo.commandBufferCount = static_cast<uint32_t>(swapChainFramebuffers.size());
 
-	// Allocate command buffers and place handles in array of buffers
-	VkResult result = vkAllocateCommandBuffers(mainDevice.logicalDevice, &cbAllocInfo, commandBuffers.data());
-	if (result != VK_SUCCESS)
+	// Secondary command buffers for parallel recording
+	VkCommandBufferAllocateInfo secondaryAllocInfo = {};
+	secondaryAllocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+	secondaryAllocInfo.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+	secondaryAllocInfo.commandBufferCount = 1;
+
+	for (auto &frame : frames)
 	{
-		throw std::runtime_error("Failed to allocate Command Buffers!");
+		// Resize command buffer count to have one for each framebuffer
+		frame.commandBuffers.resize(swapChainFramebuffers.size());
+
+		// Nothing has been recorded yet, so every command buffer starts dirty
+		frame.commandBufferDirty.assign(frame.commandBuffers.size(), true);
+
+		// Allocate command buffers and place handles in array of buffers
+		VkResult result = vkAllocateCommandBuffers(mainDevice.logicalDevice, &cbAllocInfo, frame.commandBuffers.data());
+		if (result != VK_SUCCESS)
+		{
+			throw std::runtime_error("Failed to allocate Command Buffers!");
+		}
+
+		// One secondary command buffer per worker for each image
+		frame.secondaryCommandBuffers.resize(frame.commandBuffers.size());
+		for (size_t i = 0; i < frame.secondaryCommandBuffers.size(); i++)
+		{
+			frame.secondaryCommandBuffers[i].resize(workerCommandPools.size());
+			for (size_t w = 0; w < workerCommandPools.size(); w++)
+			{
+				// Must come from the pool of the worker that will record it
+				secondaryAllocInfo.commandPool = workerCommandPools[w];
+
+				result = vkAllocateCommandBuffers(mainDevice.logicalDevice, &secondaryAllocInfo, &frame.secondaryCommandBuffers[i][w]);
+				if (result != VK_SUCCESS)
+				{
+					throw std::runtime_error("Failed to allocate Secondary Command Buffers!");
+				}
+			}
+		}
 	}
 }
 
 void VulkanRenderer::createSynchronisation()
 {
-	imageAvailable.resize(MAX_FRAME_DRAWS);
-	renderFinished.resize(MAX_FRAME_DRAWS);
-	drawFences.resize(MAX_FRAME_DRAWS);
+	// No image is being rendered to yet
+	imagesInFlight.assign(swapChainImages.size(), 0);
 
 	// Semaphore creation information
 	VkSemaphoreCreateInfo semaphoreCreateInfo = {};
 	semaphoreCreateInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
 
-	// Fence creation information
-	VkFenceCreateInfo fenceCreateInfo = {};
-	fenceCreateInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
-	fenceCreateInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
-
-	for (size_t i = 0; i < MAX_FRAME_DRAWS; i++)
+	for (auto &frame : frames)
 	{
-		if (vkCreateSemaphore(mainDevice.logicalDevice, &semaphoreCreateInfo, nullptr, &imageAvailable[i]) != VK_SUCCESS ||
-			vkCreateSemaphore(mainDevice.logicalDevice, &semaphoreCreateInfo, nullptr, &renderFinished[i]) != VK_SUCCESS ||
-			vkCreateFence(mainDevice.logicalDevice, &fenceCreateInfo, nullptr, &drawFences[i]) != VK_SUCCESS)
+		if (vkCreateSemaphore(mainDevice.logicalDevice, &semaphoreCreateInfo, nullptr, &frame.imageAvailable) != VK_SUCCESS ||
+			vkCreateSemaphore(mainDevice.logicalDevice, &semaphoreCreateInfo, nullptr, &frame.renderFinished) != VK_SUCCESS)
 		{
-			throw std::runtime_error("Failed to create a Semaphore and/or Fence!");
+			throw std::runtime_error("Failed to create a Semaphore!");
 		}
 	}
 }
 
-void VulkanRenderer::createTextureSampler()
+void VulkanRenderer::createFrameTimeline()
 {
-	// Sampler creation info
-	VkSamplerCreateInfo samplerCreateInfo = {};
+	// Timeline semaphores hold a 64-bit value instead of a signalled/unsignalled state
+	VkSemaphoreTypeCreateInfo semaphoreTypeInfo = {};
+	semaphoreTypeInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+	semaphoreTypeInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+	semaphoreTypeInfo.initialValue = 0;									// No frame has completed yet
+
+	VkSemaphoreCreateInfo semaphoreCreateInfo = {};
+	semaphoreCreateInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+	semaphoreCreateInfo.pNext = &semaphoreTypeInfo;
+
+	VkResult result = vkCreateSemaphore(mainDevice.logicalDevice, &semaphoreCreateInfo, nullptr, &frameTimeline);
+	if (result != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to create the frame timeline Semaphore!");
+	}
+}
+
+void VulkanRenderer::createTextureSampler()
+{
+	// Sampler creation info
+	VkSamplerCreateInfo samplerCreateInfo = {};
 	samplerCreateInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
 	samplerCreateInfo.magFilter = VK_FILTER_LINEAR;						// How to render when image is magnified on screen
 	samplerCreateInfo.minFilter = VK_FILTER_LINEAR;						// How to render when image is minified on screen
@@ -930,7 +1495,7 @@ void VulkanRenderer::createTextureSampler()
 	samplerCreateInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;		// mipmap interpolation mode
 	samplerCreateInfo.mipLodBias = 0.0f;								// level of detail bias for mip level
 	samplerCreateInfo.minLod = 0.0f;									// minimum level of detail to pick mip level
-	samplerCreateInfo.maxLod = 0.0f;									// maximum level of detail to pick mip level
+	samplerCreateInfo.maxLod = VK_LOD_CLAMP_NONE;						// maximum level of detail to pick mip level (every level each view has)
 	samplerCreateInfo.anisotropyEnable = VK_TRUE;						// enable anisotropy
 	samplerCreateInfo.maxAnisotropy = 16;								// anisotropy sample level
 
@@ -941,52 +1506,110 @@ void VulkanRenderer::createTextureSampler()
 	}
 }
 
-void VulkanRenderer::createUniformBuffers()
+void VulkanRenderer::createMemoryAllocator()
+{
+	// Needed before any buffer or image is created
+	memoryAllocator = MemoryAllocator(mainDevice.physicalDevice, mainDevice.logicalDevice, optionalFeatures.memoryBudget);
+	memoryAllocator.setBudgetLimit(memoryBudgetLimit);
+	deviceLocalHeap = memoryAllocator.findHeapIndex(VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+}
+
+void VulkanRenderer::createPlaceholderTexture()
 {
-	// ViewProjection buffer size
-	VkDeviceSize vpBufferSize = sizeof(UboViewProjection);
+	// Single grey texel, drawn in place of textures that have been evicted
+	stbi_uc placeholderData[4] = { 128, 128, 128, 255 };
+	TextureData placeholder;
+	placeholder.pixels = placeholderData;
+	placeholder.width = 1;
+	placeholder.height = 1;
+	placeholder.size = sizeof(placeholderData);
+	placeholderImage = createTextureImageFromData(placeholder, &placeholderImageMemory);
+	placeholderImageView = createImageView(placeholderImage, VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_ASPECT_COLOR_BIT, placeholder.mipLevels);
+}
 
-	// Model buffer size
-	//VkDeviceSize modelBufferSize = modelUniformAlignment * MAX_OBJECTS;
+void VulkanRenderer::createTransientRing()
+{
+	// One partition for each frame in flight, so CPU never writes to data the GPU is still reading
+	// Allocations are aligned so any of them can be used as a uniform or storage buffer offset
+	// Compute work reads and writes frame data too, so the ring is shared with the compute queue
+	transientRing = TransientRing(&memoryAllocator,
+		TRANSIENT_FRAME_SIZE, static_cast<uint32_t>(frames.size()), std::max(minUniformBufferOffset, minStorageBufferOffset),
+		computeScheduler.getQueueFamilies());
+}
 
-	// One uniform buffer for each image (and by extension, command buffer)
-	vpUniformBuffer.resize(swapChainImages.size());
-	vpUniformBufferMemory.resize(swapChainImages.size());
-	//modelDUniformBuffer.resize(swapChainImages.size());
-	//modelDUniformBufferMemory.resize(swapChainImages.size());
+void VulkanRenderer::createComputeScheduler()
+{
+	QueueFamilyIndices queueFamilyIndices = getQueueFamilies(mainDevice.physicalDevice);
+	uint32_t graphicsFamily = static_cast<uint32_t>(queueFamilyIndices.graphicsFamily);
 
-	// Create Uniform buffers
-	for (size_t i = 0; i < swapChainImages.size(); i++)
+	// Compute work goes to the async compute queue if there is one, otherwise it runs on the graphics queue
+	if (computeQueue != VK_NULL_HANDLE)
+	{
+		computeScheduler = ComputeScheduler(mainDevice.logicalDevice, computeQueue,
+			static_cast<uint32_t>(queueFamilyIndices.computeFamily), graphicsFamily, static_cast<uint32_t>(frames.size()));
+	}
+	else
 	{
-		createBuffer(mainDevice.physicalDevice, mainDevice.logicalDevice, vpBufferSize, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
-			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &vpUniformBuffer[i], &vpUniformBufferMemory[i]);
+		computeScheduler = ComputeScheduler(mainDevice.logicalDevice, graphicsQueue,
+			graphicsFamily, graphicsFamily, static_cast<uint32_t>(frames.size()));
+	}
+}
+
+void VulkanRenderer::createUploadManager()
+{
+	QueueFamilyIndices queueFamilyIndices = getQueueFamilies(mainDevice.physicalDevice);
+	uint32_t graphicsFamily = static_cast<uint32_t>(queueFamilyIndices.graphicsFamily);
 
-		/*createBuffer(mainDevice.physicalDevice, mainDevice.logicalDevice, modelBufferSize, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
-			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &modelDUniformBuffer[i], &modelDUniformBufferMemory[i]);*/
+	// Uploads go through the transfer queue if there is one, so copies can run alongside rendering. The graphics queue
+	// acquires what they write before any drawing submitted after them, so drawing with it still doesn't need to wait
+	if (transferQueue != VK_NULL_HANDLE)
+	{
+		uploadManager = UploadManager(&memoryAllocator, mainDevice.logicalDevice, transferQueue,
+			static_cast<uint32_t>(queueFamilyIndices.transferFamily), graphicsQueue, graphicsFamily, UPLOAD_RING_SIZE);
+	}
+	else
+	{
+		uploadManager = UploadManager(&memoryAllocator, mainDevice.logicalDevice, graphicsQueue,
+			graphicsFamily, graphicsQueue, graphicsFamily, UPLOAD_RING_SIZE);
 	}
 }
 
+void VulkanRenderer::createGeometryPool()
+{
+	// Every mesh is sub-allocated from these two buffers, rather than allocating device memory of its own
+	geometryPool = GeometryPool(&memoryAllocator, GEOMETRY_POOL_VERTICES, GEOMETRY_POOL_INDICES);
+}
+
 void VulkanRenderer::createDescriptorPool()
 {
 	// Create Uniform descriptor pool
 	// Type of descriptors + how many DESCRIPTORS, not Descriptor Sets (combined makes the pool size)
-	// ViewProjection Pool
-	VkDescriptorPoolSize vpPoolSize = {};
-	vpPoolSize.type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-	vpPoolSize.descriptorCount = static_cast<uint32_t>(vpUniformBuffer.size());
-
-	// Model Pool (DYNAMIC)
-	/*VkDescriptorPoolSize modelPoolSize = {};
-	modelPoolSize.type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
-	modelPoolSize.descriptorCount = static_cast<uint32_t>(modelDUniformBuffer.size());*/
-
-	// List of pool sizes
-	std::vector<VkDescriptorPoolSize> descriptorPoolSizes = { vpPoolSize };
+	// ViewProjection uniform (DYNAMIC, offset into the transient ring)
+	VkDescriptorPoolSize uniformPoolSize = {};
+	uniformPoolSize.type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+	uniformPoolSize.descriptorCount = MAX_FRAME_DRAWS;
+
+	// Cull shader buffers, one set per frame in flight
+	VkDescriptorPoolSize cullUniformPoolSize = {};
+	cullUniformPoolSize.type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+	cullUniformPoolSize.descriptorCount = MAX_FRAME_DRAWS;
+
+	VkDescriptorPoolSize cullStoragePoolSize = {};
+	cullStoragePoolSize.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	cullStoragePoolSize.descriptorCount = 4 * MAX_FRAME_DRAWS;
+
+	// List of pool sizes (cull buffers only when culling on the GPU)
+	std::vector<VkDescriptorPoolSize> descriptorPoolSizes = { uniformPoolSize };
+	if (gpuCullingActive())
+	{
+		descriptorPoolSizes.push_back(cullUniformPoolSize);
+		descriptorPoolSizes.push_back(cullStoragePoolSize);
+	}
 
 	// Data to create Descriptor Pool
 	VkDescriptorPoolCreateInfo poolCreateInfo = {};
 	poolCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
-	poolCreateInfo.maxSets = static_cast<uint32_t>(swapChainImages.size());					// Maximum number of Descriptor Sets that can be created from pool
+	poolCreateInfo.maxSets = gpuCullingActive() ? 2 * MAX_FRAME_DRAWS : MAX_FRAME_DRAWS;	// Maximum number of Descriptor Sets that can be created from pool
 	poolCreateInfo.poolSizeCount = static_cast<uint32_t>(descriptorPoolSizes.size());		// Amount of Pool Sizes being passed
 	poolCreateInfo.pPoolSizes = descriptorPoolSizes.data();									// Pool Sizes to create pool with
 
@@ -998,14 +1621,15 @@ void VulkanRenderer::createDescriptorPool()
 	}
 
 	// create sampler descriptor pool
-	// texture sampler pool
+	// texture sampler pool (a set per texture, or in bindless mode a single set holding the whole texture array)
 	VkDescriptorPoolSize samplerPoolSize = {};
 	samplerPoolSize.type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-	samplerPoolSize.descriptorCount = MAX_OBJECTS;
+	samplerPoolSize.descriptorCount = bindlessTexturesActive() ? bindlessTextureCapacity : MAX_OBJECTS + 1;
 
 	VkDescriptorPoolCreateInfo samplerPoolCreateInfo = {};
 	samplerPoolCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
-	samplerPoolCreateInfo.maxSets = MAX_OBJECTS;
+	samplerPoolCreateInfo.flags = bindlessTexturesActive() ? VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT : 0;
+	samplerPoolCreateInfo.maxSets = bindlessTexturesActive() ? 1 : MAX_OBJECTS + 1;		// (plus the placeholder's set)
 	samplerPoolCreateInfo.poolSizeCount = 1;
 	samplerPoolCreateInfo.pPoolSizes = &samplerPoolSize;
 
@@ -1016,304 +1640,1106 @@ void VulkanRenderer::createDescriptorPool()
 	}
 }
 
-void VulkanRenderer::createDescriptorSets()
+void VulkanRenderer::createBindlessTextureSet()
+{
+	if (!bindlessTexturesActive()) return;
+
+	// The one set every texture is written in to, bound once for all draws
+	VkDescriptorSetAllocateInfo setAllocInfo = {};
+	setAllocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	setAllocInfo.descriptorPool = samplerDescriptorPool;
+	setAllocInfo.descriptorSetCount = 1;
+	setAllocInfo.pSetLayouts = &samplerSetLayout;
+
+	VkResult result = vkAllocateDescriptorSets(mainDevice.logicalDevice, &setAllocInfo, &bindlessTextureSet);
+	if (result != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to allocate Bindless Texture Descriptor Set!");
+	}
+}
+
+void VulkanRenderer::createPlaceholderDescriptor()
 {
-	// Resize Descriptor Set list so one for every buffer
-	descriptorSets.resize(swapChainImages.size());
+	// Draws with a texture that isn't resident use this instead of the texture's own descriptor,
+	// so that one is never in use by frames in flight and can be changed when the texture is loaded back
+	if (bindlessTexturesActive())
+	{
+		// Last element of the array (textures fill it from the start)
+		writeTextureDescriptor(bindlessTextureSet, bindlessTextureCapacity - 1, placeholderImageView);
+		return;
+	}
+
+	VkDescriptorSetAllocateInfo setAllocInfo = {};
+	setAllocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	setAllocInfo.descriptorPool = samplerDescriptorPool;
+	setAllocInfo.descriptorSetCount = 1;
+	setAllocInfo.pSetLayouts = &samplerSetLayout;
+
+	VkResult result = vkAllocateDescriptorSets(mainDevice.logicalDevice, &setAllocInfo, &placeholderDescriptorSet);
+	if (result != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to allocate Placeholder Texture Descriptor Set!");
+	}
+
+	writeTextureDescriptor(placeholderDescriptorSet, 0, placeholderImageView);
+}
 
-	std::vector<VkDescriptorSetLayout> setLayouts(swapChainImages.size(), descriptorSetLayout);
+void VulkanRenderer::createDescriptorSets()
+{
+	// One uniform set per frame, so a frame can re-point its set while other frames are still using theirs
+	std::vector<VkDescriptorSetLayout> setLayouts(frames.size(), descriptorSetLayout);
 
 	// Descriptor Set Allocation Info
 	VkDescriptorSetAllocateInfo setAllocInfo = {};
 	setAllocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
 	setAllocInfo.descriptorPool = descriptorPool;									// Pool to allocate Descriptor Set from
-	setAllocInfo.descriptorSetCount = static_cast<uint32_t>(swapChainImages.size());// Number of sets to allocate
+	setAllocInfo.descriptorSetCount = static_cast<uint32_t>(frames.size());		// Number of sets to allocate
 	setAllocInfo.pSetLayouts = setLayouts.data();									// Layouts to use to allocate sets (1:1 relationship)
 
-	// Allocate descriptor sets (multiple)
-	VkResult result = vkAllocateDescriptorSets(mainDevice.logicalDevice, &setAllocInfo, descriptorSets.data());
+	// Allocate descriptor sets
+	std::vector<VkDescriptorSet> sets(frames.size());
+	VkResult result = vkAllocateDescriptorSets(mainDevice.logicalDevice, &setAllocInfo, sets.data());
 	if (result != VK_SUCCESS)
 	{
 		throw std::runtime_error("Failed to allocate Descriptor Sets!");
 	}
 
-	// Update all of descriptor set buffer bindings
-	for (size_t i = 0; i < swapChainImages.size(); i++)
+	// Sets are written the first time each frame places its uniforms in the ring
+	for (size_t i = 0; i < frames.size(); i++)
 	{
-		// VIEW PROJECTION DESCRIPTOR
-		// Buffer info and data offset info
-		VkDescriptorBufferInfo vpBufferInfo = {};
-		vpBufferInfo.buffer = vpUniformBuffer[i];		// Buffer to get data from
-		vpBufferInfo.offset = 0;						// Position of start of data
-		vpBufferInfo.range = sizeof(UboViewProjection);				// Size of data
+		frames[i].uniformDescriptorSet = sets[i];
+		frames[i].vpUniformBuffer = VK_NULL_HANDLE;
+	}
 
-		// Data about connection between binding and buffer
-		VkWriteDescriptorSet vpSetWrite = {};
-		vpSetWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-		vpSetWrite.dstSet = descriptorSets[i];								// Descriptor Set to update
-		vpSetWrite.dstBinding = 0;											// Binding to update (matches with binding on layout/shader)
-		vpSetWrite.dstArrayElement = 0;									// Index in array to update
-		vpSetWrite.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;		// Type of descriptor
-		vpSetWrite.descriptorCount = 1;									// Amount to update
-		vpSetWrite.pBufferInfo = &vpBufferInfo;							// Information about buffer data to bind
+	if (!gpuCullingActive()) return;
 
-		// MODEL DESCRIPTOR
-		// Model Buffer Binding Info
-		/*VkDescriptorBufferInfo modelBufferInfo = {};
-		modelBufferInfo.buffer = modelDUniformBuffer[i];
-		modelBufferInfo.offset = 0;
-		modelBufferInfo.range = modelUniformAlignment;
+	// One cull set for every frame in flight, written when culling first uses it
+	std::vector<VkDescriptorSetLayout> cullSetLayouts(frames.size(), cullSetLayout);
+	std::vector<VkDescriptorSet> cullDescriptorSets(frames.size());
 
-		VkWriteDescriptorSet modelSetWrite = {};
-		modelSetWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-		modelSetWrite.dstSet = descriptorSets[i];
-		modelSetWrite.dstBinding = 1;
-		modelSetWrite.dstArrayElement = 0;
-		modelSetWrite.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
-		modelSetWrite.descriptorCount = 1;
-		modelSetWrite.pBufferInfo = &modelBufferInfo;*/
+	setAllocInfo.descriptorSetCount = static_cast<uint32_t>(cullSetLayouts.size());
+	setAllocInfo.pSetLayouts = cullSetLayouts.data();
 
-		// List of Descriptor Set Writes
-		std::vector<VkWriteDescriptorSet> setWrites = { vpSetWrite };
+	result = vkAllocateDescriptorSets(mainDevice.logicalDevice, &setAllocInfo, cullDescriptorSets.data());
+	if (result != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to allocate (cull) Descriptor Sets!");
+	}
 
-		// Update the descriptor sets with new buffer/binding info
-		vkUpdateDescriptorSets(mainDevice.logicalDevice, static_cast<uint32_t>(setWrites.size()), setWrites.data(),
-			0, nullptr);
+	for (size_t i = 0; i < frames.size(); i++)
+	{
+		frames[i].cullDescriptorSet = cullDescriptorSets[i];
+		frames[i].cullBufferInfos = {};
 	}
 }
 
-void VulkanRenderer::updateUniformBuffers(uint32_t imageIndex)
+void VulkanRenderer::updateUniformDescriptorSet(FrameResources & frame)
 {
-	// Copy VP data
-	void* data;
-	vkMapMemory(mainDevice.logicalDevice, vpUniformBufferMemory[imageIndex], 0, sizeof(UboViewProjection), 0, &data);
-	memcpy(data, &uboViewProjection, sizeof(UboViewProjection));
-	vkUnmapMemory(mainDevice.logicalDevice, vpUniformBufferMemory[imageIndex]);
+	// VIEW PROJECTION DESCRIPTOR
+	// Buffer info and data offset info (where the data is in the ring is given by a dynamic offset when binding)
+	VkDescriptorBufferInfo vpBufferInfo = {};
+	vpBufferInfo.buffer = frame.vpUniformBuffer;		// Buffer to get data from
+	vpBufferInfo.offset = 0;							// Position of start of data
+	vpBufferInfo.range = sizeof(UboViewProjection);		// Size of data
+
+	// Data about connection between binding and buffer
+	VkWriteDescriptorSet vpSetWrite = {};
+	vpSetWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	vpSetWrite.dstSet = frame.uniformDescriptorSet;							// Descriptor Set to update
+	vpSetWrite.dstBinding = 0;												// Binding to update (matches with binding on layout/shader)
+	vpSetWrite.dstArrayElement = 0;											// Index in array to update
+	vpSetWrite.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;	// Type of descriptor
+	vpSetWrite.descriptorCount = 1;											// Amount to update
+	vpSetWrite.pBufferInfo = &vpBufferInfo;									// Information about buffer data to bind
+
+	// List of Descriptor Set Writes
+	std::vector<VkWriteDescriptorSet> setWrites = { vpSetWrite };
+
+	// Update the descriptor sets with new buffer/binding info
+	vkUpdateDescriptorSets(mainDevice.logicalDevice, static_cast<uint32_t>(setWrites.size()), setWrites.data(),
+		0, nullptr);
+}
+
+void VulkanRenderer::createFrameResources()
+{
+	// One set of resources for each frame in flight
+	frames.resize(framesInFlight);
+	currentFrame = 0;
+
+	createCommandBuffers();
+	createComputeScheduler();
+	createTransientRing();
+	createDescriptorSets();
+	createSynchronisation();
+}
 
-	// Copy Model data
-	/*for (size_t i = 0; i < meshList.size(); i++)
+void VulkanRenderer::destroyCommandBuffers()
+{
+	for (auto &frame : frames)
 	{
-		UboModel * thisModel = (UboModel *)((uint64_t)modelTransferSpace + (i * modelUniformAlignment));
-		*thisModel = meshList[i].getModel();
-	}
+		for (size_t i = 0; i < frame.secondaryCommandBuffers.size(); i++)
+		{
+			for (size_t w = 0; w < frame.secondaryCommandBuffers[i].size(); w++)
+			{
+				vkFreeCommandBuffers(mainDevice.logicalDevice, workerCommandPools[w], 1, &frame.secondaryCommandBuffers[i][w]);
+			}
+		}
+		frame.secondaryCommandBuffers.clear();
 
-	// Map the list of model data
-	vkMapMemory(mainDevice.logicalDevice, modelDUniformBufferMemory[imageIndex], 0, modelUniformAlignment * meshList.size(), 0, &data);
-	memcpy(data, modelTransferSpace, modelUniformAlignment * meshList.size());
-	vkUnmapMemory(mainDevice.logicalDevice, modelDUniformBufferMemory[imageIndex]);*/
+		vkFreeCommandBuffers(mainDevice.logicalDevice, graphicsCommandPool,
+			static_cast<uint32_t>(frame.commandBuffers.size()), frame.commandBuffers.data());
+		frame.commandBuffers.clear();
+		frame.commandBufferDirty.clear();
+	}
 }
 
-void VulkanRenderer::recordCommands(uint32_t currentImage)
+void VulkanRenderer::destroyFrameResources()
 {
-	// Information about how to begin each command buffer
-	VkCommandBufferBeginInfo bufferBeginInfo = {};
-	bufferBeginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	destroyCommandBuffers();
 
-	// Information about how to begin a render pass (only needed for graphical applications)
-	VkRenderPassBeginInfo renderPassBeginInfo = {};
-	renderPassBeginInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-	renderPassBeginInfo.renderPass = renderPass;							// Render Pass to begin
-	renderPassBeginInfo.renderArea.offset = { 0, 0 };						// Start point of render pass in pixels
-	renderPassBeginInfo.renderArea.extent = swapChainExtent;				// Size of region to run render pass on (starting at offset)
+	for (auto &frame : frames)
+	{
+		vkDestroySemaphore(mainDevice.logicalDevice, frame.renderFinished, nullptr);
+		vkDestroySemaphore(mainDevice.logicalDevice, frame.imageAvailable, nullptr);
+	}
+	frames.clear();
 
-	std::array<VkClearValue, 2> clearValues = {};
-	clearValues[0].color = { 0.6f, 0.65f, 0.4f, 1.0f };
-	clearValues[1].depthStencil.depth = 1.0f;
+	computeScheduler.destroyComputeScheduler();
+	transientRing.destroyTransientRing();
 
-	renderPassBeginInfo.pClearValues = clearValues.data();					// List of clear values
-	renderPassBeginInfo.clearValueCount = static_cast<uint32_t>(clearValues.size());
+	// Uniform descriptor sets refer to the ring buffers, and are the only sets allocated from this pool
+	vkResetDescriptorPool(mainDevice.logicalDevice, descriptorPool, 0);
+}
 
-	renderPassBeginInfo.framebuffer = swapChainFramebuffers[currentImage];
+void VulkanRenderer::updateProjection()
+{
+	uboViewProjection.projection = glm::perspective(glm::radians(45.0f), (float)swapChainExtent.width / (float)swapChainExtent.height, 0.1f, 100.0f);
 
-	// Start recording commands to command buffer!
-	VkResult result = vkBeginCommandBuffer(commandBuffers[currentImage], &bufferBeginInfo);
-	if (result != VK_SUCCESS)
+	// Vulkan inverts the Y axis compared to OpenGL
+	uboViewProjection.projection[1][1] *= -1;
+}
+
+void VulkanRenderer::updateRenderList()
+{
+	// Copy out everything drawing needs from each mesh, so per-frame work doesn't go through the models
+	renderList = {};
+	for (size_t i = 0; i < modelList.size(); i++)
 	{
-		throw std::runtime_error("Failed to start recording a Command Buffer!");
+		renderList.modelFirstMesh.push_back(static_cast<uint32_t>(renderList.indexCount.size()));
+		for (size_t k = 0; k < modelList[i].getMeshCount(); k++)
+		{
+			Mesh * mesh = modelList[i].getMesh(k);
+			renderList.firstIndex.push_back(mesh->getFirstIndex());
+			renderList.vertexOffset.push_back(mesh->getVertexOffset());
+			renderList.indexCount.push_back(static_cast<uint32_t>(mesh->getIndexCount()));
+			renderList.texId.push_back(mesh->getTexId());
+			renderList.transformIndex.push_back(static_cast<uint32_t>(i));
+			renderList.boundingSphere.push_back(mesh->getBoundingSphere());
+			renderList.boundingBoxMin.push_back(mesh->getBoundingBoxMin());
+			renderList.boundingBoxMax.push_back(mesh->getBoundingBoxMax());
+		}
 	}
+	renderList.modelFirstMesh.push_back(static_cast<uint32_t>(renderList.indexCount.size()));
 
-	// Begin Render Pass
-	vkCmdBeginRenderPass(commandBuffers[currentImage], &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
-
-	// Bind Pipeline to be used in render pass
-	vkCmdBindPipeline(commandBuffers[currentImage], VK_PIPELINE_BIND_POINT_GRAPHICS, graphicsPipeline);
+	renderListDirty = false;
+}
 
-	for (size_t j = 0; j < modelList.size(); j++)
-	{
-		MeshModel thisModel = modelList[j];
-		glm::mat4 model = modelList[j].getModel();
-		vkCmdPushConstants(
-			commandBuffers[currentImage],
-			pipelineLayout,
-			VK_SHADER_STAGE_VERTEX_BIT,		// Stage to push constants to
-			0,								// Offset of push constants to update
-			sizeof(Model),					// Size of data being pushed
-			&model);			// Actual data being pushed (can be array)
+void VulkanRenderer::updateUniformBuffers(uint32_t frameIndex)
+{
+	FrameResources &frame = frames[frameIndex];
 
-		for (size_t k = 0; k < thisModel.getMeshCount(); k++)
-		{
+	// GPU has finished with this frame's previous data, so its part of the ring can be reused
+	// Buffers outgrown by the ring are freed once the frames using them have completed
+	transientRing.beginFrame(frameIndex, frameNumber, getCompletedFrame());
 
-			VkBuffer vertexBuffers[] = { thisModel.getMesh(k)->getVertexBuffer() };					// Buffers to bind
-			VkDeviceSize offsets[] = { 0 };												// Offsets into buffers being bound
-			vkCmdBindVertexBuffers(commandBuffers[currentImage], 0, 1, vertexBuffers, offsets);	// Command to bind vertex buffer before drawing with them
+	// Copy VP data
+	TransientAllocation vpAllocation = transientRing.allocate(sizeof(UboViewProjection));
+	memcpy(vpAllocation.data, &uboViewProjection, sizeof(UboViewProjection));
 
-			// Bind mesh index buffer, with 0 offset and using the uint32 type
-			vkCmdBindIndexBuffer(commandBuffers[currentImage], thisModel.getMesh(k)->getIndexBuffer(), 0, VK_INDEX_TYPE_UINT32);
+	if (renderListDirty)
+	{
+		updateRenderList();
+	}
 
-			// Dynamic Offset Amount
-			// uint32_t dynamicOffset = static_cast<uint32_t>(modelUniformAlignment) * j;
+	// Combine model transform with each instance transform, so the shader only needs one matrix
+	instanceTransforms.clear();
+	for (size_t i = 0; i < modelList.size(); i++)
+	{
+		glm::mat4 modelTransform = modelList[i].getModel();
+		for (const auto &instance : modelList[i].getInstances())
+		{
+			instanceTransforms.push_back(modelTransform * instance);
+		}
+	}
 
-			// "Push" constants to given shader stage directly (no buffer)
+	// The ring has grown into a new buffer, point this frame's set at it
+	// (safe to update, this frame's previous commands have finished)
+	if (vpAllocation.buffer != frame.vpUniformBuffer)
+	{
+		frame.vpUniformBuffer = vpAllocation.buffer;
+		updateUniformDescriptorSet(frame);
+		std::fill(frame.commandBufferDirty.begin(), frame.commandBufferDirty.end(), true);
+	}
 
+	// Ranges are recorded into direct draws, so note the previous ones to see if they change
+	previousInstanceRanges.swap(meshInstanceRanges);
+	meshInstanceRanges.clear();
 
-			std::array<VkDescriptorSet, 2> descriptorSetGroup = { descriptorSets[currentImage],
-				samplerDescriptorSets[thisModel.getMesh(k)->getTexId()] };
+	// GPU culling (when active) works on every instance, so the CPU doesn't cull as well
+	bool culling = cpuCulling && !gpuCullingActive();
 
-			// Bind Descriptor Sets
-			vkCmdBindDescriptorSets(commandBuffers[currentImage], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout,
-				0, static_cast<uint32_t>(descriptorSetGroup.size()), descriptorSetGroup.data(), 0, nullptr);
+	size_t partialInstanceCount = 0;
+	if (culling)
+	{
+		// Test bounding box of every instance of every mesh against the frustum
+		frustumCuller.setFrustum(uboViewProjection.projection * uboViewProjection.view);
+		frustumCuller.clearBoxes();
+		size_t modelFirstInstance = 0;
+		for (size_t i = 0; i < modelList.size(); i++)
+		{
+			for (uint32_t m = renderList.modelFirstMesh[i]; m < renderList.modelFirstMesh[i + 1]; m++)
+			{
+				for (size_t instance = 0; instance < modelList[i].getInstanceCount(); instance++)
+				{
+					frustumCuller.addBox(instanceTransforms[modelFirstInstance + instance], renderList.boundingBoxMin[m], renderList.boundingBoxMax[m]);
+				}
+			}
+			modelFirstInstance += modelList[i].getInstanceCount();
+		}
+		frustumCuller.cull(instanceVisibility);
 
-			// Execute pipeline
-			vkCmdDrawIndexed(commandBuffers[currentImage], thisModel.getMesh(k)->getIndexCount(), 1, 0, 0, 0);
+		// Count visible instances of each mesh, only meshes with some (but not all) instances visible need their own copy
+		meshVisibleCounts.clear();
+		size_t box = 0;
+		for (size_t i = 0; i < modelList.size(); i++)
+		{
+			for (uint32_t m = renderList.modelFirstMesh[i]; m < renderList.modelFirstMesh[i + 1]; m++)
+			{
+				uint32_t visibleCount = 0;
+				for (size_t instance = 0; instance < modelList[i].getInstanceCount(); instance++, box++)
+				{
+					visibleCount += instanceVisibility[box] ? 1 : 0;
+				}
+				meshVisibleCounts.push_back(visibleCount);
+				if (visibleCount != modelList[i].getInstanceCount())
+				{
+					partialInstanceCount += visibleCount;
+				}
+			}
 		}
 	}
 
-	// End Render Pass
-	vkCmdEndRenderPass(commandBuffers[currentImage]);
-
-	// Stop recording to command buffer
-	result = vkEndCommandBuffer(commandBuffers[currentImage]);
-	if (result != VK_SUCCESS)
+	// Copy Instance data, instances of each model are contiguous and models are in model list order
+	// Each transform is written once for its model, shared by all of the model's meshes
+	TransientAllocation instanceAllocation = transientRing.allocate(sizeof(glm::mat4) * (instanceTransforms.size() + partialInstanceCount));
+	if (!instanceTransforms.empty())
 	{
-		throw std::runtime_error("Failed to stop recording a Command Buffer!");
+		memcpy(instanceAllocation.data, instanceTransforms.data(), sizeof(glm::mat4) * instanceTransforms.size());
 	}
 
-}
+	// Partly visible meshes get a list of just their visible instances, after every model's instances
+	glm::mat4 * partialData = static_cast<glm::mat4 *>(instanceAllocation.data) + instanceTransforms.size();
+	uint32_t partialFirstInstance = static_cast<uint32_t>(instanceTransforms.size());
+	uint32_t modelFirstInstance = 0;
+	size_t box = 0;
+	for (size_t i = 0; i < modelList.size(); i++)
+	{
+		uint32_t modelInstanceCount = static_cast<uint32_t>(modelList[i].getInstanceCount());
+		for (uint32_t m = renderList.modelFirstMesh[i]; m < renderList.modelFirstMesh[i + 1]; m++, box += modelInstanceCount)
+		{
+			InstanceRange range = { modelFirstInstance, modelInstanceCount };
+			if (culling && meshVisibleCounts[m] != modelInstanceCount)
+			{
+				range = { partialFirstInstance, meshVisibleCounts[m] };
+				for (uint32_t instance = 0; instance < modelInstanceCount; instance++)
+				{
+					if (instanceVisibility[box + instance])
+					{
+						*partialData++ = instanceTransforms[modelFirstInstance + instance];
+					}
+				}
+				partialFirstInstance += range.instanceCount;
+			}
+			meshInstanceRanges.push_back(range);
+		}
+		modelFirstInstance += modelInstanceCount;
+	}
 
-void VulkanRenderer::getPhysicalDevice()
-{
-	// Enumerate Physical devices the vkInstance can access
-	uint32_t deviceCount = 0;
-	vkEnumeratePhysicalDevices(instance, &deviceCount, nullptr);
+	// Direct draws record the instances they draw, so must be recorded again if they change (indirect draws read them each frame)
+	bool rangesChanged = previousInstanceRanges.size() != meshInstanceRanges.size()
+		|| !std::equal(previousInstanceRanges.begin(), previousInstanceRanges.end(), meshInstanceRanges.begin(),
+			[](const InstanceRange &a, const InstanceRange &b) { return a.firstInstance == b.firstInstance && a.instanceCount == b.instanceCount; });
+	if (rangesChanged && !indirectDrawingActive())
+	{
+		invalidateCommandBuffers();
+	}
 
-	// If no devices available, then none support Vulkan!
-	if (deviceCount == 0)
+	// Offsets are recorded into command buffers, so re-record them if the data has moved
+	// (allocations are made in the same order every frame, so this only happens if that order changes or the ring grows)
+	uint32_t vpOffset = static_cast<uint32_t>(vpAllocation.offset);
+	if (vpOffset != frame.vpUniformOffset || instanceAllocation.buffer != frame.instanceBuffer || instanceAllocation.offset != frame.instanceOffset)
 	{
-		throw std::runtime_error("Can't find GPUs that support Vulkan Instance!");
+		frame.vpUniformOffset = vpOffset;
+		frame.instanceBuffer = instanceAllocation.buffer;
+		frame.instanceOffset = instanceAllocation.offset;
+		std::fill(frame.commandBufferDirty.begin(), frame.commandBufferDirty.end(), true);
 	}
 
-	// Get list of Physical Devices
-	std::vector<VkPhysicalDevice> deviceList(deviceCount);
-	vkEnumeratePhysicalDevices(instance, &deviceCount, deviceList.data());
+	// Instance data must be in place before indirect draw commands
+	// (firstInstance of each command is the start of its mesh's instances, so the GPU can find them)
+	if (indirectDrawingActive())
+	{
+		updateIndirectCommands(frameIndex);
+	}
+}
 
-	for (const auto& device : deviceList)
+void VulkanRenderer::sortDraws()
+{
+	// Key every mesh by the state it needs, so meshes sharing state end up next to each other and binds can be skipped
+	// Within the same state, nearer meshes are drawn first so more hidden fragments fail the depth test
+	// Indirect commands are sorted every frame, but cached direct draws are only sorted when they are recorded,
+	// so their depth order would go stale as the camera moves: leave depth out of their keys
+	bool depthSorting = indirectDrawingActive() || !commandBufferCaching;
+
+	drawList.clear();
+	glm::mat4 modelView;
+	uint32_t modelViewIndex = UINT32_MAX;
+	for (uint32_t m = 0; m < renderList.indexCount.size(); m++)
 	{
-		if (checkDeviceSuitable(device))
+		// Meshes of a model are next to each other, so the model's view transform is only worked out once
+		if (renderList.transformIndex[m] != modelViewIndex)
 		{
-			mainDevice.physicalDevice = device;
-			break;
+			modelViewIndex = renderList.transformIndex[m];
+			modelView = uboViewProjection.view * modelList[modelViewIndex].getModel();
 		}
+
+		// Camera looks down -z, so distance in front of it is -z of the mesh's centre in view space
+		glm::vec4 centre = modelView * glm::vec4(glm::vec3(renderList.boundingSphere[m]), 1.0f);
+		float depth = depthSorting ? -centre.z : 0.0f;
+
+		// Only one graphics pipeline and one geometry pool so far, so those parts of the key are always 0
+		uint64_t key = DrawList::makeKey(0, static_cast<uint32_t>(renderList.texId[m]), 0, depth);
+		drawList.add(key, m);
 	}
 
-	// Get properties of our new device
-	VkPhysicalDeviceProperties deviceProperties;
-	vkGetPhysicalDeviceProperties(mainDevice.physicalDevice, &deviceProperties);
+	drawList.sort();
+}
 
-	//minUniformBufferOffset = deviceProperties.limits.minUniformBufferOffsetAlignment;
+bool VulkanRenderer::indirectDrawingActive()
+{
+	// Instance data is found through firstInstance, so indirect draws need it to be supported
+	return indirectDrawing && optionalFeatures.drawIndirectFirstInstance;
 }
 
-void VulkanRenderer::allocateDynamicBufferTransferSpace()
+bool VulkanRenderer::bindlessTexturesActive()
 {
-	// Calculate alignment of model data
-	/*modelUniformAlignment = (sizeof(UboModel) + minUniformBufferOffset - 1)
-							& ~(minUniformBufferOffset - 1);
+	return bindlessTextures && optionalFeatures.descriptorIndexing;
+}
 
-	// Create space in memory to hold dynamic buffer that is aligned to our required alignment and holds MAX_OBJECTS
-	modelTransferSpace = (UboModel *)_aligned_malloc(modelUniformAlignment * MAX_OBJECTS, modelUniformAlignment);*/
+bool VulkanRenderer::gpuCullingActive()
+{
+	// Culling writes the indirect commands, so only takes effect when drawing indirectly
+	return gpuCulling && indirectDrawingActive();
 }
 
-bool VulkanRenderer::checkInstanceExtensionSupport(std::vector<const char*>* checkExtensions)
+void VulkanRenderer::updateIndirectCommands(uint32_t frameIndex)
 {
-	// Need to get number of extensions to create array of correct size to hold extensions
-	uint32_t extensionCount = 0;
-	vkEnumerateInstanceExtensionProperties(nullptr, &extensionCount, nullptr);
+	FrameResources &frame = frames[frameIndex];
 
-	// Create a list of VkExtensionProperties using count
-	std::vector<VkExtensionProperties> extensions(extensionCount);
-	vkEnumerateInstanceExtensionProperties(nullptr, &extensionCount, extensions.data());
+	// When culling on the GPU, every instance of every mesh is a separate draw that can be culled
+	bool culling = gpuCullingActive();
 
-	// Check if given extensions are in list of available extensions
-	for (const auto& checkExtension : *checkExtensions)
+	// Sort meshes by state, so every mesh using a texture ends up in the same batch
+	sortDraws();
+
+	// Group meshes in to batches, a batch ends when the texture that must be bound changes (all meshes share the geometry buffers)
+	drawBatches.clear();
+	size_t drawCount = 0;
+	for (size_t d = 0; d < drawList.size(); d++)
 	{
-		bool hasExtension = false;
-		for (const auto& extension : extensions)
-		{
-			if (strcmp(checkExtension, extension.extensionName) == 0)
-			{
-				hasExtension = true;
-				break;
-			}
-		}
+		uint32_t m = drawList[d].meshIndex;
+		uint32_t meshDrawCount = culling ? meshInstanceRanges[m].instanceCount : 1;
 
-		if (!hasExtension)
+		if (drawBatches.empty() || drawBatches.back().texId != renderList.texId[m])
 		{
-			return false;
+			DrawBatch batch = {};
+			batch.texId = renderList.texId[m];
+			batch.firstDraw = static_cast<uint32_t>(drawCount);
+			batch.drawCount = 0;
+			drawBatches.push_back(batch);
 		}
+		drawBatches.back().drawCount += meshDrawCount;
+		drawCount += meshDrawCount;
 	}
 
-	return true;
-}
-
-bool VulkanRenderer::checkDeviceExtensionSupport(VkPhysicalDevice device)
-{
-	// Get device extension count
-	uint32_t extensionCount = 0;
-	vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, nullptr);
-
-	// If no extensions found, return failure
-	if (extensionCount == 0)
-	{
-		return false;
-	}
-
-	// Populate list of extensions
-	std::vector<VkExtensionProperties> extensions(extensionCount);
-	vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, extensions.data());
+	// Space for draw commands, one per draw in the same order as the batches (written by the cull shader when culling)
+	TransientAllocation commandAllocation = transientRing.allocate(sizeof(VkDrawIndexedIndirectCommand) * drawCount);
 
-	// Check for extension
-	for (const auto& deviceExtension : deviceExtensions)
+	TransientAllocation candidateAllocation = {};
+	if (culling)
 	{
-		bool hasExtension = false;
-		for (const auto& extension : extensions)
+		// Describe each draw for the cull shader
+		candidateAllocation = transientRing.allocate(sizeof(DrawCandidate) * drawCount);
+		DrawCandidate * candidate = static_cast<DrawCandidate *>(candidateAllocation.data);
+		uint32_t candidateIndex = 0;
+		uint32_t batch = 0;
+		for (size_t d = 0; d < drawList.size(); d++)
 		{
-			if (strcmp(deviceExtension, extension.extensionName) == 0)
+			uint32_t m = drawList[d].meshIndex;
+			const InstanceRange &range = meshInstanceRanges[m];
+			for (uint32_t instance = 0; instance < range.instanceCount; instance++, candidate++, candidateIndex++)
 			{
-				hasExtension = true;
-				break;
+				// Move on to the next batch once this one's draws are all described
+				while (candidateIndex >= drawBatches[batch].firstDraw + drawBatches[batch].drawCount)
+				{
+					batch++;
+				}
+
+				candidate->boundingSphere = renderList.boundingSphere[m];
+				candidate->indexCount = renderList.indexCount[m];
+				candidate->firstIndex = renderList.firstIndex[m];
+				candidate->vertexOffset = renderList.vertexOffset[m];
+				candidate->instance = range.firstInstance + instance;
+				candidate->batch = batch;
+				candidate->batchFirstDraw = drawBatches[batch].firstDraw;
 			}
 		}
-
-		if (!hasExtension)
+	}
+	else
+	{
+		// Write one draw command per mesh in sorted order, drawing the instances in its range (none if all were culled on the CPU)
+		VkDrawIndexedIndirectCommand * command = static_cast<VkDrawIndexedIndirectCommand *>(commandAllocation.data);
+		for (size_t d = 0; d < drawList.size(); d++, command++)
 		{
-			return false;
+			uint32_t m = drawList[d].meshIndex;
+			command->indexCount = renderList.indexCount[m];
+			command->instanceCount = meshInstanceRanges[m].instanceCount;
+			command->firstIndex = renderList.firstIndex[m];
+			command->vertexOffset = renderList.vertexOffset[m];
+			command->firstInstance = meshInstanceRanges[m].firstInstance;
 		}
 	}
 
-	return true;
+	// Write the number of draws in each batch (read by the GPU when drawing with counts)
+	// When culling, counts start at 0 and the cull shader adds each visible draw
+	TransientAllocation countAllocation = transientRing.allocate(sizeof(uint32_t) * drawBatches.size());
+	uint32_t * batchDrawCount = static_cast<uint32_t *>(countAllocation.data);
+	for (const auto &batch : drawBatches)
+	{
+		*batchDrawCount++ = culling ? 0 : batch.drawCount;
+	}
+
+	if (commandAllocation.buffer != frame.indirectBuffer || commandAllocation.offset != frame.indirectOffset
+		|| countAllocation.buffer != frame.indirectCountBuffer || countAllocation.offset != frame.indirectCountOffset)
+	{
+		frame.indirectBuffer = commandAllocation.buffer;
+		frame.indirectOffset = commandAllocation.offset;
+		frame.indirectCountBuffer = countAllocation.buffer;
+		frame.indirectCountOffset = countAllocation.offset;
+		std::fill(frame.commandBufferDirty.begin(), frame.commandBufferDirty.end(), true);
+	}
+
+	cullCandidateCount = culling ? static_cast<uint32_t>(drawCount) : 0;
+	if (cullCandidateCount == 0) return;
+
+	// Frustum to cull against, and how to output the draws
+	TransientAllocation paramsAllocation = transientRing.allocate(sizeof(CullParams));
+	CullParams * params = static_cast<CullParams *>(paramsAllocation.data);
+	extractFrustumPlanes(uboViewProjection.projection * uboViewProjection.view, params->frustumPlanes);
+	params->candidateCount = cullCandidateCount;
+	params->compact = optionalFeatures.drawIndirectCount ? 1 : 0;
+
+	// Point the frame's cull set at this frame's data
+	std::array<VkDescriptorBufferInfo, 5> bufferInfos = {};
+	bufferInfos[0] = { paramsAllocation.buffer, paramsAllocation.offset, sizeof(CullParams) };
+	bufferInfos[1] = { candidateAllocation.buffer, candidateAllocation.offset, sizeof(DrawCandidate) * drawCount };
+	bufferInfos[2] = { frame.instanceBuffer, frame.instanceOffset, sizeof(glm::mat4) * instanceTransforms.size() };
+	bufferInfos[3] = { commandAllocation.buffer, commandAllocation.offset, sizeof(VkDrawIndexedIndirectCommand) * drawCount };
+	bufferInfos[4] = { countAllocation.buffer, countAllocation.offset, sizeof(uint32_t) * drawBatches.size() };
+	updateCullDescriptorSet(frame, bufferInfos);
 }
 
-bool VulkanRenderer::checkValidationLayerSupport()
+void VulkanRenderer::updateCullDescriptorSet(FrameResources & frame, const std::array<VkDescriptorBufferInfo, 5> & bufferInfos)
 {
-	uint32_t layerCount;
-	vkEnumerateInstanceLayerProperties(&layerCount, nullptr);
+	// Nothing to do if data is where it was last frame (usual case, allocations are made in the same order every frame)
+	bool changed = false;
+	for (size_t i = 0; i < bufferInfos.size(); i++)
+	{
+		changed |= bufferInfos[i].buffer != frame.cullBufferInfos[i].buffer
+			|| bufferInfos[i].offset != frame.cullBufferInfos[i].offset
+			|| bufferInfos[i].range != frame.cullBufferInfos[i].range;
+	}
+	if (!changed) return;
 
-	std::vector<VkLayerProperties> availableLayers(layerCount);
-	vkEnumerateInstanceLayerProperties(&layerCount, availableLayers.data());
+	std::array<VkWriteDescriptorSet, 5> setWrites = {};
+	for (uint32_t i = 0; i < setWrites.size(); i++)
+	{
+		setWrites[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		setWrites[i].dstSet = frame.cullDescriptorSet;
+		setWrites[i].dstBinding = i;
+		setWrites[i].dstArrayElement = 0;
+		setWrites[i].descriptorType = i == 0 ? VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER : VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		setWrites[i].descriptorCount = 1;
+		setWrites[i].pBufferInfo = &bufferInfos[i];
+	}
+
+	// Frame's previous work has finished, but updating the set invalidates commands recorded with it
+	vkUpdateDescriptorSets(mainDevice.logicalDevice, static_cast<uint32_t>(setWrites.size()), setWrites.data(), 0, nullptr);
+	frame.cullBufferInfos = bufferInfos;
+	std::fill(frame.commandBufferDirty.begin(), frame.commandBufferDirty.end(), true);
+}
 
-	for (const char* layerName : validationLayers) {
-		bool layerFound = false;
+void VulkanRenderer::recordCommands(uint32_t currentImage)
+{
+	// Information about how to begin each command buffer
+	VkCommandBufferBeginInfo bufferBeginInfo = {};
+	bufferBeginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
 
-		for (const auto& layerProperties : availableLayers) {
+	// Information about how to begin a render pass (only needed for graphical applications)
+	VkRenderPassBeginInfo renderPassBeginInfo = {};
+	renderPassBeginInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+	renderPassBeginInfo.renderPass = renderPass;							// Render Pass to begin
+	renderPassBeginInfo.renderArea.offset = { 0, 0 };						// Start point of render pass in pixels
+	renderPassBeginInfo.renderArea.extent = swapChainExtent;				// Size of region to run render pass on (starting at offset)
+
+	std::array<VkClearValue, 2> clearValues = {};
+	clearValues[0].color = { 0.6f, 0.65f, 0.4f, 1.0f };
+	clearValues[1].depthStencil.depth = 1.0f;
+
+	renderPassBeginInfo.pClearValues = clearValues.data();					// List of clear values
+	renderPassBeginInfo.clearValueCount = static_cast<uint32_t>(clearValues.size());
+
+	renderPassBeginInfo.framebuffer = swapChainFramebuffers[currentImage];
+
+	// Commands are recorded for the current frame in flight
+	FrameResources &frame = frames[currentFrame];
+
+	// Start recording commands to command buffer!
+	VkResult result = vkBeginCommandBuffer(frame.commandBuffers[currentImage], &bufferBeginInfo);
+	if (result != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to start recording a Command Buffer!");
+	}
+
+	// Direct draws are recorded in state sorted order (indirect commands are sorted when they are written)
+	if (!indirectDrawingActive())
+	{
+		sortDraws();
+	}
+
+	if (indirectDrawingActive())
+	{
+		// Cull draws in a compute pass, before the render pass that draws them (unless culled on the async compute queue)
+		if (cullCandidateCount > 0 && !computeScheduler.isAsync())
+		{
+			recordCulling(frame.commandBuffers[currentImage], frame);
+		}
+
+		// Begin Render Pass, the whole scene is a handful of indirect draws so there is nothing to split between workers
+		vkCmdBeginRenderPass(frame.commandBuffers[currentImage], &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+
+		vkCmdBindPipeline(frame.commandBuffers[currentImage], VK_PIPELINE_BIND_POINT_GRAPHICS, graphicsPipeline);
+		recordViewportAndScissor(frame.commandBuffers[currentImage]);
+
+		drawStats = recordIndirectDraws(frame.commandBuffers[currentImage], frame);
+	}
+	else if (parallelRecording && drawList.size() > 1)
+	{
+		// Begin Render Pass, contents will come from secondary command buffers recorded by workers
+		vkCmdBeginRenderPass(frame.commandBuffers[currentImage], &renderPassBeginInfo, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+
+		// Give each worker an equal sized range of the sorted draws (so each worker's share still needs few binds)
+		size_t totalDrawCount = drawList.size();
+		size_t workerCount = std::min(workerCommandPools.size(), totalDrawCount);
+		size_t drawsPerWorker = (totalDrawCount + workerCount - 1) / workerCount;
+		workerCount = (totalDrawCount + drawsPerWorker - 1) / drawsPerWorker;	// Rounding up can leave trailing workers with nothing to do
+
+		std::vector<std::future<void>> recordings;
+		std::vector<DrawStats> workerStats(workerCount);
+		for (size_t i = 0; i < workerCount; i++)
+		{
+			size_t firstDraw = i * drawsPerWorker;
+			size_t drawCount = std::min(drawsPerWorker, totalDrawCount - firstDraw);
+			recordings.push_back(recordingWorkers.submit([this, &workerStats, currentImage, i, firstDraw, drawCount]() {
+				workerStats[i] = recordSecondaryCommands(currentImage, i, firstDraw, drawCount);
+			}));
+		}
+
+		// Wait for all workers to finish (get() rethrows any error thrown while recording)
+		drawStats = {};
+		for (size_t i = 0; i < workerCount; i++)
+		{
+			recordings[i].get();
+			drawStats.drawCount += workerStats[i].drawCount;
+			drawStats.bindCount += workerStats[i].bindCount;
+			drawStats.textureBindCount += workerStats[i].textureBindCount;
+		}
+
+		// Execute the secondary command buffers in order inside the render pass
+		vkCmdExecuteCommands(frame.commandBuffers[currentImage], static_cast<uint32_t>(workerCount), frame.secondaryCommandBuffers[currentImage].data());
+	}
+	else
+	{
+		// Begin Render Pass
+		vkCmdBeginRenderPass(frame.commandBuffers[currentImage], &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+
+		// Pipeline is bound along with the rest of the draw state
+		recordViewportAndScissor(frame.commandBuffers[currentImage]);
+
+		drawStats = recordMeshDraws(frame.commandBuffers[currentImage], frame, 0, drawList.size());
+	}
+
+	// What sorting saved (each worker binds its first texture again, so parallel recording can give some back)
+	uint32_t unsortedTextureBinds = countUnsortedTextureBinds();
+	drawStats.textureBindsSaved = unsortedTextureBinds > drawStats.textureBindCount ? unsortedTextureBinds - drawStats.textureBindCount : 0;
+
+	// End Render Pass
+	vkCmdEndRenderPass(frame.commandBuffers[currentImage]);
+
+	// Stop recording to command buffer
+	result = vkEndCommandBuffer(frame.commandBuffers[currentImage]);
+	if (result != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to stop recording a Command Buffer!");
+	}
+
+}
+
+DrawStats VulkanRenderer::recordSecondaryCommands(uint32_t currentImage, size_t worker, size_t firstDraw, size_t drawCount)
+{
+	VkCommandBuffer commandBuffer = frames[currentFrame].secondaryCommandBuffers[currentImage][worker];
+
+	// Secondary command buffers must know which render pass (and subpass) they will be executed within
+	VkCommandBufferInheritanceInfo inheritanceInfo = {};
+	inheritanceInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+	inheritanceInfo.renderPass = renderPass;									// Render Pass the commands will be executed in
+	inheritanceInfo.subpass = 0;												// Subpass the commands will be executed in
+	inheritanceInfo.framebuffer = swapChainFramebuffers[currentImage];			// Framebuffer being rendered to (optional, but can help driver)
+
+	VkCommandBufferBeginInfo bufferBeginInfo = {};
+	bufferBeginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	bufferBeginInfo.flags = VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;	// Whole command buffer is inside a render pass
+	bufferBeginInfo.pInheritanceInfo = &inheritanceInfo;
+
+	VkResult result = vkBeginCommandBuffer(commandBuffer, &bufferBeginInfo);
+	if (result != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to start recording a Secondary Command Buffer!");
+	}
+
+	// Dynamic state is not inherited from primary command buffer, so set it again (pipeline is bound with the draw state)
+	recordViewportAndScissor(commandBuffer);
+
+	DrawStats stats = recordMeshDraws(commandBuffer, frames[currentFrame], firstDraw, drawCount);
+
+	result = vkEndCommandBuffer(commandBuffer);
+	if (result != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to stop recording a Secondary Command Buffer!");
+	}
+
+	return stats;
+}
+
+void VulkanRenderer::recordViewportAndScissor(VkCommandBuffer commandBuffer)
+{
+	// Viewport and scissor cover the whole of the current swapchain extent
+	VkViewport viewport = {};
+	viewport.x = 0.0f;
+	viewport.y = 0.0f;
+	viewport.width = (float)swapChainExtent.width;
+	viewport.height = (float)swapChainExtent.height;
+	viewport.minDepth = 0.0f;
+	viewport.maxDepth = 1.0f;
+	vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+
+	VkRect2D scissor = {};
+	scissor.offset = { 0, 0 };
+	scissor.extent = swapChainExtent;
+	vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+}
+
+DrawStats VulkanRenderer::recordMeshDraws(VkCommandBuffer commandBuffer, const FrameResources & frame, size_t firstDraw, size_t drawCount)
+{
+	DrawStats stats = {};
+
+	// State bound so far in this command buffer, draws are sorted by state so it only changes when it must
+	VkPipeline boundPipeline = VK_NULL_HANDLE;
+	VkBuffer boundVertexBuffer = VK_NULL_HANDLE;
+	bool uniformSetBound = false;
+	int boundTexId = -1;
+
+	// Dynamic Offset Amount (VP is read from this frame's part of the transient ring, not recorded here)
+	uint32_t dynamicOffset = frame.vpUniformOffset;
+
+	for (size_t d = firstDraw; d < firstDraw + drawCount; d++)
+	{
+		uint32_t m = drawList[d].meshIndex;
+
+		// Only record meshes with instances in view
+		const InstanceRange &range = meshInstanceRanges[m];
+		if (range.instanceCount == 0) continue;
+
+		stats.drawCount++;
+
+		// Bind Pipeline to be used in render pass
+		if (boundPipeline != graphicsPipeline)
+		{
+			vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, graphicsPipeline);
+			boundPipeline = graphicsPipeline;
+			stats.bindCount++;
+		}
+
+		// Every mesh is in the geometry pool, so vertex/index buffers only need binding once (plus this frame's instance transforms)
+		if (boundVertexBuffer != geometryPool.getVertexBuffer())
+		{
+			VkBuffer vertexBuffers[] = { geometryPool.getVertexBuffer(), frame.instanceBuffer };		// Buffers to bind
+			VkDeviceSize offsets[] = { 0, frame.instanceOffset };										// Offsets into buffers being bound
+			vkCmdBindVertexBuffers(commandBuffer, 0, 2, vertexBuffers, offsets);	// Command to bind vertex buffer before drawing with them
+
+			// Bind index buffer, with 0 offset and using the uint32 type
+			vkCmdBindIndexBuffer(commandBuffer, geometryPool.getIndexBuffer(), 0, VK_INDEX_TYPE_UINT32);
+
+			boundVertexBuffer = geometryPool.getVertexBuffer();
+			stats.bindCount += 2;
+		}
+
+		// Uniform set (set 0) is the same for every draw, texture set (set 1) only changes between groups of sorted draws
+		if (!uniformSetBound)
+		{
+			vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout,
+				0, 1, &frame.uniformDescriptorSet, 1, &dynamicOffset);
+			uniformSetBound = true;
+			stats.bindCount++;
+		}
+
+		if (boundTexId != renderList.texId[m])
+		{
+			recordTextureBind(commandBuffer, renderList.texId[m], boundTexId < 0);
+			boundTexId = renderList.texId[m];
+			stats.bindCount++;
+			stats.textureBindCount++;
+		}
+
+		// Execute pipeline, once for every instance of the mesh (mesh's geometry is found from its offsets in the pool)
+		vkCmdDrawIndexed(commandBuffer, renderList.indexCount[m], range.instanceCount, renderList.firstIndex[m], renderList.vertexOffset[m], range.firstInstance);
+	}
+
+	return stats;
+}
+
+uint32_t VulkanRenderer::countUnsortedTextureBinds()
+{
+	// Texture is bound whenever it differs from the last draw's (or batch's, for indirect draws), as when recording sorted draws
+	uint32_t bindCount = 0;
+	int boundTexId = -1;
+	for (size_t m = 0; m < renderList.texId.size(); m++)
+	{
+		// Direct draws leave out meshes with no instances in view, indirect draws have a command for every mesh
+		if (!indirectDrawingActive() && meshInstanceRanges[m].instanceCount == 0) continue;
+
+		if (renderList.texId[m] != boundTexId)
+		{
+			boundTexId = renderList.texId[m];
+			bindCount++;
+		}
+	}
+
+	return bindCount;
+}
+
+DrawStats VulkanRenderer::recordIndirectDraws(VkCommandBuffer commandBuffer, const FrameResources & frame)
+{
+	const VkDeviceSize commandStride = sizeof(VkDrawIndexedIndirectCommand);
+
+	// Dynamic Offset Amount (VP is read from this frame's part of the transient ring)
+	uint32_t dynamicOffset = frame.vpUniformOffset;
+
+	// Pipeline (bound by caller), geometry and uniforms are the same for every batch, so are only bound once
+	// Batches are made from sorted draws, so each one has a different texture
+	DrawStats stats = {};
+	stats.drawCount = static_cast<uint32_t>(drawBatches.size());
+	stats.bindCount = 4;
+
+	// Geometry of every batch is in the pool, plus this frame's instance transforms
+	VkBuffer vertexBuffers[] = { geometryPool.getVertexBuffer(), frame.instanceBuffer };
+	VkDeviceSize offsets[] = { 0, frame.instanceOffset };
+	vkCmdBindVertexBuffers(commandBuffer, 0, 2, vertexBuffers, offsets);
+	vkCmdBindIndexBuffer(commandBuffer, geometryPool.getIndexBuffer(), 0, VK_INDEX_TYPE_UINT32);
+	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout,
+		0, 1, &frame.uniformDescriptorSet, 1, &dynamicOffset);
+
+	for (size_t b = 0; b < drawBatches.size(); b++)
+	{
+		const DrawBatch &batch = drawBatches[b];
+
+		if (b == 0 || drawBatches[b - 1].texId != batch.texId)
+		{
+			recordTextureBind(commandBuffer, batch.texId, b == 0);
+			stats.bindCount++;
+			stats.textureBindCount++;
+		}
+
+		// Draw commands are read from the ring when the commands execute, so their contents can change without recording again
+		VkDeviceSize commandOffset = frame.indirectOffset + commandStride * batch.firstDraw;
+		if (optionalFeatures.drawIndirectCount)
+		{
+			// Number of draws is read from the count buffer too (up to the batch size)
+			vkCmdDrawIndexedIndirectCount(commandBuffer, frame.indirectBuffer, commandOffset,
+				frame.indirectCountBuffer, frame.indirectCountOffset + sizeof(uint32_t) * b, batch.drawCount, static_cast<uint32_t>(commandStride));
+		}
+		else if (optionalFeatures.multiDrawIndirect)
+		{
+			vkCmdDrawIndexedIndirect(commandBuffer, frame.indirectBuffer, commandOffset, batch.drawCount, static_cast<uint32_t>(commandStride));
+		}
+		else
+		{
+			// Without multi draw, each indirect draw call can only read one command
+			for (uint32_t i = 0; i < batch.drawCount; i++)
+			{
+				vkCmdDrawIndexedIndirect(commandBuffer, frame.indirectBuffer, commandOffset + commandStride * i, 1, static_cast<uint32_t>(commandStride));
+			}
+		}
+	}
+
+	return stats;
+}
+
+void VulkanRenderer::recordTextureBind(VkCommandBuffer commandBuffer, int texId, bool firstBind)
+{
+	// Textures that aren't resident (or are still being loaded back) draw with the placeholder
+	bool resident = textureImageViews[texId] != VK_NULL_HANDLE && !textureResidency[texId].restoring;
+
+	if (bindlessTexturesActive())
+	{
+		// Texture array only has to be bound once, after that each texture is just an index
+		if (firstBind)
+		{
+			vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout,
+				1, 1, &bindlessTextureSet, 0, nullptr);
+		}
+
+		DrawPushConstants pushConstants = {};
+		pushConstants.textureIndex = resident ? static_cast<uint32_t>(texId) : bindlessTextureCapacity - 1;
+		vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(DrawPushConstants), &pushConstants);
+	}
+	else
+	{
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout,
+			1, 1, resident ? &samplerDescriptorSets[texId] : &placeholderDescriptorSet, 0, nullptr);
+	}
+}
+
+void VulkanRenderer::recordCulling(VkCommandBuffer commandBuffer, const FrameResources & frame)
+{
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, cullPipeline);
+	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, cullPipelineLayout,
+		0, 1, &frame.cullDescriptorSet, 0, nullptr);
+
+	// One invocation per draw, in groups of 64 (local size in cull.comp)
+	vkCmdDispatch(commandBuffer, (cullCandidateCount + 63) / 64, 1, 1);
+
+	// On the compute queue, the semaphore the draws wait on makes the results visible instead
+	if (computeScheduler.isAsync()) return;
+
+	// Draw commands and counts must be written before they are read to draw
+	VkMemoryBarrier cullBarrier = {};
+	cullBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	cullBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	cullBarrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT;
+
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT,
+		0, 1, &cullBarrier, 0, nullptr, 0, nullptr);
+}
+
+void VulkanRenderer::invalidateCommandBuffers()
+{
+	// Mark every image's commands as out of date in every frame, they will be recorded again when next drawn
+	for (auto &frame : frames)
+	{
+		std::fill(frame.commandBufferDirty.begin(), frame.commandBufferDirty.end(), true);
+	}
+}
+
+void VulkanRenderer::getPhysicalDevice()
+{
+	// Enumerate Physical devices the vkInstance can access
+	uint32_t deviceCount = 0;
+	vkEnumeratePhysicalDevices(instance, &deviceCount, nullptr);
+
+	// If no devices available, then none support Vulkan!
+	if (deviceCount == 0)
+	{
+		throw std::runtime_error("Can't find GPUs that support Vulkan Instance!");
+	}
+
+	// Get list of Physical Devices
+	std::vector<VkPhysicalDevice> deviceList(deviceCount);
+	vkEnumeratePhysicalDevices(instance, &deviceCount, deviceList.data());
+
+	for (const auto& device : deviceList)
+	{
+		if (checkDeviceSuitable(device))
+		{
+			mainDevice.physicalDevice = device;
+			break;
+		}
+	}
+
+	// Get properties of our new device
+	VkPhysicalDeviceProperties deviceProperties;
+	vkGetPhysicalDeviceProperties(mainDevice.physicalDevice, &deviceProperties);
+
+	minUniformBufferOffset = deviceProperties.limits.minUniformBufferOffsetAlignment;
+	minStorageBufferOffset = deviceProperties.limits.minStorageBufferOffsetAlignment;
+
+	// Find which optional features the device supports
+	VkPhysicalDeviceVulkan12Features vulkan12Features = {};
+	vulkan12Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+
+	VkPhysicalDeviceFeatures2 deviceFeatures2 = {};
+	deviceFeatures2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+	deviceFeatures2.pNext = &vulkan12Features;
+	vkGetPhysicalDeviceFeatures2(mainDevice.physicalDevice, &deviceFeatures2);
+
+	optionalFeatures.multiDrawIndirect = deviceFeatures2.features.multiDrawIndirect;
+	optionalFeatures.drawIndirectFirstInstance = deviceFeatures2.features.drawIndirectFirstInstance;
+	optionalFeatures.textureCompressionBC = deviceFeatures2.features.textureCompressionBC;
+	optionalFeatures.drawIndirectCount = vulkan12Features.drawIndirectCount;
+	optionalFeatures.descriptorIndexing = vulkan12Features.runtimeDescriptorArray
+		&& vulkan12Features.shaderSampledImageArrayNonUniformIndexing
+		&& vulkan12Features.descriptorBindingSampledImageUpdateAfterBind
+		&& vulkan12Features.descriptorBindingPartiallyBound;
+
+	// Heap budgets can be read from the driver if it has the memory budget extension
+	uint32_t extensionCount = 0;
+	vkEnumerateDeviceExtensionProperties(mainDevice.physicalDevice, nullptr, &extensionCount, nullptr);
+	std::vector<VkExtensionProperties> extensions(extensionCount);
+	vkEnumerateDeviceExtensionProperties(mainDevice.physicalDevice, nullptr, &extensionCount, extensions.data());
+	for (const auto &extension : extensions)
+	{
+		if (strcmp(extension.extensionName, VK_EXT_MEMORY_BUDGET_EXTENSION_NAME) == 0)
+		{
+			optionalFeatures.memoryBudget = true;
+		}
+	}
+
+	// Bindless texture array can't be bigger than the device allows for update-after-bind sets
+	VkPhysicalDeviceVulkan12Properties vulkan12Properties = {};
+	vulkan12Properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_PROPERTIES;
+
+	VkPhysicalDeviceProperties2 deviceProperties2 = {};
+	deviceProperties2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+	deviceProperties2.pNext = &vulkan12Properties;
+	vkGetPhysicalDeviceProperties2(mainDevice.physicalDevice, &deviceProperties2);
+
+	// Texture mips are blitted on the GPU if the format can be, otherwise they're made on the CPU
+	VkFormatProperties textureFormatProperties;
+	vkGetPhysicalDeviceFormatProperties(mainDevice.physicalDevice, VK_FORMAT_R8G8B8A8_UNORM, &textureFormatProperties);
+	VkFormatFeatureFlags linearBlitFeatures = VK_FORMAT_FEATURE_BLIT_SRC_BIT | VK_FORMAT_FEATURE_BLIT_DST_BIT
+		| VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT;
+	optionalFeatures.textureLinearBlit = (textureFormatProperties.optimalTilingFeatures & linearBlitFeatures) == linearBlitFeatures;
+
+	// Textures stored block compressed are loaded as such if the device can sample their format, otherwise from the source image
+	VkFormatFeatureFlags compressedFeatures = VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT
+		| VK_FORMAT_FEATURE_TRANSFER_DST_BIT;
+	for (VkFormat format : { VK_FORMAT_BC1_RGB_UNORM_BLOCK, VK_FORMAT_BC1_RGBA_UNORM_BLOCK, VK_FORMAT_BC3_UNORM_BLOCK, VK_FORMAT_BC7_UNORM_BLOCK })
+	{
+		VkFormatProperties formatProperties;
+		vkGetPhysicalDeviceFormatProperties(mainDevice.physicalDevice, format, &formatProperties);
+		if ((formatProperties.optimalTilingFeatures & compressedFeatures) == compressedFeatures)
+		{
+			compressedTextureFormats.insert(format);
+		}
+	}
+
+	bindlessTextureCapacity = std::min({ MAX_BINDLESS_TEXTURES,
+		vulkan12Properties.maxPerStageDescriptorUpdateAfterBindSampledImages,
+		vulkan12Properties.maxDescriptorSetUpdateAfterBindSampledImages });
+}
+
+bool VulkanRenderer::checkInstanceExtensionSupport(std::vector<const char*>* checkExtensions)
+{
+	// Need to get number of extensions to create array of correct size to hold extensions
+	uint32_t extensionCount = 0;
+	vkEnumerateInstanceExtensionProperties(nullptr, &extensionCount, nullptr);
+
+	// Create a list of VkExtensionProperties using count
+	std::vector<VkExtensionProperties> extensions(extensionCount);
+	vkEnumerateInstanceExtensionProperties(nullptr, &extensionCount, extensions.data());
+
+	// Check if given extensions are in list of available extensions
+	for (const auto& checkExtension : *checkExtensions)
+	{
+		bool hasExtension = false;
+		for (const auto& extension : extensions)
+		{
+			if (strcmp(checkExtension, extension.extensionName) == 0)
+			{
+				hasExtension = true;
+				break;
+			}
+		}
+
+		if (!hasExtension)
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+bool VulkanRenderer::checkDeviceExtensionSupport(VkPhysicalDevice device)
+{
+	// Get device extension count
+	uint32_t extensionCount = 0;
+	vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, nullptr);
+
+	// If no extensions found, return failure
+	if (extensionCount == 0)
+	{
+		return false;
+	}
+
+	// Populate list of extensions
+	std::vector<VkExtensionProperties> extensions(extensionCount);
+	vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, extensions.data());
+
+	// Check for extension
+	for (const auto& deviceExtension : deviceExtensions)
+	{
+		bool hasExtension = false;
+		for (const auto& extension : extensions)
+		{
+			if (strcmp(deviceExtension, extension.extensionName) == 0)
+			{
+				hasExtension = true;
+				break;
+			}
+		}
+
+		if (!hasExtension)
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+bool VulkanRenderer::checkValidationLayerSupport()
+{
+	uint32_t layerCount;
+	vkEnumerateInstanceLayerProperties(&layerCount, nullptr);
+
+	std::vector<VkLayerProperties> availableLayers(layerCount);
+	vkEnumerateInstanceLayerProperties(&layerCount, availableLayers.data());
+
+	for (const char* layerName : validationLayers) {
+		bool layerFound = false;
+
+		for (const auto& layerProperties : availableLayers) {
 			if (strcmp(layerName, layerProperties.layerName) == 0) {
 				layerFound = true;
 				break;
@@ -1339,6 +2765,15 @@ bool VulkanRenderer::checkDeviceSuitable(VkPhysicalDevice device)
 	VkPhysicalDeviceFeatures deviceFeatures;
 	vkGetPhysicalDeviceFeatures(device, &deviceFeatures);
 
+	// Vulkan 1.2 features are queried by chaining their structure
+	VkPhysicalDeviceVulkan12Features vulkan12Features = {};
+	vulkan12Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+
+	VkPhysicalDeviceFeatures2 deviceFeatures2 = {};
+	deviceFeatures2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+	deviceFeatures2.pNext = &vulkan12Features;
+	vkGetPhysicalDeviceFeatures2(device, &deviceFeatures2);
+
 
 	QueueFamilyIndices indices = getQueueFamilies(device);
 
@@ -1351,7 +2786,8 @@ bool VulkanRenderer::checkDeviceSuitable(VkPhysicalDevice device)
 		swapChainValid = !swapChainDetails.presentationModes.empty() && !swapChainDetails.formats.empty();
 	}
 
-	return indices.isValid() && extensionsSupported && swapChainValid && deviceFeatures.samplerAnisotropy;
+	return indices.isValid() && extensionsSupported && swapChainValid && deviceFeatures.samplerAnisotropy
+		&& vulkan12Features.timelineSemaphore;
 }
 
 QueueFamilyIndices VulkanRenderer::getQueueFamilies(VkPhysicalDevice device)
@@ -1369,24 +2805,43 @@ QueueFamilyIndices VulkanRenderer::getQueueFamilies(VkPhysicalDevice device)
 	int i = 0;
 	for (const auto &queueFamily : queueFamilyList)
 	{
-		// First check if queue family has at least 1 queue in that family (could have no queues)
-		// Queue can be multiple types defined through bitfield. Need to bitwise AND with VK_QUEUE_*_BIT to check if has required type
-		if (queueFamily.queueCount > 0 && queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT)
+		// Graphics and presentation families stop changing once both are found (the search continues only for a transfer family)
+		if (!indices.isValid())
 		{
-			indices.graphicsFamily = i;		// If queue family is valid, then get index
+			// First check if queue family has at least 1 queue in that family (could have no queues)
+			// Queue can be multiple types defined through bitfield. Need to bitwise AND with VK_QUEUE_*_BIT to check if has required type
+			if (queueFamily.queueCount > 0 && queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT)
+			{
+				indices.graphicsFamily = i;		// If queue family is valid, then get index
+			}
+
+			// Check if Queue Family supports presentation
+			VkBool32 presentationSupport = false;
+			vkGetPhysicalDeviceSurfaceSupportKHR(device, i, surface, &presentationSupport);
+			// Check if queue is presentation type (can be both graphics and presentation)
+			if (queueFamily.queueCount > 0 && presentationSupport)
+			{
+				indices.presentationFamily = i;
+			}
+		}
+
+		// Transfer only family (usually a DMA engine), which can copy without taking time from graphics work
+		// (graphics and compute families can always transfer too, whether they report it or not)
+		VkQueueFlags transferOnly = queueFamily.queueFlags & (VK_QUEUE_TRANSFER_BIT | VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT);
+		if (indices.transferFamily < 0 && queueFamily.queueCount > 0 && transferOnly == VK_QUEUE_TRANSFER_BIT)
+		{
+			indices.transferFamily = i;
 		}
 
-		// Check if Queue Family supports presentation
-		VkBool32 presentationSupport = false;
-		vkGetPhysicalDeviceSurfaceSupportKHR(device, i, surface, &presentationSupport);
-		// Check if queue is presentation type (can be both graphics and presentation)
-		if (queueFamily.queueCount > 0 && presentationSupport)
+		// Compute family without graphics (async compute), whose work can run alongside graphics work
+		if (indices.computeFamily < 0 && queueFamily.queueCount > 0
+			&& (queueFamily.queueFlags & (VK_QUEUE_COMPUTE_BIT | VK_QUEUE_GRAPHICS_BIT)) == VK_QUEUE_COMPUTE_BIT)
 		{
-			indices.presentationFamily = i;
+			indices.computeFamily = i;
 		}
 
-		// Check if queue family indices are in a valid state, stop searching if so
-		if (indices.isValid())
+		// Check if queue family indices are in a valid state, stop searching if so (and the optional families are found)
+		if (indices.isValid() && indices.transferFamily >= 0 && indices.computeFamily >= 0)
 		{
 			break;
 		}
@@ -1472,10 +2927,10 @@ VkSurfaceFormatKHR VulkanRenderer::chooseBestSurfaceFormat(const std::vector<VkS
 
 VkPresentModeKHR VulkanRenderer::chooseBestPresentationMode(const std::vector<VkPresentModeKHR> presentationModes)
 {
-	// Look for Mailbox presentation mode
+	// Look for the requested presentation mode
 	for (const auto &presentationMode : presentationModes)
 	{
-		if (presentationMode == VK_PRESENT_MODE_MAILBOX_KHR)
+		if (presentationMode == preferredPresentMode)
 		{
 			return presentationMode;
 		}
@@ -1536,7 +2991,7 @@ VkFormat VulkanRenderer::chooseSupportedFormat(const std::vector<VkFormat>& form
 	throw std::runtime_error("Failed to find a matching format!");
 }
 
-VkImage VulkanRenderer::createImage(uint32_t width, uint32_t height, VkFormat format, VkImageTiling tiling, VkImageUsageFlags useFlags, VkMemoryPropertyFlags propFlags, VkDeviceMemory* imageMemory)
+VkImage VulkanRenderer::createImage(uint32_t width, uint32_t height, uint32_t mipLevels, VkFormat format, VkImageTiling tiling, VkImageUsageFlags useFlags, VkMemoryPropertyFlags propFlags, MemoryCategory category, MemoryAllocation* imageMemory)
 {
 	// Create the image
 	// Image creation info
@@ -1546,7 +3001,7 @@ VkImage VulkanRenderer::createImage(uint32_t width, uint32_t height, VkFormat fo
 	imageCreateInfo.extent.width = width;								// width of image extent
 	imageCreateInfo.extent.height = height;								// height of image extent
 	imageCreateInfo.extent.depth = 1;									// depth of image (just one, no 3D aspect.
-	imageCreateInfo.mipLevels = 1;										// number of mipmap levels
+	imageCreateInfo.mipLevels = mipLevels;								// number of mipmap levels
 	imageCreateInfo.arrayLayers = 1;									// number of layers in image array
 	imageCreateInfo.format = format;									// format type of the image
 	imageCreateInfo.tiling = tiling;									// how image data should be "tiled" (arranged for optimal reading)
@@ -1555,39 +3010,14 @@ VkImage VulkanRenderer::createImage(uint32_t width, uint32_t height, VkFormat fo
 	imageCreateInfo.samples = VK_SAMPLE_COUNT_1_BIT;					// number of samples for multisampling
 	imageCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;			// Whether images can be shared between queues
 
+	// Create the image, and give it memory from the allocator (connected to the image ready for use)
 	VkImage image;
-	VkResult result = vkCreateImage(mainDevice.logicalDevice, &imageCreateInfo, nullptr, &image);
-	if (result != VK_SUCCESS)
-	{
-		throw std::runtime_error("Failed to create an Image!");
-	}
-
-	// Create memory for image
-
-	// Get memory requirements for a type of image
-	VkMemoryRequirements memoryRequirements;
-	vkGetImageMemoryRequirements(mainDevice.logicalDevice, image, &memoryRequirements);
-
-
-	// Allocate memory using image requirements and user defined properties
-	VkMemoryAllocateInfo memoryAllocInfo = {};
-	memoryAllocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-	memoryAllocInfo.allocationSize = memoryRequirements.size;
-	memoryAllocInfo.memoryTypeIndex = findMemoryTypeIndex(mainDevice.physicalDevice, memoryRequirements.memoryTypeBits, propFlags);
-
-	result = vkAllocateMemory(mainDevice.logicalDevice, &memoryAllocInfo, nullptr, imageMemory);
-	if (result != VK_SUCCESS)
-	{
-		throw std::runtime_error("Failed to allocate memory for image!");
-	}
-
-	// Connect memory to image
-	vkBindImageMemory(mainDevice.logicalDevice, image, *imageMemory, 0);
+	memoryAllocator.createImage(imageCreateInfo, propFlags, category, &image, imageMemory);
 
 	return image;
 }
 
-VkImageView VulkanRenderer::createImageView(VkImage image, VkFormat format, VkImageAspectFlags aspectFlags)
+VkImageView VulkanRenderer::createImageView(VkImage image, VkFormat format, VkImageAspectFlags aspectFlags, uint32_t mipLevels)
 {
 	VkImageViewCreateInfo viewCreateInfo = {};
 	viewCreateInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
@@ -1602,7 +3032,7 @@ VkImageView VulkanRenderer::createImageView(VkImage image, VkFormat format, VkIm
 	// Subresources allow the view to view only a part of an image
 	viewCreateInfo.subresourceRange.aspectMask = aspectFlags;				// Which aspect of image to view (e.g. COLOR_BIT for viewing colour)
 	viewCreateInfo.subresourceRange.baseMipLevel = 0;						// Start mipmap level to view from
-	viewCreateInfo.subresourceRange.levelCount = 1;							// Number of mipmap levels to view
+	viewCreateInfo.subresourceRange.levelCount = mipLevels;					// Number of mipmap levels to view
 	viewCreateInfo.subresourceRange.baseArrayLayer = 0;						// Start array level to view from
 	viewCreateInfo.subresourceRange.layerCount = 1;							// Number of array levels to view
 
@@ -1635,65 +3065,96 @@ VkShaderModule VulkanRenderer::createShaderModule(const std::vector<char>& code)
 	return shaderModule;
 }
 
-int VulkanRenderer::createTextureImage(std::string fileName)
+int VulkanRenderer::createTextureImage(std::string fileName, const TextureData & textureData)
 {
-	// Load image file
-	int width, height;
-	VkDeviceSize imageSize;
-	stbi_uc * imageData = loadTextureFile(fileName, &width, &height, &imageSize);
+	// Make room for it first, if it would take the heap over budget (evicts textures not drawn recently)
+	// A mip chain made for it adds about a third again (compressed textures already include theirs)
+	bool compressed = textureData.compressed.format != VK_FORMAT_UNDEFINED;
+	evictTextures(deviceLocalHeap, compressed ? textureData.size : textureData.size + textureData.size / 3);
+
+	MemoryAllocation texImageMemory;
+	VkImage texImage = createTextureImageFromData(textureData, &texImageMemory);
+
+	// add texture data to vector for reference
+	textureImages.push_back(texImage);
+	textureImageMemory.push_back(texImageMemory);
 
-	// Create staging buffer to hold loaded data, ready to copy to device
-	VkBuffer imageStagingBuffer;
-	VkDeviceMemory imageStagingBufferMemory;
-	createBuffer(mainDevice.physicalDevice, mainDevice.logicalDevice, imageSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-		&imageStagingBuffer, &imageStagingBufferMemory);
+	TextureResidency residency = {};
+	residency.fileName = fileName;
+	residency.size = texImageMemory.size;
+	residency.lastUsedFrame = frameNumber + 1;		// Its upload goes with the next frame, so it can't be evicted before that is done
+	residency.mipLevels = textureData.mipLevels;
+	residency.format = textureData.format;
+	textureResidency.push_back(residency);
 
-	// copy image data to staging buffer
-	void* data;
-	vkMapMemory(mainDevice.logicalDevice, imageStagingBufferMemory, 0, imageSize, 0, &data);
-	memcpy(data, imageData, static_cast<size_t>(imageSize));
-	vkUnmapMemory(mainDevice.logicalDevice, imageStagingBufferMemory);
+	// return index of new texture image
+	return textureImages.size() - 1;
+}
 
-	// free original image data
-	stbi_image_free(imageData);
+VkImage VulkanRenderer::createTextureImageFromData(const TextureData & textureData, MemoryAllocation * imageMemory)
+{
+	if (textureData.compressed.format != VK_FORMAT_UNDEFINED)
+	{
+		return createCompressedTextureImage(textureData.compressed, imageMemory);
+	}
+
+	uint32_t width = static_cast<uint32_t>(textureData.width);
+	uint32_t height = static_cast<uint32_t>(textureData.height);
+
+	// Levels not already made on the CPU are blitted from level 0 on the GPU, which needs it as a transfer source too
+	bool blitMips = textureData.mipChain.empty() && textureData.mipLevels > 1;
 
 	// Create image to hold final texture
-	VkImage texImage;
-	VkDeviceMemory texImageMemory;
-	texImage = createImage(width, height, VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_TILING_OPTIMAL,
-		VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &texImageMemory);
-
-	// copy data to image
-	// Transition image to be DST for copy operation
-	transtionImageLayout(mainDevice.logicalDevice, graphicsQueue, graphicsCommandPool,
-		texImage, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
-	// copy image data
-	copyImageBuffer(mainDevice.logicalDevice, graphicsQueue, graphicsCommandPool, imageStagingBuffer, texImage, width, height);
-
-	// Transition image to be shader readable for shader usage
-	transtionImageLayout(mainDevice.logicalDevice, graphicsQueue, graphicsCommandPool,
-		texImage, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+	VkImageUsageFlags usage = VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+	if (blitMips)
+	{
+		usage |= VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+	}
+	VkImage texImage = createImage(width, height, textureData.mipLevels, VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_TILING_OPTIMAL,
+		usage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, MEMORY_CATEGORY_TEXTURES, imageMemory);
+
+	// Pixels are staged now, the copy (and layout transitions) happen with the rest of the upload batch
+	if (textureData.mipChain.empty())
+	{
+		// Only level 0 is copied, the rest (if any) are blitted from it on the GPU
+		uploadManager.uploadImage(texImage, width, height, textureData.mipLevels, {}, textureData.pixels, textureData.size);
+	}
+	else
+	{
+		// Otherwise every level was made by the decoding worker, and is copied as it is
+		std::vector<VkDeviceSize> levelOffsets(textureData.mipLevels);
+		for (uint32_t level = 0; level < textureData.mipLevels; level++)
+		{
+			levelOffsets[level] = MipGenerator::getMipChainSize(width, height, level);
+		}
+
+		uploadManager.uploadImage(texImage, width, height, textureData.mipLevels, levelOffsets,
+			textureData.mipChain.data(), textureData.mipChain.size());
+	}
+
+	return texImage;
+}
 
-	// add texture data to vector for reference
-	textureImages.push_back(texImage);
-	textureImageMemory.push_back(texImageMemory);
+VkImage VulkanRenderer::createCompressedTextureImage(const KtxTexture & texture, MemoryAllocation * imageMemory)
+{
+	// Blocks can't be blitted, so every level comes from the file
+	VkImage texImage = createImage(texture.width, texture.height, texture.mipLevels, texture.format, VK_IMAGE_TILING_OPTIMAL,
+		VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, MEMORY_CATEGORY_TEXTURES, imageMemory);
 
-	// destroy staging buffers
-	vkDestroyBuffer(mainDevice.logicalDevice, imageStagingBuffer, nullptr);
-	vkFreeMemory(mainDevice.logicalDevice, imageStagingBufferMemory, nullptr);
+	uploadManager.uploadImage(texImage, texture.width, texture.height, texture.mipLevels, texture.levelOffsets,
+		texture.data.data(), texture.data.size());
 
-	// return index of new texture image
-	return textureImages.size() - 1;
+	return texImage;
 }
 
-int VulkanRenderer::createTexture(std::string fileName)
+int VulkanRenderer::createTexture(std::string fileName, const TextureData & textureData)
 {
-	// create texture image and get its location in array
-	int textureImageLoc = createTextureImage(fileName);
+	// create texture image from the decoded file and get its location in array
+	int textureImageLoc = createTextureImage(fileName, textureData);
 	
 	// create imageview and add to the list
-	VkImageView imageView = createImageView(textureImages[textureImageLoc], VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_ASPECT_COLOR_BIT);
+	VkImageView imageView = createImageView(textureImages[textureImageLoc], textureResidency[textureImageLoc].format, VK_IMAGE_ASPECT_COLOR_BIT,
+		textureResidency[textureImageLoc].mipLevels);
 	textureImageViews.push_back(imageView);
 
 	// create texture descriptor
@@ -1705,6 +3166,21 @@ int VulkanRenderer::createTexture(std::string fileName)
 
 int VulkanRenderer::createTextureDescriptor(VkImageView textureImage)
 {
+	if (bindlessTexturesActive())
+	{
+		// Texture goes in the next element of the array, its index is what draws push to sample it (last element is the placeholder's)
+		uint32_t textureIndex = static_cast<uint32_t>(textureImageViews.size() - 1);
+		if (textureIndex >= bindlessTextureCapacity - 1)
+		{
+			throw std::runtime_error("Bindless Texture array is full!");
+		}
+
+		// Set is update-after-bind, so this is fine even while recorded commands using it are in flight
+		updateTextureDescriptor(static_cast<int>(textureIndex), textureImage);
+
+		return static_cast<int>(textureIndex);
+	}
+
 	VkDescriptorSet descriptorSet;
 
 	// descriptor set allocation info
@@ -1721,33 +3197,307 @@ int VulkanRenderer::createTextureDescriptor(VkImageView textureImage)
 		throw std::runtime_error("Failed to allocate Texture Descriptor Sets");
 	}
 
+	// add descriptor set to list
+	samplerDescriptorSets.push_back(descriptorSet);
+
+	// update new descriptor set
+	int descriptorLoc = static_cast<int>(samplerDescriptorSets.size() - 1);
+	updateTextureDescriptor(descriptorLoc, textureImage);
+
+	// Return descriptor set location
+	return descriptorLoc;
+}
+
+void VulkanRenderer::updateTextureDescriptor(int texId, VkImageView textureImage)
+{
+	// Texture's element of the bindless array, or its own set
+	if (bindlessTexturesActive())
+	{
+		writeTextureDescriptor(bindlessTextureSet, static_cast<uint32_t>(texId), textureImage);
+	}
+	else
+	{
+		writeTextureDescriptor(samplerDescriptorSets[texId], 0, textureImage);
+	}
+}
+
+void VulkanRenderer::writeTextureDescriptor(VkDescriptorSet descriptorSet, uint32_t arrayElement, VkImageView textureImage)
+{
 	// texture image info
 	VkDescriptorImageInfo imageInfo = {};
 	imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;		// umage layout when in use
 	imageInfo.imageView = textureImage;										// image to bind to set
 	imageInfo.sampler = textureSampler;										// sampler to use for set
 
-	//descriptor write info
 	VkWriteDescriptorSet descriptorWrite = {};
 	descriptorWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
 	descriptorWrite.dstSet = descriptorSet;
 	descriptorWrite.dstBinding = 0;
-	descriptorWrite.dstArrayElement = 0;
+	descriptorWrite.dstArrayElement = arrayElement;
 	descriptorWrite.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
 	descriptorWrite.descriptorCount = 1;
 	descriptorWrite.pImageInfo = &imageInfo;
 
-	// update new descriptor set
 	vkUpdateDescriptorSets(mainDevice.logicalDevice, 1, &descriptorWrite, 0, nullptr);
+}
 
-	// add descriptor set to list
-	samplerDescriptorSets.push_back(descriptorSet);
+void VulkanRenderer::manageTextureMemory()
+{
+	// Note which textures this frame draws with (indirect draws bind every mesh's texture, direct draws only visible meshes')
+	for (size_t m = 0; m < renderList.texId.size(); m++)
+	{
+		int texId = renderList.texId[m];
+		if (texId < 0 || texId >= static_cast<int>(textureResidency.size())) continue;
 
-	// Return descriptor set location
-	return samplerDescriptorSets.size() - 1;
+		if (indirectDrawingActive() || meshInstanceRanges[m].instanceCount > 0)
+		{
+			textureResidency[texId].lastUsedFrame = frameNumber;
+		}
+	}
+
+	// Keep every heap within its budget
+	for (uint32_t heap = 0; heap < memoryAllocator.getHeapCount(); heap++)
+	{
+		evictTextures(heap, 0);
+	}
+
+	// Start loading back an evicted texture this frame draws with, if it fits without going over budget
+	// (along with the others already on their way back, at most one is started a frame)
+	VkDeviceSize restoringSize = 0;
+	for (const auto &pending : pendingRestores)
+	{
+		if (!pending.uploaded) restoringSize += textureResidency[pending.texId].size;
+	}
+	for (size_t i = 0; i < textureImages.size(); i++)
+	{
+		if (textureImages[i] != VK_NULL_HANDLE || textureResidency[i].restoring || textureResidency[i].lastUsedFrame != frameNumber) continue;
+
+		HeapBudget heapBudget = memoryAllocator.getHeapBudget(deviceLocalHeap);
+		if (heapBudget.usage + restoringSize + textureResidency[i].size <= heapBudget.budget)
+		{
+			restoreTexture(static_cast<int>(i));
+		}
+		break;
+	}
+	updateTextureRestores();
+
+	HeapBudget heapBudget = memoryAllocator.getHeapBudget(deviceLocalHeap);
+	memoryStats.deviceLocalUsage = heapBudget.usage;
+	memoryStats.deviceLocalBudget = heapBudget.budget;
+	memoryStats.textureMemory = memoryAllocator.getCategoryUsage(deviceLocalHeap, MEMORY_CATEGORY_TEXTURES);
+	memoryStats.evictedTextures = static_cast<uint32_t>(std::count_if(textureImages.begin(), textureImages.end(),
+		[](VkImage image) { return image == VK_NULL_HANDLE; }));
+	memoryStats.textureCacheHits = textureCache.getHitCount();
+}
+
+bool VulkanRenderer::evictTextures(uint32_t heapIndex, VkDeviceSize neededBytes)
+{
+	HeapBudget heapBudget = memoryAllocator.getHeapBudget(heapIndex);
+	if (heapBudget.usage + neededBytes <= heapBudget.budget) return true;
+
+	// Only textures the GPU has finished with can go, anything drawn by a frame still in flight stays
+	uint64_t completedFrame = getCompletedFrame();
+	bool evicted = false;
+	while (heapBudget.usage + neededBytes > heapBudget.budget)
+	{
+		// Resident texture in this heap no model uses any more, otherwise the least recently used
+		int victim = -1;
+		bool victimUnused = false;
+		for (size_t i = 0; i < textureImages.size(); i++)
+		{
+			if (textureImages[i] == VK_NULL_HANDLE || textureResidency[i].restoring || textureResidency[i].lastUsedFrame > completedFrame
+				|| memoryAllocator.getHeapIndex(textureImageMemory[i]) != heapIndex) continue;
+
+			bool unused = textureCache.getReferenceCount(static_cast<int>(i)) == 0;
+			if (victim < 0 || (unused && !victimUnused)
+				|| (unused == victimUnused && textureResidency[i].lastUsedFrame < textureResidency[victim].lastUsedFrame))
+			{
+				victim = static_cast<int>(i);
+				victimUnused = unused;
+			}
+		}
+		if (victim < 0) break;
+
+		// Driver's usage isn't updated straight away, so count the texture's size off ourselves
+		VkDeviceSize freedBytes = textureImageMemory[victim].size;
+		evictTexture(victim);
+		heapBudget.usage -= std::min(freedBytes, heapBudget.usage);
+		evicted = true;
+	}
+
+	// Recorded commands bind the changed descriptors
+	if (evicted)
+	{
+		invalidateCommandBuffers();
+	}
+
+	return heapBudget.usage + neededBytes <= heapBudget.budget;
+}
+
+void VulkanRenderer::evictTexture(int texId)
+{
+	// Draws with it bind the placeholder's descriptor until it is loaded again
+	// (its own is pointed at the placeholder too, rather than at a destroyed view, no frame in flight uses it)
+	updateTextureDescriptor(texId, placeholderImageView);
+
+	vkDestroyImageView(mainDevice.logicalDevice, textureImageViews[texId], nullptr);
+	memoryAllocator.destroyImage(textureImages[texId], textureImageMemory[texId]);
+	textureImageViews[texId] = VK_NULL_HANDLE;
+	textureImages[texId] = VK_NULL_HANDLE;
+}
+
+void VulkanRenderer::restoreTexture(int texId)
+{
+	// File is decoded on a worker, the rest happens in updateTextureRestores once it is done
+	textureResidency[texId].restoring = true;
+
+	PendingRestore pending;
+	pending.texId = texId;
+	pending.data = std::make_shared<TextureData>();
+
+	std::string fileName = textureResidency[texId].fileName;
+	std::shared_ptr<TextureData> data = pending.data;
+	pending.decoded = decodingWorkers.submit([this, fileName, data] {
+		*data = loadTexture(fileName);
+	});
+
+	pendingRestores.push_back(std::move(pending));
+}
+
+void VulkanRenderer::updateTextureRestores()
+{
+	for (auto it = pendingRestores.begin(); it != pendingRestores.end(); )
+	{
+		PendingRestore &pending = *it;
+
+		if (!pending.uploaded)
+		{
+			// Still being decoded on a worker
+			if (pending.decoded.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+			{
+				++it;
+				continue;
+			}
+
+			// A texture that can't be loaded back keeps drawing with the placeholder (and isn't tried again)
+			try
+			{
+				pending.decoded.get();
+			}
+			catch (const std::exception &e)
+			{
+				std::cerr << "Failed to load a texture back in: " << e.what() << std::endl;
+				it = pendingRestores.erase(it);
+				continue;
+			}
+
+			TextureData &data = *pending.data;
+			textureImages[pending.texId] = createTextureImageFromData(data, &textureImageMemory[pending.texId]);
+			textureResidency[pending.texId].mipLevels = data.mipLevels;
+			textureResidency[pending.texId].format = data.format;
+			textureImageViews[pending.texId] = createImageView(textureImages[pending.texId], data.format, VK_IMAGE_ASPECT_COLOR_BIT,
+				data.mipLevels);
+			freeTextureData(data);
+
+			// Upload is submitted now rather than with the next frame, so the texture can be drawn with as soon as it is done
+			pending.uploadToken = uploadManager.submit();
+			pending.uploaded = true;
+		}
+
+		if (!uploadManager.isComplete(pending.uploadToken))
+		{
+			++it;
+			continue;
+		}
+
+		// Frames in flight draw with the placeholder's descriptor, not this one, so it can change straight away
+		updateTextureDescriptor(pending.texId, textureImageViews[pending.texId]);
+		textureResidency[pending.texId].restoring = false;
+
+		// Recorded commands still bind the placeholder in its place
+		invalidateCommandBuffers();
+
+		it = pendingRestores.erase(it);
+	}
 }
 
 int VulkanRenderer::createMeshModel(std::string modelFile)
+{
+	ModelData modelData;
+	loadModelData(modelFile, &modelData);
+
+	// Textures are created as their decodes finish, while the rest are still decoding
+	try
+	{
+		createModelTextures(modelData, true, nullptr);
+	}
+	catch (...)
+	{
+		freeModelData(modelData);
+		releaseModelTextures(modelData);
+		throw;
+	}
+	std::vector<Mesh> modelMeshes = createModelMeshes(modelData);
+
+	// Every texture and mesh of the model goes to the GPU in one submission
+	uploadManager.submit();
+
+	// Create mesh model and add to list
+	MeshModel meshModel = MeshModel(modelMeshes);
+	modelList.push_back(meshModel);
+	modelLoadStates.push_back(MODEL_READY);
+
+	// New model must be added to the render list and recorded commands
+	renderListDirty = true;
+	invalidateCommandBuffers();
+
+	return modelList.size() - 1;
+}
+
+int VulkanRenderer::loadModelAsync(std::string modelFile)
+{
+	// Model is in the list straight away so its id can be used, but has no meshes until it is ready
+	modelList.push_back(MeshModel(std::vector<Mesh>()));
+	modelLoadStates.push_back(MODEL_LOADING);
+
+	int modelId = static_cast<int>(modelList.size() - 1);
+
+	PendingModel pending;
+	pending.modelId = modelId;
+	pending.data = std::make_shared<ModelData>();
+
+	// Import and texture decoding only touch the worker's own ModelData
+	std::shared_ptr<ModelData> modelData = pending.data;
+	pending.loaded = loadingWorkers.submit([this, modelFile, modelData] {
+		loadModelData(modelFile, modelData.get());
+	});
+
+	pendingModels.push_back(std::move(pending));
+
+	return modelId;
+}
+
+ModelLoadState VulkanRenderer::getModelLoadState(int modelId)
+{
+	if (modelId >= modelLoadStates.size())
+	{
+		throw std::runtime_error("Attempted to get load state of invalid Model!");
+	}
+
+	return modelLoadStates[modelId];
+}
+
+void VulkanRenderer::setAsyncModelLoading(bool enabled)
+{
+	asyncModelLoading = enabled;
+}
+
+void VulkanRenderer::setTextureContentHashing(bool enabled)
+{
+	textureContentHashing = enabled;
+}
+
+void VulkanRenderer::loadModelData(std::string modelFile, ModelData * modelData)
 {
 	// Import model "scene"
 	Assimp::Importer importer;
@@ -1758,35 +3508,249 @@ int VulkanRenderer::createMeshModel(std::string modelFile)
 	}
 
 	// Get vector of all materials with 1:1 ID placement
-	std::vector<std::string> textureNames = MeshModel::LoadMaterials(scene);
+	std::vector<std::string> materialTextureNames = MeshModel::LoadMaterials(scene);
 
-	// Conversion from the materials list IDs to our Descriptor Array IDs
-	std::vector<int> matToTex(textureNames.size());
+	// Materials sharing a texture file share one texture
+	for (const auto &name : materialTextureNames)
+	{
+		int textureIndex = -1;
+		if (!name.empty())
+		{
+			std::string normalisedName = TextureCache::normalisePath(name);
+			for (size_t t = 0; t < modelData->textureNames.size() && textureIndex < 0; t++)
+			{
+				if (TextureCache::normalisePath(modelData->textureNames[t]) == normalisedName)
+				{
+					textureIndex = static_cast<int>(t);
+				}
+			}
+			if (textureIndex < 0)
+			{
+				textureIndex = static_cast<int>(modelData->textureNames.size());
+				modelData->textureNames.push_back(name);
+			}
+		}
+		modelData->materialTextures.push_back(textureIndex);
+	}
 
-	// Loop over textureNames and create textures for them
-	for (size_t i = 0; i < textureNames.size(); i++)
+	// Read all our meshes
+	MeshModel::LoadNode(scene->mRootNode, scene, modelData->meshes);
+
+	// Decode every texture not already created at once, one task each
+	// Results are collected by createModelTextures, the vectors aren't resized again so each task's data stays put
+	size_t textureCount = modelData->textureNames.size();
+	modelData->textures.resize(textureCount);
+	modelData->contents.resize(textureCount);
+	modelData->textureDecodes.resize(textureCount);
+	modelData->texIds.assign(textureCount, -1);
+	for (size_t i = 0; i < textureCount; i++)
 	{
-		// If material had no texture, set '0' to indicate no texture, texture 0 will be reserved for a default texture
-		if (textureNames[i].empty())
+		std::string fileName = modelData->textureNames[i];
+
+		modelData->texIds[i] = textureCache.acquire(fileName);
+		if (modelData->texIds[i] >= 0) continue;
+
+		TextureData * texture = &modelData->textures[i];
+		TextureContent * content = &modelData->contents[i];
+		bool hashContent = textureContentHashing;
+		modelData->textureDecodes[i] = decodingWorkers.submit([this, fileName, texture, content, hashContent] {
+			*texture = loadTexture(fileName);
+			if (hashContent)
+			{
+				*content = TextureCache::hashContent(texture->contentBytes(), static_cast<size_t>(texture->size), texture->width, texture->height,
+					static_cast<uint32_t>(texture->format));
+			}
+		});
+	}
+}
+
+void VulkanRenderer::freeModelData(ModelData & modelData)
+{
+	// Decodes still running write to the pixels, so let them finish first (their errors no longer matter)
+	for (auto &decode : modelData.textureDecodes)
+	{
+		if (decode.valid())
 		{
-			matToTex[i] = 0;
+			try
+			{
+				decode.get();
+			}
+			catch (...)
+			{
+			}
 		}
-		else
+	}
+
+	for (auto &texture : modelData.textures)
+	{
+		freeTextureData(texture);
+	}
+}
+
+bool VulkanRenderer::createModelTextures(ModelData & modelData, bool wait, uint32_t * textureBudget)
+{
+	while (true)
+	{
+		// Create the texture of each material whose decode has finished, in whatever order they finish
+		size_t oldestDecoding = modelData.textureDecodes.size();
+		for (size_t i = 0; i < modelData.textureDecodes.size(); i++)
 		{
-			// Otherwise, create texture and set value to index of new texture
-			matToTex[i] = createTexture(textureNames[i]);
+			std::future<void> &decode = modelData.textureDecodes[i];
+			if (!decode.valid()) continue;
+
+			// The rest are left for a later frame once this one has created its share (only when not waiting)
+			if (textureBudget && *textureBudget == 0) return false;
+
+			if (decode.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+			{
+				oldestDecoding = std::min(oldestDecoding, i);
+				continue;
+			}
+
+			// Rethrows if the file couldn't be decoded
+			decode.get();
+
+			// Another model may have created it since, or it may be a copy of one already created under another name
+			const std::string &fileName = modelData.textureNames[i];
+			TextureData &texture = modelData.textures[i];
+			int texId = textureCache.acquire(fileName);
+			if (texId < 0)
+			{
+				texId = textureCache.acquireContent(fileName, modelData.contents[i], texture.contentBytes());
+			}
+			if (texId < 0)
+			{
+				texId = createTexture(fileName, texture);
+				textureCache.add(fileName, modelData.contents[i], texture.contentBytes(), texId);
+			}
+			modelData.texIds[i] = texId;
+
+			// Pixels are copied to staging (and to the cache if hashed), so the decoded file can go straight away
+			freeTextureData(texture);
+
+			if (textureBudget) (*textureBudget)--;
 		}
+
+		// Everything decoded and created
+		if (oldestDecoding == modelData.textureDecodes.size()) return true;
+		if (!wait) return false;
+
+		// Sleep until at least one more is ready
+		modelData.textureDecodes[oldestDecoding].wait();
+	}
+}
+
+std::vector<Mesh> VulkanRenderer::createModelMeshes(ModelData & modelData)
+{
+	// Conversion from the materials list IDs to our Descriptor Array IDs
+	std::vector<int> matToTex(modelData.materialTextures.size());
+	for (size_t i = 0; i < matToTex.size(); i++)
+	{
+		// If material had no texture, set '0' to indicate no texture, texture 0 will be reserved for a default texture
+		int textureIndex = modelData.materialTextures[i];
+		matToTex[i] = textureIndex < 0 ? 0 : modelData.texIds[textureIndex];
 	}
 
 	// Load in all our meshes
-	std::vector<Mesh> modelMeshes = MeshModel::LoadNode(mainDevice.physicalDevice, mainDevice.logicalDevice, graphicsQueue, graphicsCommandPool,
-		scene->mRootNode, scene, matToTex);
+	return MeshModel::CreateMeshes(&geometryPool, &uploadManager, modelData.meshes, matToTex);
+}
 
-	// Create mesh model and add to list
-	MeshModel meshModel = MeshModel(modelMeshes);
-	modelList.push_back(meshModel);
+void VulkanRenderer::releaseModelTextures(ModelData & modelData)
+{
+	// One reference was taken for each texture the model found or created
+	// Memory of a texture nothing else references can go (its slot stays, the same as an evicted texture's, pointing at the
+	// placeholder, and a later load that finds it in the cache loads it back when drawing with it)
+	for (auto &texId : modelData.texIds)
+	{
+		if (texId >= 0)
+		{
+			if (textureCache.release(texId) && textureImages[texId] != VK_NULL_HANDLE && !textureResidency[texId].restoring)
+			{
+				evictTexture(texId);
+			}
+			texId = -1;
+		}
+	}
+}
 
-	return modelList.size() - 1;
+void VulkanRenderer::updateModelLoads()
+{
+	// Meshes of at most one model, and only a few textures, are created per frame, so a burst of loads doesn't cause one long frame
+	bool createdMeshes = false;
+	uint32_t textureBudget = MAX_TEXTURE_CREATES_PER_FRAME;
+
+	for (auto it = pendingModels.begin(); it != pendingModels.end(); )
+	{
+		PendingModel &pending = *it;
+
+		if (!pending.uploaded)
+		{
+			// Still being imported on a worker
+			if (pending.loaded.valid() && pending.loaded.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+			{
+				++it;
+				continue;
+			}
+
+			// Textures are created as their decodes finish, the meshes once every texture has been
+			bool meshesCreated = false;
+			try
+			{
+				if (pending.loaded.valid())
+				{
+					pending.loaded.get();
+				}
+				if (createModelTextures(*pending.data, false, &textureBudget) && !createdMeshes)
+				{
+					pending.meshes = createModelMeshes(*pending.data);
+					meshesCreated = true;
+					createdMeshes = true;
+				}
+			}
+			catch (const std::exception &e)
+			{
+				// Textures already created may have uploads queued, so they are only released once those are done
+				std::cerr << "Failed to load model in the background: " << e.what() << std::endl;
+				freeModelData(*pending.data);
+				pending.failed = true;
+			}
+
+			if (!meshesCreated && !pending.failed)
+			{
+				++it;
+				continue;
+			}
+
+			// Uploads are queued with everything else and submitted now, rather than with the next frame,
+			// so the model can join as soon as they are done
+			pending.uploadToken = uploadManager.submit();
+			pending.uploaded = true;
+		}
+
+		// Model only joins the scene once its resources are resident
+		if (!uploadManager.isComplete(pending.uploadToken))
+		{
+			++it;
+			continue;
+		}
+
+		if (pending.failed)
+		{
+			releaseModelTextures(*pending.data);
+			modelLoadStates[pending.modelId] = MODEL_FAILED;
+			it = pendingModels.erase(it);
+			continue;
+		}
+
+		modelList[pending.modelId].setMeshes(pending.meshes);
+		modelLoadStates[pending.modelId] = MODEL_READY;
+
+		// New meshes must be added to the render list and recorded commands
+		renderListDirty = true;
+		invalidateCommandBuffers();
+
+		it = pendingModels.erase(it);
+	}
 }
 
 stbi_uc* VulkanRenderer::loadTextureFile(std::string fileName, int* width, int* height, VkDeviceSize* imageSize)
@@ -1809,6 +3773,69 @@ stbi_uc* VulkanRenderer::loadTextureFile(std::string fileName, int* width, int*
 	return image;
 }
 
+void VulkanRenderer::generateTextureMips(TextureData * textureData)
+{
+	// Full mip chain, down to 1x1
+	uint32_t width = static_cast<uint32_t>(textureData->width);
+	uint32_t height = static_cast<uint32_t>(textureData->height);
+	textureData->mipLevels = MipGenerator::getMipLevels(width, height);
+
+	// Blitted on the GPU if the format can be, otherwise every level is made here (off the render thread) and uploaded as it is
+	if (!optionalFeatures.textureLinearBlit && textureData->mipLevels > 1)
+	{
+		textureData->mipChain = MipGenerator::generateMipChain(textureData->pixels, width, height, textureData->mipLevels);
+	}
+}
+
+VulkanRenderer::TextureData VulkanRenderer::loadTexture(const std::string & fileName)
+{
+	TextureData textureData;
+
+	// Compressed copy sits next to the source image, with the same name (made by --encode-textures)
+	if (!compressedTextureFormats.empty())
+	{
+		std::string compressedName = fileName.substr(0, fileName.find_last_of('.')) + ".ktx2";
+		try
+		{
+			if (KtxFile::load("Textures/" + compressedName, &textureData.compressed))
+			{
+				if (compressedTextureFormats.count(textureData.compressed.format) > 0)
+				{
+					textureData.width = static_cast<int>(textureData.compressed.width);
+					textureData.height = static_cast<int>(textureData.compressed.height);
+					textureData.size = textureData.compressed.data.size();
+					textureData.format = textureData.compressed.format;
+					textureData.mipLevels = textureData.compressed.mipLevels;
+					return textureData;
+				}
+			}
+		}
+		catch (const std::exception &e)
+		{
+			// A broken file is no worse than a missing one, the source image still loads
+			std::cerr << e.what() << std::endl;
+		}
+
+		// Missing, broken, or stored in a format this device can't sample
+		textureData.compressed = KtxTexture();
+	}
+
+	textureData.pixels = loadTextureFile(fileName, &textureData.width, &textureData.height, &textureData.size);
+	generateTextureMips(&textureData);
+	return textureData;
+}
+
+void VulkanRenderer::freeTextureData(TextureData & textureData)
+{
+	if (textureData.pixels)
+	{
+		stbi_image_free(textureData.pixels);
+		textureData.pixels = nullptr;
+	}
+	textureData.mipChain = {};
+	textureData.compressed = KtxTexture();
+}
+
 VKAPI_ATTR VkBool32 VKAPI_CALL VulkanRenderer::debugCallback(VkDebugUtilsMessageSeverityFlagBitsEXT messageSeverity, VkDebugUtilsMessageTypeFlagsEXT messageType, const VkDebugUtilsMessengerCallbackDataEXT* pCallbackData, void* pUserData)
 {
 	std::cerr << "validation layer: " << pCallbackData->pMessage << std::endl;
@@ -16,12 +16,27 @@
 #include <set>
 #include <algorithm>
 #include <array>
+#include <chrono>
+#include <thread>
+#include <future>
+#include <memory>
 
 #include "stb_image.h"
 
 #include "Mesh.h"
 #include "MeshModel.h"
 #include "Utilities.h"
+#include "ThreadPool.h"
+#include "TransientRing.h"
+#include "GeometryPool.h"
+#include "MemoryAllocator.h"
+#include "UploadManager.h"
+#include "ComputeScheduler.h"
+#include "TextureCache.h"
+#include "MipGenerator.h"
+#include "KtxFile.h"
+#include "DrawList.h"
+#include "FrustumCuller.h"
 
 const std::vector<const char*> validationLayers = {
 	"VK_LAYER_KHRONOS_validation"
@@ -41,7 +56,53 @@ public:
 	int init(GLFWwindow * newWindow);
 
 	void updateModel(int modelId, glm::mat4 newModel);
-
+	size_t addInstance(int modelId, glm::mat4 transform);
+	void updateInstance(int modelId, size_t instanceId, glm::mat4 transform);
+	void updateMeshTexture(int modelId, size_t meshIndex, int texId);
+
+	// Start loading a model on a background worker and return its id straight away. The model can be moved and given
+	// instances at once, but has no meshes (so draws nothing) until its import and uploads are done
+	int loadModelAsync(std::string modelFile);
+	ModelLoadState getModelLoadState(int modelId);
+	// Load the scene's models in the background during init, instead of before the first frame
+	void setAsyncModelLoading(bool enabled);
+	// Also share textures whose pixels match one already loaded under another name (costs a hash of every texture decoded)
+	void setTextureContentHashing(bool enabled);
+
+	void setCommandBufferCaching(bool enabled);
+	void setParallelRecording(bool enabled);
+	void setIndirectDrawing(bool enabled);
+	void setGpuCulling(bool enabled);
+	void setCpuCulling(bool enabled);
+	void setFramesInFlight(uint32_t count);
+
+	// Sample textures from one array indexed per draw, rather than binding a set per texture
+	// Must be set before init, falls back to a set per texture if the device lacks descriptor indexing
+	void setBindlessTextures(bool enabled);
+
+	// Call when the window's framebuffer changes size, swapchain is rebuilt on the next frame
+	void notifyFramebufferResized();
+
+	// Presentation policy: IMMEDIATE (lowest latency, tears), MAILBOX (low latency, no tearing),
+	// FIFO (vsync, lowest power) or FIFO_RELAXED (vsync, tears when late). Falls back to FIFO if unsupported
+	void setPresentMode(VkPresentModeKHR mode);
+	VkPresentModeKHR getPresentMode();
+
+	// Limit frame rate on the CPU (0 = unlimited)
+	void setTargetFrameRate(double framesPerSecond);
+
+	// Most device local memory to use, in bytes (0 = as much as the driver's budget allows)
+	// Least recently used textures are evicted to stay within it, and loaded again when next drawn if there is room
+	void setMemoryBudget(VkDeviceSize bytes);
+
+	const FrameTimings & getFrameTimings();
+	const DrawStats & getDrawStats();
+	const MemoryStats & getMemoryStats();
+
+	// Frame numbers start at 1, a resource used by frame N is free once getCompletedFrame() >= N
+	uint64_t getSubmittedFrame();
+	uint64_t getCompletedFrame();
+	void waitForFrame(uint64_t targetFrame);
 
 	void draw();
 	void cleanup();
@@ -52,9 +113,72 @@ private:
 	GLFWwindow * window;
 
 	int currentFrame = 0;
+	uint32_t framesInFlight = DEFAULT_FRAME_DRAWS;		// Number of frames the CPU may prepare ahead of the GPU (1 to MAX_FRAME_DRAWS)
 
 	//Scene Objects
 	std::vector<MeshModel> modelList;
+	std::vector<ModelLoadState> modelLoadStates;		// State of each model in modelList
+
+	// - Background Model Loading
+	// Decoded texture on the CPU (of a material, or of an evicted texture being loaded back)
+	struct TextureData {
+		stbi_uc * pixels = nullptr;				// RGBA8 pixels (nullptr if the material has no texture, or it was block compressed)
+		KtxTexture compressed;					// Every level block compressed, if loaded from a KTX2 file (undefined format if not)
+		int width = 0;
+		int height = 0;
+		VkDeviceSize size = 0;					// Bytes of pixels, or of every compressed level
+		VkFormat format = VK_FORMAT_R8G8B8A8_UNORM;		// Format of its image
+		uint32_t mipLevels = 1;					// Levels its image gets (a full chain)
+		std::vector<unsigned char> mipChain;	// Every level packed, made by the decoding worker when the GPU can't blit them (empty otherwise)
+
+		// Bytes the content hash covers (size of them)
+		const unsigned char * contentBytes() const
+		{
+			return compressed.format != VK_FORMAT_UNDEFINED ? compressed.data.data() : pixels;
+		}
+	};
+	// Everything read from a model file, before any of it is on the GPU
+	struct ModelData {
+		std::vector<int> materialTextures;			// Texture each material uses, index in to textureNames (-1 if none)
+		std::vector<std::string> textureNames;		// Each texture the model uses, once (however many materials share it)
+		std::vector<TextureData> textures;			// Decoded pixels of each texture (none if it was found in the cache)
+		std::vector<TextureContent> contents;		// Hash and shape of each texture's pixels (hash 0 unless content hashing is on)
+		std::vector<std::future<void>> textureDecodes;	// Decode of each texture on a worker (not valid once collected)
+		std::vector<int> texIds;					// Texture id of each texture (-1 until created or found in the cache)
+		std::vector<MeshData> meshes;
+	};
+	struct PendingModel {
+		int modelId;
+		std::shared_ptr<ModelData> data;			// Filled in by a loading worker
+		std::future<void> loaded;					// Ready once the worker is done (holds any exception it threw)
+		bool uploaded = false;						// GPU resources created and their uploads submitted
+		bool failed = false;						// Load threw, textures it created are released once their uploads are done
+		uint64_t uploadToken = 0;
+		std::vector<Mesh> meshes;					// Given to the model once uploads are complete
+	};
+	ThreadPool loadingWorkers;
+	ThreadPool decodingWorkers;						// Decode textures, one task per texture
+	std::vector<PendingModel> pendingModels;
+	bool asyncModelLoading = false;
+
+	// - Texture Cache
+	TextureCache textureCache;						// Textures already created, by file (and optionally by contents)
+	bool textureContentHashing = false;
+
+	// Everything drawing needs from every mesh of every model, flattened in to arrays (one element per mesh, in model order)
+	// Rebuilt only when the scene changes, so recording just walks the arrays
+	struct RenderList {
+		std::vector<uint32_t> firstIndex;			// Place of mesh's geometry in the geometry pool
+		std::vector<int32_t> vertexOffset;
+		std::vector<uint32_t> indexCount;
+		std::vector<int> texId;
+		std::vector<uint32_t> transformIndex;		// Model whose transform (and instances) the mesh uses
+		std::vector<glm::vec4> boundingSphere;		// Mesh space bounds
+		std::vector<glm::vec3> boundingBoxMin;
+		std::vector<glm::vec3> boundingBoxMax;
+		std::vector<uint32_t> modelFirstMesh;		// Index of each model's first mesh, plus the total mesh count at the end
+	} renderList;
+	bool renderListDirty = true;
 
 	// Scene settings
 	struct UboViewProjection {
@@ -68,20 +192,137 @@ private:
 	VkDebugUtilsMessengerEXT debugMessenger;
 	VkDebugReportCallbackEXT callback;
 	struct {
-		VkPhysicalDevice physicalDevice;
-		VkDevice logicalDevice;
+		VkPhysicalDevice physicalDevice = VK_NULL_HANDLE;
+		VkDevice logicalDevice = VK_NULL_HANDLE;
 	} mainDevice;
+	struct {
+		bool multiDrawIndirect = false;				// More than one draw per indirect draw call
+		bool drawIndirectFirstInstance = false;		// Indirect draws can start past instance 0 (needed to draw indirectly)
+		bool drawIndirectCount = false;				// Number of indirect draws can be read from a buffer
+		bool descriptorIndexing = false;			// Non-uniform indexed, partially bound, update-after-bind texture arrays
+		bool memoryBudget = false;					// VK_EXT_memory_budget, heap budgets and usage from the driver
+		bool textureLinearBlit = false;				// Texture format can be blitted with linear filtering (mips made on the GPU)
+		bool textureCompressionBC = false;			// All BC formats can be sampled
+	} optionalFeatures;								// Features used if the chosen device supports them
+	std::set<VkFormat> compressedTextureFormats;	// Block compressed formats textures can be loaded as (sampled with linear filtering)
 	VkQueue graphicsQueue;
 	VkQueue presentationQueue;
+	VkQueue transferQueue = VK_NULL_HANDLE;		// Streaming uploads, if the device has a transfer only queue family
+	VkQueue computeQueue = VK_NULL_HANDLE;		// Async compute, if the device has a compute family without graphics
 	VkSurfaceKHR surface;
-	VkSwapchainKHR swapchain;
+	VkSwapchainKHR swapchain = VK_NULL_HANDLE;
+	bool swapChainOutOfDate = false;			// Swapchain must be rebuilt after the next present (resize, present mode change)
+	VkPresentModeKHR preferredPresentMode = VK_PRESENT_MODE_MAILBOX_KHR;
+	VkPresentModeKHR presentMode;				// Presentation mode actually in use
 
 	std::vector<SwapchainImage> swapChainImages;
 	std::vector<VkFramebuffer> swapChainFramebuffers;
-	std::vector<VkCommandBuffer> commandBuffers;
+	std::vector<uint64_t> imagesInFlight;		// Number of the last frame that rendered to each swapchain image (0 if none)
+
+	// - Frames In Flight
+	// Everything a frame writes to or records into, so a frame can be prepared while previous frames are still on the GPU
+	struct FrameResources {
+		// Recorded commands reference the framebuffer of the image they draw to, so keep one recording per swapchain image
+		std::vector<VkCommandBuffer> commandBuffers;
+		std::vector<std::vector<VkCommandBuffer>> secondaryCommandBuffers;	// Secondary command buffers per image, one for each worker
+		std::vector<bool> commandBufferDirty;								// Whether the commands for each image must be re-recorded before use
+
+		// Where this frame's data is in the transient ring (recorded into commands)
+		uint32_t vpUniformOffset = 0;
+		VkBuffer instanceBuffer = VK_NULL_HANDLE;
+		VkDeviceSize instanceOffset = 0;
+		VkBuffer indirectBuffer = VK_NULL_HANDLE;	// Indirect draw commands (when drawing indirectly)
+		VkDeviceSize indirectOffset = 0;
+		VkBuffer indirectCountBuffer = VK_NULL_HANDLE;	// Draw count of each batch (when drawing indirectly with counts)
+		VkDeviceSize indirectCountOffset = 0;
+
+		// Uniforms are read through dynamic offsets, the set only changes if the ring grows into a new buffer
+		VkDescriptorSet uniformDescriptorSet;
+		VkBuffer vpUniformBuffer = VK_NULL_HANDLE;		// Ring buffer the set currently points at
+
+		// Buffers the cull shader reads and writes: params, candidates, instances, commands, counts
+		// (the set is only rewritten when these move, which is only safe once the frame's previous work has finished)
+		VkDescriptorSet cullDescriptorSet = VK_NULL_HANDLE;
+		std::array<VkDescriptorBufferInfo, 5> cullBufferInfos = {};
+
+		VkSemaphore imageAvailable;
+		VkSemaphore renderFinished;
+		uint64_t submittedFrame = 0;			// Frame number last submitted using these resources (0 if never)
+	};
+	std::vector<FrameResources> frames;
+	bool commandBufferCaching = true;			// Re-record command buffers only when the scene changes
+
+	// - Device Memory
+	MemoryAllocator memoryAllocator;			// Every buffer and image gets its memory from here
+	VkDeviceSize memoryBudgetLimit = 0;
+	uint32_t deviceLocalHeap = 0;				// Heap textures are allocated from
+	MemoryStats memoryStats;
+
+	// - Transient Data
+	TransientRing transientRing;				// Persistently mapped, one partition per frame in flight
+
+	// - Uploads
+	UploadManager uploadManager;				// Batches copies of new textures and meshes in to as few submits as possible
+
+	// - Async Compute
+	ComputeScheduler computeScheduler;			// Compute work for each frame, on its own queue when the device has one
+
+	// - Geometry
+	GeometryPool geometryPool;					// Vertices and indices of every mesh, bound once for all draws
+
+	// - Frame Completion
+	VkSemaphore frameTimeline;					// Timeline semaphore, GPU sets its value to the number of each frame as it completes
+	uint64_t frameNumber = 0;					// Number of the last frame submitted
+
+	// - Frame Pacing
+	std::chrono::steady_clock::duration targetFrameInterval = std::chrono::steady_clock::duration::zero();
+	std::chrono::steady_clock::time_point nextFrameStart;
+	FrameTimings frameTimings;					// Timings of the last frame drawn
+
+	// - Parallel Recording
+	ThreadPool recordingWorkers;
+	std::vector<VkCommandPool> workerCommandPools;						// One pool per worker, pools can't be used from two threads at once
+	bool parallelRecording = false;
+
+	// - Instances
+	// Range of a frame's instance data each mesh draws (every mesh of a model shares the model's range, unless only some of its instances are visible)
+	struct InstanceRange {
+		uint32_t firstInstance;
+		uint32_t instanceCount;
+	};
+	std::vector<InstanceRange> meshInstanceRanges;		// One for each mesh, counting across all models
+	std::vector<InstanceRange> previousInstanceRanges;	// Last frame's ranges (kept so neither list is reallocated every frame)
+	std::vector<glm::mat4> instanceTransforms;			// World transform of every instance of every model
+
+	// - Draw Sorting
+	DrawList drawList;							// Every mesh, sorted by the state it needs bound
+	DrawStats drawStats;						// Binds recorded/skipped when commands were last recorded
+
+	// - CPU Culling
+	FrustumCuller frustumCuller;
+	std::vector<uint8_t> instanceVisibility;			// Visibility of each instance of each mesh
+	std::vector<uint32_t> meshVisibleCounts;			// Number of visible instances of each mesh
+	bool cpuCulling = false;
+
+	// - Indirect Drawing
+	// Consecutive meshes that use the same texture, drawn by a single indirect draw
+	struct DrawBatch {
+		int texId;
+		uint32_t firstDraw;					// Index of first command of batch in the frame's indirect commands
+		uint32_t drawCount;
+	};
+	std::vector<DrawBatch> drawBatches;
+	bool indirectDrawing = false;
+
+	// - GPU Culling
+	VkDescriptorSetLayout cullSetLayout = VK_NULL_HANDLE;		// Cull objects are only created when GPU culling is active
+	VkPipelineLayout cullPipelineLayout = VK_NULL_HANDLE;
+	VkPipeline cullPipeline = VK_NULL_HANDLE;
+	uint32_t cullCandidateCount = 0;		// Number of draws tested by the cull shader
+	bool gpuCulling = false;
 
 	VkImage depthBufferImage;
-	VkDeviceMemory depthBufferImageMemory;
+	MemoryAllocation depthBufferImageMemory;
 	VkImageView depthBufferImageView;
 
 	VkSampler textureSampler;
@@ -93,24 +334,47 @@ private:
 
 	VkDescriptorPool descriptorPool;
 	VkDescriptorPool samplerDescriptorPool;
-	std::vector<VkDescriptorSet> descriptorSets;
 	std::vector<VkDescriptorSet> samplerDescriptorSets;
 
-	std::vector<VkBuffer> vpUniformBuffer;
-	std::vector<VkDeviceMemory> vpUniformBufferMemory;
+	// -- Bindless Textures
+	VkDescriptorSet bindlessTextureSet = VK_NULL_HANDLE;	// Every texture, as one array (update-after-bind, so textures can be added while in use)
+	uint32_t bindlessTextureCapacity = MAX_BINDLESS_TEXTURES;
+	bool bindlessTextures = false;
 
-	std::vector<VkBuffer> modelDUniformBuffer;
-	std::vector<VkDeviceMemory> modelDUniformBufferMemory;
-
-	//VkDeviceSize minUniformBufferOffset;
-	//size_t modelUniformAlignment;
-	//UboModel * modelTransferSpace;
+	VkDeviceSize minUniformBufferOffset;
+	VkDeviceSize minStorageBufferOffset;
 
 	// -- Assets
 	std::vector<VkImage> textureImages;
-	std::vector<VkDeviceMemory> textureImageMemory;
+	std::vector<MemoryAllocation> textureImageMemory;
 	std::vector<VkImageView> textureImageViews;
 
+	// Evicted textures have no image or view, draws with them bind the placeholder's descriptor until they are loaded again
+	struct TextureResidency {
+		std::string fileName;					// File to load it again from
+		VkDeviceSize size = 0;					// Device memory it needs when resident
+		uint64_t lastUsedFrame = 0;				// Last frame that drew with it
+		uint32_t mipLevels = 1;					// Levels of its image (and view)
+		VkFormat format = VK_FORMAT_R8G8B8A8_UNORM;
+		bool restoring = false;					// Being loaded back (still drawn with the placeholder until its upload completes)
+	};
+	std::vector<TextureResidency> textureResidency;
+
+	// Evicted texture on its way back: decoded on a worker, then uploaded through the upload manager
+	struct PendingRestore {
+		int texId;
+		std::shared_ptr<TextureData> data;			// Filled in by a decoding worker
+		std::future<void> decoded;					// Ready once the worker is done (holds any exception it threw)
+		bool uploaded = false;						// Image created and its upload submitted
+		uint64_t uploadToken = 0;
+	};
+	std::vector<PendingRestore> pendingRestores;
+
+	VkImage placeholderImage = VK_NULL_HANDLE;
+	MemoryAllocation placeholderImageMemory;
+	VkImageView placeholderImageView = VK_NULL_HANDLE;
+	VkDescriptorSet placeholderDescriptorSet = VK_NULL_HANDLE;		// (in bindless mode the placeholder is the last element of the array instead)
+
 	// - Pipeline
 	VkPipeline graphicsPipeline;
 	VkPipelineLayout pipelineLayout;
@@ -123,11 +387,6 @@ private:
 	VkFormat swapChainImageFormat;
 	VkExtent2D swapChainExtent;
 
-	// - Synchronisation
-	std::vector<VkSemaphore> imageAvailable;
-	std::vector<VkSemaphore> renderFinished;
-	std::vector<VkFence> drawFences;
-
 	// Vulkan Functions
 	// - Create Functions
 	void createInstance();
@@ -135,32 +394,63 @@ private:
 	void setupDebugMessenger();
 	void createSurface();
 	void createSwapChain();
+	void recreateSwapChain();
+	void limitFrameRate();
 	void createRenderPass();
 	void createDescriptorSetLayout();
 	void createPushConstantRange();
 	void createGraphicsPipeline();
+	void createCullPipeline();
 	void createDepthBufferImage();
 	void createFramebuffers();
 	void createCommandPool();
 	void createCommandBuffers();
 	void createSynchronisation();
+	void createFrameTimeline();
 	void createTextureSampler();
 
-	void createUniformBuffers();
+	void createMemoryAllocator();
+	void createUploadManager();
+	void createComputeScheduler();
+	void createPlaceholderTexture();
+	void createPlaceholderDescriptor();
+	void createTransientRing();
+	void createGeometryPool();
 	void createDescriptorPool();
 	void createDescriptorSets();
-
-	void updateUniformBuffers(uint32_t imageIndex);
+	void createBindlessTextureSet();
+	void createFrameResources();
+
+	void updateProjection();
+	void updateRenderList();
+	void updateUniformBuffers(uint32_t frameIndex);
+	void updateUniformDescriptorSet(FrameResources & frame);
+	void updateIndirectCommands(uint32_t frameIndex);
+	void sortDraws();
+	bool indirectDrawingActive();
+	bool bindlessTexturesActive();
+	bool gpuCullingActive();
+	void updateCullDescriptorSet(FrameResources & frame, const std::array<VkDescriptorBufferInfo, 5> & bufferInfos);
+
+	// - Destroy Functions
+	void destroySwapChainResources();
+	void destroyCommandBuffers();
+	void destroyFrameResources();
 
 	// - Record Functions
 	void recordCommands(uint32_t currentImage);
+	DrawStats recordSecondaryCommands(uint32_t currentImage, size_t worker, size_t firstDraw, size_t drawCount);
+	void recordViewportAndScissor(VkCommandBuffer commandBuffer);
+	DrawStats recordIndirectDraws(VkCommandBuffer commandBuffer, const FrameResources & frame);
+	void recordCulling(VkCommandBuffer commandBuffer, const FrameResources & frame);
+	void recordTextureBind(VkCommandBuffer commandBuffer, int texId, bool firstBind);
+	DrawStats recordMeshDraws(VkCommandBuffer commandBuffer, const FrameResources & frame, size_t firstDraw, size_t drawCount);
+	uint32_t countUnsortedTextureBinds();
+	void invalidateCommandBuffers();
 
 	// - Get Functions
 	void getPhysicalDevice();
 
-	// - Allocate Funcitions
-	void allocateDynamicBufferTransferSpace();
-
 	// - Support Functions
 	// -- Checker Functions
 	bool checkInstanceExtensionSupport(std::vector<const char*> * checkExtensions);
@@ -181,19 +471,39 @@ private:
 	VkFormat chooseSupportedFormat(const std::vector<VkFormat> &formats, VkImageTiling tiling, VkFormatFeatureFlags featureFlags);
 
 	// -- Create Functions
-	VkImage createImage(uint32_t width, uint32_t height, VkFormat format,VkImageTiling tiling, VkImageUsageFlags useFlags,
-		VkMemoryPropertyFlags propFlags, VkDeviceMemory *imageMemory);
-	VkImageView createImageView(VkImage image, VkFormat format, VkImageAspectFlags aspectFlags);
+	VkImage createImage(uint32_t width, uint32_t height, uint32_t mipLevels, VkFormat format,VkImageTiling tiling, VkImageUsageFlags useFlags,
+		VkMemoryPropertyFlags propFlags, MemoryCategory category, MemoryAllocation *imageMemory);
+	VkImageView createImageView(VkImage image, VkFormat format, VkImageAspectFlags aspectFlags, uint32_t mipLevels);
 	VkShaderModule createShaderModule(const std::vector<char> &code);
 
-	int createTextureImage(std::string fileName);
-	int createTexture(std::string fileName);
+	int createTextureImage(std::string fileName, const TextureData & textureData);
+	VkImage createTextureImageFromData(const TextureData & textureData, MemoryAllocation * imageMemory);
+	VkImage createCompressedTextureImage(const KtxTexture & texture, MemoryAllocation * imageMemory);
+	int createTexture(std::string fileName, const TextureData & textureData);
 	int createTextureDescriptor(VkImageView textureImage);
+	void updateTextureDescriptor(int texId, VkImageView textureImage);
+	void writeTextureDescriptor(VkDescriptorSet descriptorSet, uint32_t arrayElement, VkImageView textureImage);
+
+	// -- Texture Residency
+	void manageTextureMemory();
+	bool evictTextures(uint32_t heapIndex, VkDeviceSize neededBytes);
+	void evictTexture(int texId);
+	void restoreTexture(int texId);
+	void updateTextureRestores();
 
 	int createMeshModel(std::string modelFile);
+	void loadModelData(std::string modelFile, ModelData * modelData);
+	void freeModelData(ModelData & modelData);
+	bool createModelTextures(ModelData & modelData, bool wait, uint32_t * textureBudget);
+	std::vector<Mesh> createModelMeshes(ModelData & modelData);
+	void releaseModelTextures(ModelData & modelData);
+	void updateModelLoads();
 
 	// -- Loader Functions
-	stbi_uc* loadTextureFile(std::string fileName, int* width, int* height, VkDeviceSize* imageSize);
+	stbi_uc* loadTextureFile(std::string fileName, int* width, int* height, VkDeviceSize* imageSize);		// Safe to call from any thread
+	void generateTextureMips(TextureData * textureData);		// Safe to call from any thread
+	TextureData loadTexture(const std::string & fileName);		// Block compressed if it can be, with its mips, safe to call from any thread
+	void freeTextureData(TextureData & textureData);
 	
 	// Static debug callback function
 	static VKAPI_ATTR VkBool32 VKAPI_CALL debugCallback(
@@ -7,12 +7,19 @@
 #include <stdexcept>
 #include <vector>
 #include <iostream>
+#include <string>
 
 #include "VulkanRenderer.h"
+#include "BlockEncoder.h"
 
 GLFWwindow * window;
 VulkanRenderer vulkanRenderer;
 
+void framebufferResizeCallback(GLFWwindow * resizedWindow, int width, int height)
+{
+	vulkanRenderer.notifyFramebufferResized();
+}
+
 void initWindow(std::string wName = "Test Window", const int width = 800, const int height = 600)
 {
 	// Initialise GLFW
@@ -20,13 +27,124 @@ void initWindow(std::string wName = "Test Window", const int width = 800, const
 
 	// Set GLFW to NOT work with OpenGL
 	glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
-	glfwWindowHint(GLFW_RESIZABLE, GLFW_FALSE);
+	glfwWindowHint(GLFW_RESIZABLE, GLFW_TRUE);
 
 	window = glfwCreateWindow(width, height, wName.c_str(), nullptr, nullptr);
+
+	// Swapchain must be rebuilt to match the window whenever it is resized
+	glfwSetFramebufferSizeCallback(window, framebufferResizeCallback);
+}
+
+VkPresentModeKHR parsePresentMode(const std::string & name)
+{
+	if (name == "immediate") return VK_PRESENT_MODE_IMMEDIATE_KHR;
+	if (name == "mailbox") return VK_PRESENT_MODE_MAILBOX_KHR;
+	if (name == "fifo-relaxed") return VK_PRESENT_MODE_FIFO_RELAXED_KHR;
+	return VK_PRESENT_MODE_FIFO_KHR;
 }
 
-int main()
+// Compress each texture (in Textures/) to a KTX2 file beside it, which is loaded instead when the device supports its format
+int encodeTextures(const std::vector<std::string> & fileNames)
 {
+	int result = EXIT_SUCCESS;
+	for (const auto &fileName : fileNames)
+	{
+		int width, height, channels;
+		std::string fileLoc = "Textures/" + fileName;
+		stbi_uc * pixels = stbi_load(fileLoc.c_str(), &width, &height, &channels, STBI_rgb_alpha);
+		if (!pixels)
+		{
+			std::cerr << "Failed to load a Texture file! (" << fileName << ")" << std::endl;
+			result = EXIT_FAILURE;
+			continue;
+		}
+
+		KtxTexture texture = BlockEncoder::encodeTexture(pixels, static_cast<uint32_t>(width), static_cast<uint32_t>(height));
+		stbi_image_free(pixels);
+
+		std::string compressedName = fileName.substr(0, fileName.find_last_of('.')) + ".ktx2";
+		try
+		{
+			KtxFile::save("Textures/" + compressedName, texture);
+		}
+		catch (const std::runtime_error &e)
+		{
+			std::cerr << e.what() << std::endl;
+			result = EXIT_FAILURE;
+			continue;
+		}
+
+		// Compared with the uncompressed level 0 alone, as textures were before mips
+		std::cout << fileName << " -> " << compressedName << ": " << width << "x" << height << ", "
+			<< texture.mipLevels << " levels, " << (width * height * 4) / 1024 << " KB -> " << texture.data.size() / 1024 << " KB ("
+			<< (texture.format == VK_FORMAT_BC3_UNORM_BLOCK ? "BC3" : "BC1") << ")" << std::endl;
+	}
+
+	return result;
+}
+
+int main(int argc, char * argv[])
+{
+	bool showTimings = false;
+
+	// Read launch options (e.g. "--frames-in-flight 3" to trade input latency for throughput)
+	for (int i = 1; i < argc; i++)
+	{
+		std::string option = argv[i];
+		if (option == "--encode-textures")			// Every file named after it is compressed ahead of time, then exits without rendering
+		{
+			return encodeTextures(std::vector<std::string>(argv + i + 1, argv + argc));
+		}
+		else if (option == "--show-timings")
+		{
+			showTimings = true;
+		}
+		else if (option == "--indirect")
+		{
+			vulkanRenderer.setIndirectDrawing(true);
+		}
+		else if (option == "--gpu-culling")			// Culled draws are removed from the indirect commands
+		{
+			vulkanRenderer.setIndirectDrawing(true);
+			vulkanRenderer.setGpuCulling(true);
+		}
+		else if (option == "--bindless")				// One texture array indexed per draw, instead of a set per texture
+		{
+			vulkanRenderer.setBindlessTextures(true);
+		}
+		else if (option == "--cpu-culling")			// Meshes out of view are not drawn at all (best with --indirect, direct draws re-record as view changes)
+		{
+			vulkanRenderer.setCpuCulling(true);
+		}
+		else if (option == "--async-load")				// Models appear once loaded, instead of before the first frame
+		{
+			vulkanRenderer.setAsyncModelLoading(true);
+		}
+		else if (option == "--hash-textures")			// Textures with identical pixels are shared, whatever their file name
+		{
+			vulkanRenderer.setTextureContentHashing(true);
+		}
+		else if (i + 1 < argc)
+		{
+			if (option == "--frames-in-flight")
+			{
+				vulkanRenderer.setFramesInFlight(static_cast<uint32_t>(std::atoi(argv[++i])));
+			}
+			else if (option == "--present-mode")			// immediate, mailbox, fifo or fifo-relaxed
+			{
+				vulkanRenderer.setPresentMode(parsePresentMode(argv[++i]));
+			}
+			else if (option == "--target-fps")
+			{
+				vulkanRenderer.setTargetFrameRate(std::atof(argv[++i]));
+			}
+			else if (option == "--memory-budget")			// Megabytes of device local memory to stay within
+			{
+				vulkanRenderer.setMemoryBudget(static_cast<VkDeviceSize>(std::atof(argv[++i]) * 1024 * 1024));
+			}
+		}
+	}
+
 	// Create Window
 	initWindow("Test Window", 1366, 768);
 
@@ -40,6 +158,11 @@ int main()
 	float deltaTime = 0.0f;
 	float lastTime = 0.0f;
 
+	// Timings summed over the last second when showing timings
+	FrameTimings timingTotals = {};
+	int timedFrames = 0;
+	double lastReport = glfwGetTime();
+
 	// Loop until closed
 	while (!glfwWindowShouldClose(window))
 	{
@@ -65,6 +188,41 @@ int main()
 		//vulkanRenderer.updateModel(1, secondModel);
 
 		vulkanRenderer.draw();
+
+		if (showTimings)
+		{
+			const FrameTimings & timings = vulkanRenderer.getFrameTimings();
+			timingTotals.limiterWait += timings.limiterWait;
+			timingTotals.fenceWait += timings.fenceWait;
+			timingTotals.acquireWait += timings.acquireWait;
+			timingTotals.present += timings.present;
+			timingTotals.cpuFrame += timings.cpuFrame;
+			timedFrames++;
+
+			// Report average timings once a second
+			double now = glfwGetTime();
+			if (now - lastReport >= 1.0)
+			{
+				std::cout << timedFrames << " fps | ms per frame: cpu " << timingTotals.cpuFrame / timedFrames
+					<< ", limiter " << timingTotals.limiterWait / timedFrames
+					<< ", fence " << timingTotals.fenceWait / timedFrames
+					<< ", acquire " << timingTotals.acquireWait / timedFrames
+					<< ", present " << timingTotals.present / timedFrames << std::endl;
+
+				const DrawStats & drawStats = vulkanRenderer.getDrawStats();
+				std::cout << "  draws " << drawStats.drawCount << ", binds " << drawStats.bindCount
+					<< " (" << drawStats.textureBindCount << " texture, " << drawStats.textureBindsSaved << " texture binds saved by sorting)" << std::endl;
+
+				const MemoryStats & memoryStats = vulkanRenderer.getMemoryStats();
+				std::cout << "  device memory " << memoryStats.deviceLocalUsage / (1024 * 1024) << " / " << memoryStats.deviceLocalBudget / (1024 * 1024)
+					<< " MB, textures " << memoryStats.textureMemory / (1024 * 1024) << " MB (" << memoryStats.evictedTextures << " evicted, "
+					<< memoryStats.textureCacheHits << " cache hits)" << std::endl;
+
+				timingTotals = {};
+				timedFrames = 0;
+				lastReport = now;
+			}
+		}
 	}
 
 	vulkanRenderer.cleanup();